@@ -1,5 +1,6 @@
 #include <string>
 #include <vector>
+#include <iostream>
 
 #ifdef _WIN32
 namespace win32
@@ -16,6 +17,9 @@ namespace posix
 #include "PluginManager.h"
 #include "SettingsManager.h"
 #include "CoreManager.h"
+#include "OfflineScanner.h"
+#include "PatchBaker.h"
+#include "PatchManager.h"
 
 std::vector<std::string> getFilesInDirectory(const std::string& path)
 {
@@ -45,7 +49,7 @@ std::vector<std::string> getFilesInDirectory(const std::string& path)
     return result;
 }
 
-int main()
+int main(int argc, char* argv[])
 {
     // Load and save settings from the following file
     SettingsManager& settings = SettingsManager::getSingleton();
@@ -58,6 +62,50 @@ int main()
     for (const auto& plugin : plugins)
         pluginManager.add(pluginsPath + "/" + plugin);
 
+    // With "--scan <module name>=<ELF file>...", resolve the searches ahead of time instead
+    if (argc > 1 && std::string(argv[1]) == "--scan")
+    {
+        OfflineScanner scanner;
+        for (int a = 2; a < argc; ++a)
+        {
+            std::string module = argv[a];
+            size_t separator = module.find('=');
+            if (separator == std::string::npos)
+            {
+                std::cerr << "Usage: " << argv[0] << " --scan <module name>=<ELF file>...\n";
+                return 1;
+            }
+            scanner.addModule(module.substr(0, separator), module.substr(separator + 1));
+        }
+        scanner.addFromPatchManager();
+        auto problems = scanner.writePlan(settings.get("CoreManager.resolutionCacheFile"));
+        for (const auto& problem : problems)
+            std::cerr << problem << '\n';
+        return problems.empty() ? 0 : 1;
+    }
+
+    // With "--bake <patch pack> <module name> <ELF file> <baked ELF file>", write a copy of the file with the patch pack in it
+    if (argc > 1 && std::string(argv[1]) == "--bake")
+    {
+        if (argc != 6)
+        {
+            std::cerr << "Usage: " << argv[0] << " --bake <patch pack> <module name> <ELF file> <baked ELF file>\n";
+            return 1;
+        }
+        if (settings.get("CoreManager.bakeManifestFile").empty())
+            settings.set("CoreManager.bakeManifestFile", "bake.manifest");
+        try
+        {
+            PatchBaker::bake(PatchManager::getSingleton().getPatchPack(argv[2]), argv[3], argv[4], argv[5], settings.get("CoreManager.bakeManifestFile"));
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << e.what() << '\n';
+            return 1;
+        }
+        return 0;
+    }
+
     // Start one instance of the target program
     CoreManager::getSingleton().startCore();
 
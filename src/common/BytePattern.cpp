@@ -0,0 +1,533 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cctype>
+#include <cstring>
+
+#include "BytePattern.h"
+
+namespace
+{
+    // Each op is a byte followed by its operands. Jumps are forward only, from the start of the op.
+    enum Op : uint8_t
+    {
+        MATCH,
+        BYTES, // count, bytes
+        ANY, // count
+        MASK, // value, mask
+        RANGE, // first, last
+        SET, // 256 bit bitmap
+        GAP, // min, max
+        SPLIT, // 16-bit offset of the next alternative to try if this one doesn't match
+        JUMP // 16-bit offset
+    };
+
+    const size_t setSize = 256 / 8;
+
+    size_t getOpSize(const std::vector<uint8_t>& code, size_t pc)
+    {
+        switch (code[pc])
+        {
+            case MATCH:
+                return 1;
+            case BYTES:
+                return pc + 1 < code.size() ? 2 + code[pc + 1] : 2;
+            case ANY:
+                return 2;
+            case MASK: case RANGE: case GAP: case SPLIT: case JUMP:
+                return 3;
+            case SET:
+                return 1 + setSize;
+            default:
+                throw std::logic_error("Invalid pattern.");
+        }
+    }
+
+    size_t readOffset(const std::vector<uint8_t>& code, size_t pc)
+    {
+        return code[pc + 1] | code[pc + 2] << 8;
+    }
+
+    void appendJump(std::vector<uint8_t>& code, Op op, size_t offset)
+    {
+        if (offset > 0xffff)
+            throw std::logic_error("Pattern is too big.");
+        code.push_back(op);
+        code.push_back(offset & 0xff);
+        code.push_back(offset >> 8);
+    }
+
+    class Compiler final
+    {
+        public:
+            explicit Compiler(const std::string& pattern):
+                pattern_(pattern),
+                position_(0)
+            {
+            }
+
+            std::vector<uint8_t> compile()
+            {
+                std::vector<uint8_t> code = parseSequence_();
+                if (position_ < pattern_.size())
+                    throwUnexpected_();
+                code.push_back(MATCH);
+                return code;
+            }
+
+        private:
+            // Until the end of the pattern or of an alternative, with no jumps out of it, so it can be moved around whole
+            std::vector<uint8_t> parseSequence_()
+            {
+                std::vector<uint8_t> code;
+                size_t lastOp = std::string::npos; // Where runs of bytes and anything can be added to
+                auto append = [&code, &lastOp](Op op, uint8_t operand)
+                {
+                    if ((op == BYTES || op == ANY) && lastOp != std::string::npos && code[lastOp] == op && code[lastOp + 1] < 0xff)
+                        ++code[lastOp + 1];
+                    else
+                    {
+                        lastOp = code.size();
+                        code.push_back(op);
+                        code.push_back(1);
+                    }
+                    if (op == BYTES)
+                        code.push_back(operand);
+                };
+
+                for (;;)
+                {
+                    skipWhitespace_();
+                    if (position_ >= pattern_.size() || pattern_[position_] == '|' || pattern_[position_] == ')')
+                        return code;
+
+                    if (pattern_[position_] == '(')
+                    {
+                        std::vector<uint8_t> alternatives = parseAlternatives_();
+                        code.insert(code.end(), alternatives.begin(), alternatives.end());
+                        lastOp = std::string::npos;
+                    }
+                    else if (pattern_[position_] == '[')
+                    {
+                        std::vector<bool> isMember = parseSet_();
+                        size_t count = std::count(isMember.begin(), isMember.end(), true);
+                        size_t first = std::find(isMember.begin(), isMember.end(), true) - isMember.begin();
+                        if (count == 256)
+                            append(ANY, 0);
+                        else if (count == 1)
+                            append(BYTES, first);
+                        else if (std::find(isMember.begin() + first, isMember.end(), false) - isMember.begin() == (ptrdiff_t)(first + count))
+                        {
+                            code.insert(code.end(), {RANGE, (uint8_t)first, (uint8_t)(first + count - 1)});
+                            lastOp = std::string::npos;
+                        }
+                        else
+                        {
+                            code.push_back(SET);
+                            for (size_t b = 0; b < 256; b += 8)
+                            {
+                                uint8_t bits = 0;
+                                for (size_t bit = 0; bit < 8; ++bit)
+                                    bits |= isMember[b + bit] << bit;
+                                code.push_back(bits);
+                            }
+                            lastOp = std::string::npos;
+                        }
+                    }
+                    else if (pattern_[position_] == '{')
+                    {
+                        std::pair<size_t, size_t> gap = parseGap_();
+                        if (gap.first == gap.second)
+                            for (size_t b = 0; b < gap.first; ++b)
+                                append(ANY, 0);
+                        else
+                        {
+                            code.insert(code.end(), {GAP, (uint8_t)gap.first, (uint8_t)gap.second});
+                            lastOp = std::string::npos;
+                        }
+                    }
+                    else
+                    {
+                        // Two characters, each a hex digit or ?
+                        if (position_ + 1 >= pattern_.size())
+                            throwUnexpected_();
+                        int high = parseNibble_(pattern_[position_]);
+                        int low = parseNibble_(pattern_[position_ + 1]);
+                        if (high == -2 || low == -2)
+                            throwUnexpected_();
+                        position_ += 2;
+                        if (high == -1 && low == -1)
+                            append(ANY, 0);
+                        else if (high != -1 && low != -1)
+                            append(BYTES, high << 4 | low);
+                        else
+                        {
+                            code.insert(code.end(), {MASK, (uint8_t)(high == -1 ? low : high << 4), (uint8_t)(high == -1 ? 0x0f : 0xf0)});
+                            lastOp = std::string::npos;
+                        }
+                    }
+                }
+            }
+
+            // SPLIT over each alternative but the last, and each but the last JUMPs over the rest after matching
+            std::vector<uint8_t> parseAlternatives_()
+            {
+                ++position_;
+                std::vector<std::vector<uint8_t>> alternatives;
+                for (;;)
+                {
+                    alternatives.push_back(parseSequence_());
+                    if (position_ >= pattern_.size())
+                        throw std::logic_error("Pattern is missing a ).");
+                    if (pattern_[position_++] == ')')
+                        break;
+                }
+
+                std::vector<uint8_t> code = alternatives.back();
+                for (auto alternative = alternatives.rbegin() + 1; alternative != alternatives.rend(); ++alternative)
+                {
+                    std::vector<uint8_t> rest;
+                    rest.swap(code);
+                    appendJump(code, SPLIT, 3 + alternative->size() + 3);
+                    code.insert(code.end(), alternative->begin(), alternative->end());
+                    appendJump(code, JUMP, 3 + rest.size());
+                    code.insert(code.end(), rest.begin(), rest.end());
+                }
+                return code;
+            }
+
+            std::vector<bool> parseSet_()
+            {
+                ++position_;
+                std::vector<bool> isMember(256, false);
+                bool isNegated = position_ < pattern_.size() && pattern_[position_] == '^';
+                if (isNegated)
+                    ++position_;
+                for (;;)
+                {
+                    skipWhitespace_();
+                    if (position_ >= pattern_.size())
+                        throw std::logic_error("Pattern is missing a ].");
+                    if (pattern_[position_] == ']')
+                        break;
+                    size_t first = parseByte_();
+                    size_t last = first;
+                    skipWhitespace_();
+                    if (position_ < pattern_.size() && pattern_[position_] == '-')
+                    {
+                        ++position_;
+                        skipWhitespace_();
+                        last = parseByte_();
+                        if (last < first)
+                            throw std::logic_error("Pattern has a range that ends before it starts.");
+                    }
+                    for (size_t b = first; b <= last; ++b)
+                        isMember[b] = true;
+                }
+                ++position_;
+                if (isNegated)
+                    isMember.flip();
+                if (std::find(isMember.begin(), isMember.end(), true) == isMember.end())
+                    throw std::logic_error("Pattern has a set that nothing can be in.");
+                return isMember;
+            }
+
+            std::pair<size_t, size_t> parseGap_()
+            {
+                ++position_;
+                std::pair<size_t, size_t> gap;
+                gap.first = parseNumber_();
+                gap.second = gap.first;
+                skipWhitespace_();
+                if (position_ < pattern_.size() && pattern_[position_] == ',')
+                {
+                    ++position_;
+                    gap.second = parseNumber_();
+                }
+                skipWhitespace_();
+                if (position_ >= pattern_.size() || pattern_[position_] != '}')
+                    throw std::logic_error("Pattern is missing a }.");
+                ++position_;
+                if (gap.second < gap.first || gap.second == 0 || gap.second > 0xff)
+                    throw std::logic_error("Pattern gaps have to be from 1 to 255 bytes, and can't end before they start.");
+                return gap;
+            }
+
+            size_t parseByte_()
+            {
+                if (position_ + 1 >= pattern_.size() || parseNibble_(pattern_[position_]) < 0 || parseNibble_(pattern_[position_ + 1]) < 0)
+                    throwUnexpected_();
+                position_ += 2;
+                return parseNibble_(pattern_[position_ - 2]) << 4 | parseNibble_(pattern_[position_ - 1]);
+            }
+
+            size_t parseNumber_()
+            {
+                skipWhitespace_();
+                size_t start = position_;
+                while (position_ < pattern_.size() && std::isdigit((unsigned char)pattern_[position_]))
+                    ++position_;
+                if (start == position_ || position_ - start > 3)
+                    throwUnexpected_();
+                return std::stoul(pattern_.substr(start, position_ - start));
+            }
+
+            int parseNibble_(char c) const // -1 for ?, and -2 if it isn't one
+            {
+                if (c == '?')
+                    return -1;
+                if (!std::isxdigit((unsigned char)c))
+                    return -2;
+                return std::isdigit((unsigned char)c) ? c - '0' : std::tolower((unsigned char)c) - 'a' + 10;
+            }
+
+            void skipWhitespace_()
+            {
+                while (position_ < pattern_.size() && std::isspace((unsigned char)pattern_[position_]))
+                    ++position_;
+            }
+
+            void throwUnexpected_() const
+            {
+                if (position_ >= pattern_.size())
+                    throw std::logic_error("Pattern ends unexpectedly.");
+                throw std::logic_error("Unexpected \"" + pattern_.substr(position_, 1) + "\" at " + itos(position_) + " in pattern.");
+            }
+
+            const std::string& pattern_;
+            size_t position_;
+    };
+}
+
+BytePattern::BytePattern():
+    minSize_(0),
+    maxSize_(0),
+    anchorOffset_(0)
+{
+}
+
+BytePattern::BytePattern(const std::vector<uint8_t>& code):
+    code_(code),
+    minSize_(0),
+    maxSize_(0),
+    anchorOffset_(0)
+{
+    // Every op has to have its operands, and jumps have to land on ops further on, so matching always ends
+    std::vector<size_t> ops;
+    std::vector<bool> isOp(code_.size(), false);
+    for (size_t pc = 0; pc < code_.size(); pc += getOpSize(code_, pc))
+    {
+        if (pc + getOpSize(code_, pc) > code_.size())
+            throw std::logic_error("Invalid pattern.");
+        ops.push_back(pc);
+        isOp[pc] = true;
+    }
+    if (ops.empty() || code_[ops.back()] != MATCH)
+        throw std::logic_error("Invalid pattern.");
+
+    // The sizes of what's matched from each op to the end, worked out backwards as jumps only go forwards
+    std::vector<size_t> minSizes(code_.size());
+    std::vector<size_t> maxSizes(code_.size());
+    for (auto op = ops.crbegin(); op != ops.crend(); ++op)
+    {
+        const size_t pc = *op;
+        const size_t next = pc + getOpSize(code_, pc);
+        switch (code_[pc])
+        {
+            case MATCH:
+                minSizes[pc] = maxSizes[pc] = 0;
+                break;
+
+            case BYTES: case ANY:
+                if (code_[pc + 1] == 0)
+                    throw std::logic_error("Invalid pattern.");
+                minSizes[pc] = code_[pc + 1] + minSizes[next];
+                maxSizes[pc] = code_[pc + 1] + maxSizes[next];
+                break;
+
+            case MASK: case RANGE: case SET:
+                minSizes[pc] = 1 + minSizes[next];
+                maxSizes[pc] = 1 + maxSizes[next];
+                break;
+
+            case GAP:
+                if (code_[pc + 1] > code_[pc + 2])
+                    throw std::logic_error("Invalid pattern.");
+                minSizes[pc] = code_[pc + 1] + minSizes[next];
+                maxSizes[pc] = code_[pc + 2] + maxSizes[next];
+                break;
+
+            case SPLIT: case JUMP:
+            {
+                const size_t target = pc + readOffset(code_, pc);
+                if (target <= pc || target >= code_.size() || !isOp[target])
+                    throw std::logic_error("Invalid pattern.");
+                minSizes[pc] = code_[pc] == JUMP ? minSizes[target] : std::min(minSizes[next], minSizes[target]);
+                maxSizes[pc] = code_[pc] == JUMP ? maxSizes[target] : std::max(maxSizes[next], maxSizes[target]);
+                break;
+            }
+        }
+    }
+    minSize_ = minSizes[0];
+    maxSize_ = maxSizes[0];
+    if (minSize_ == 0)
+        throw std::logic_error("Patterns have to match at least one byte.");
+
+    // Only what's before the first gap or alternative is at a fixed offset
+    size_t offset = 0;
+    for (size_t pc = 0; code_[pc] == BYTES || code_[pc] == ANY || code_[pc] == MASK || code_[pc] == RANGE || code_[pc] == SET; pc += getOpSize(code_, pc))
+    {
+        if (code_[pc] == BYTES && code_[pc + 1] > anchor_.size())
+        {
+            anchor_.assign(&code_[pc + 2], &code_[pc + 2] + code_[pc + 1]);
+            anchorOffset_ = offset;
+        }
+        offset += code_[pc] == BYTES || code_[pc] == ANY ? code_[pc + 1] : 1;
+    }
+}
+
+std::vector<uint8_t> BytePattern::compile(const std::string& pattern)
+{
+    std::vector<uint8_t> code = Compiler(pattern).compile();
+    BytePattern check(code); // Throws if it can't match anything
+    return code;
+}
+
+bool BytePattern::isMatchAt(const uint8_t* address, const uint8_t* end, size_t& size) const
+{
+    const uint8_t* matchEnd;
+    if (code_.empty() || (size_t)(end - address) < minSize_ || !isMatchAt_(0, address, end, matchEnd))
+        return false;
+    size = matchEnd - address;
+    return true;
+}
+
+std::set<uint8_t*> BytePattern::find(const uint8_t* start, size_t size) const
+{
+    std::set<uint8_t*> results;
+    const uint8_t* end = start + size;
+    const uint8_t* candidate = start;
+    while (candidate < end)
+    {
+        // The anchor is searched for with the vectorised memmem() rather than trying every byte
+        if (!anchor_.empty())
+        {
+            if ((size_t)(end - candidate) < anchorOffset_ + anchor_.size())
+                break;
+#ifdef _WIN32
+            const uint8_t* anchor = std::search(candidate + anchorOffset_, end, anchor_.cbegin(), anchor_.cend());
+            if (anchor == end)
+                break;
+#else
+            const uint8_t* anchor = (const uint8_t*)memmem(candidate + anchorOffset_, end - (candidate + anchorOffset_), anchor_.data(), anchor_.size());
+            if (anchor == nullptr)
+                break;
+#endif
+            candidate = anchor - anchorOffset_;
+        }
+
+        size_t matchSize;
+        if (isMatchAt(candidate, end, matchSize))
+        {
+            results.insert((uint8_t*)candidate);
+            candidate += matchSize;
+        }
+        else
+            ++candidate;
+    }
+    return results;
+}
+
+size_t BytePattern::getMinSize() const
+{
+    return minSize_;
+}
+
+size_t BytePattern::getMaxSize() const
+{
+    return maxSize_;
+}
+
+// Private members
+
+bool BytePattern::isMatchAt_(size_t pc, const uint8_t* address, const uint8_t* end, const uint8_t*& matchEnd) const
+{
+    for (;;)
+        switch (code_[pc])
+        {
+            case MATCH:
+                matchEnd = address;
+                return true;
+
+            case BYTES:
+                if ((size_t)(end - address) < code_[pc + 1] || std::memcmp(address, &code_[pc + 2], code_[pc + 1]) != 0)
+                    return false;
+                address += code_[pc + 1];
+                pc += 2 + code_[pc + 1];
+                break;
+
+            case ANY:
+                if ((size_t)(end - address) < code_[pc + 1])
+                    return false;
+                address += code_[pc + 1];
+                pc += 2;
+                break;
+
+            case MASK:
+                if (address >= end || (*address & code_[pc + 2]) != code_[pc + 1])
+                    return false;
+                ++address;
+                pc += 3;
+                break;
+
+            case RANGE:
+                if (address >= end || *address < code_[pc + 1] || *address > code_[pc + 2])
+                    return false;
+                ++address;
+                pc += 3;
+                break;
+
+            case SET:
+                if (address >= end || !(code_[pc + 1 + (*address >> 3)] >> (*address & 0x07) & 1))
+                    return false;
+                ++address;
+                pc += 1 + setSize;
+                break;
+
+            case GAP:
+                for (size_t size = code_[pc + 1]; size <= code_[pc + 2] && size <= (size_t)(end - address); ++size)
+                    if (isMatchAt_(pc + 3, address + size, end, matchEnd))
+                        return true;
+                return false;
+
+            case SPLIT:
+                if (isMatchAt_(pc + 3, address, end, matchEnd))
+                    return true;
+                pc += readOffset(code_, pc);
+                break;
+
+            case JUMP:
+                pc += readOffset(code_, pc);
+                break;
+
+            default:
+                return false;
+        }
+}
@@ -0,0 +1,356 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdexcept>
+#include <algorithm>
+
+#include <cstring>
+#include <cerrno>
+
+#include "ElfImage.h"
+
+#ifndef _WIN32
+namespace posix
+{
+    #include <sys/mman.h>
+    #include <elf.h>
+}
+
+namespace
+{
+    bool isInsideFile(const std::vector<uint8_t>& data, size_t offset, size_t size)
+    {
+        return offset <= data.size() && size <= data.size() - offset;
+    }
+}
+#endif
+
+ElfImage::ElfImage():
+    base_(nullptr),
+    size_(0),
+    isRelocated_(false),
+    fileHash_(0)
+{
+}
+
+ElfImage::~ElfImage()
+{
+    close();
+}
+
+void ElfImage::open(const std::string& pathfile)
+{
+    close();
+#ifdef _WIN32
+    (void)pathfile;
+    throw std::logic_error("ElfImage::open() not implemented");
+#else
+    std::vector<uint8_t> data = readFile(pathfile);
+    if (!isInsideFile(data, 0, sizeof(posix::Elf32_Ehdr)))
+        throw std::runtime_error("Not an ELF file.");
+    const posix::Elf32_Ehdr* header = (const posix::Elf32_Ehdr*)&data[0];
+    if (std::memcmp(header->e_ident, ELFMAG, SELFMAG) != 0 || header->e_ident[EI_CLASS] != ELFCLASS32 || header->e_machine != EM_386 ||
+        (header->e_type != ET_EXEC && header->e_type != ET_DYN))
+        throw std::runtime_error("Not an i386 ELF executable or shared object.");
+    if (!isInsideFile(data, header->e_phoff, header->e_phnum * sizeof(posix::Elf32_Phdr)))
+        throw std::runtime_error("The ELF program headers are truncated.");
+    const posix::Elf32_Phdr* programHeaders = (const posix::Elf32_Phdr*)&data[header->e_phoff];
+
+    // Work out where the loadable segments go, and the build-id while we're at it
+    std::vector<const posix::Elf32_Phdr*> loadHeaders;
+    const posix::Elf32_Phdr* dynamicHeader = nullptr;
+    const posix::Elf32_Phdr* ehFrameHeader = nullptr;
+    std::string buildId;
+    size_t start = (size_t)-1;
+    size_t end = 0;
+    for (size_t s = 0; s < header->e_phnum; ++s)
+    {
+        const posix::Elf32_Phdr& programHeader = programHeaders[s];
+        if (programHeader.p_type == PT_LOAD)
+        {
+            if (!isInsideFile(data, programHeader.p_offset, programHeader.p_filesz) || programHeader.p_filesz > programHeader.p_memsz)
+                throw std::runtime_error("An ELF segment is truncated.");
+            if (programHeader.p_memsz == 0)
+                continue;
+            loadHeaders.push_back(&programHeader);
+            start = std::min(start, (size_t)programHeader.p_vaddr);
+            end = std::max(end, (size_t)programHeader.p_vaddr + programHeader.p_memsz);
+        }
+        else if (programHeader.p_type == PT_DYNAMIC)
+            dynamicHeader = &programHeader;
+        else if (programHeader.p_type == PT_GNU_EH_FRAME)
+            ehFrameHeader = &programHeader;
+        else if (programHeader.p_type == PT_NOTE && buildId.empty() && isInsideFile(data, programHeader.p_offset, programHeader.p_filesz))
+        {
+            const uint8_t* note = &data[programHeader.p_offset];
+            const uint8_t* notesEnd = note + programHeader.p_filesz;
+            while (note + sizeof(posix::Elf32_Nhdr) <= notesEnd)
+            {
+                const posix::Elf32_Nhdr* noteHeader = (const posix::Elf32_Nhdr*)note;
+                const char* name = (const char*)(noteHeader + 1);
+                const uint8_t* desc = (const uint8_t*)name + ((noteHeader->n_namesz + 3) & ~3);
+                if (desc + noteHeader->n_descsz > notesEnd)
+                    break;
+                if (noteHeader->n_type == NT_GNU_BUILD_ID && noteHeader->n_namesz == 4 && std::memcmp(name, "GNU", 4) == 0)
+                {
+                    static const char hexDigits[] = "0123456789abcdef";
+                    for (size_t b = 0; b < noteHeader->n_descsz; ++b)
+                    {
+                        buildId += hexDigits[desc[b] >> 4];
+                        buildId += hexDigits[desc[b] & 0xf];
+                    }
+                    break;
+                }
+                note = desc + ((noteHeader->n_descsz + 3) & ~3);
+            }
+        }
+    }
+    if (loadHeaders.empty())
+        throw std::runtime_error("The ELF file has nothing to load.");
+    Memory::alignPage(start, end);
+
+    // Collect the symbols, preferring the full symbol table over the dynamic one
+    std::map<std::string, size_t> symbols;
+    if (header->e_shoff != 0 && header->e_shentsize == sizeof(posix::Elf32_Shdr) &&
+        isInsideFile(data, header->e_shoff, header->e_shnum * sizeof(posix::Elf32_Shdr)))
+    {
+        const posix::Elf32_Shdr* sectionHeaders = (const posix::Elf32_Shdr*)&data[header->e_shoff];
+        for (const auto& sectionType : {SHT_SYMTAB, SHT_DYNSYM})
+            for (size_t s = 0; s < header->e_shnum; ++s)
+            {
+                const posix::Elf32_Shdr& sectionHeader = sectionHeaders[s];
+                if (sectionHeader.sh_type != (posix::Elf32_Word)sectionType || sectionHeader.sh_link >= header->e_shnum ||
+                    !isInsideFile(data, sectionHeader.sh_offset, sectionHeader.sh_size))
+                    continue;
+                const posix::Elf32_Shdr& stringsHeader = sectionHeaders[sectionHeader.sh_link];
+                if (!isInsideFile(data, stringsHeader.sh_offset, stringsHeader.sh_size))
+                    continue;
+                const posix::Elf32_Sym* symbol = (const posix::Elf32_Sym*)&data[sectionHeader.sh_offset];
+                const posix::Elf32_Sym* symbolsEnd = symbol + sectionHeader.sh_size / sizeof(posix::Elf32_Sym);
+                for (; symbol < symbolsEnd; ++symbol)
+                {
+                    if (symbol->st_shndx == SHN_UNDEF || symbol->st_name == 0 || symbol->st_name >= stringsHeader.sh_size ||
+                        symbol->st_value < start || symbol->st_value >= end)
+                        continue;
+                    const char* name = (const char*)&data[stringsHeader.sh_offset + symbol->st_name];
+                    symbols.emplace(std::string(name, strnlen(name, stringsHeader.sh_size - symbol->st_name)), symbol->st_value - start);
+                }
+            }
+    }
+
+    // Lay the segments out, trying to put executables where they were linked so their absolute pointers still work
+    size_t size = end - start;
+    void* image = posix::mmap(header->e_type == ET_EXEC ? (void*)start : nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (image == MAP_FAILED)
+        throw std::runtime_error(strError(errno));
+    base_ = (uint8_t*)image;
+    size_ = size;
+    const size_t pageAlignment = Memory::getPageAlignment();
+    for (const auto& loadHeader : loadHeaders)
+    {
+        // The loader maps whole pages of the file, so the bytes before an unaligned segment show up too
+        size_t misalignment = std::min(loadHeader->p_vaddr & (pageAlignment - 1), (size_t)loadHeader->p_offset);
+        std::memcpy(base_ + (loadHeader->p_vaddr - misalignment - start), &data[loadHeader->p_offset - misalignment], loadHeader->p_filesz + misalignment);
+
+        Memory::PageInfo segment;
+        segment.start = base_ + (loadHeader->p_vaddr - start);
+        uint8_t* segmentEnd = segment.start + loadHeader->p_memsz;
+        Memory::alignPage((size_t&)segment.start, (size_t&)segmentEnd);
+        segment.size = segmentEnd - segment.start;
+        segment.isReadable = loadHeader->p_flags & PF_R;
+        segment.isWritable = loadHeader->p_flags & PF_W;
+        segment.isExecutable = loadHeader->p_flags & PF_X;
+        segment.pathfile = pathfile;
+        segments_.push_back(segment);
+
+        FileRange_ fileRange;
+        fileRange.rva = loadHeader->p_vaddr - start;
+        fileRange.offset = loadHeader->p_offset;
+        fileRange.size = loadHeader->p_filesz;
+        fileRanges_.push_back(fileRange);
+    }
+
+    // Sections are only needed to narrow searches down, so there just aren't any if their headers are missing
+    if (header->e_shoff != 0 && header->e_shentsize == sizeof(posix::Elf32_Shdr) && header->e_shstrndx < header->e_shnum &&
+        isInsideFile(data, header->e_shoff, header->e_shnum * sizeof(posix::Elf32_Shdr)))
+    {
+        const posix::Elf32_Shdr* sectionHeaders = (const posix::Elf32_Shdr*)&data[header->e_shoff];
+        const posix::Elf32_Shdr& namesHeader = sectionHeaders[header->e_shstrndx];
+        if (isInsideFile(data, namesHeader.sh_offset, namesHeader.sh_size))
+            for (size_t s = 0; s < header->e_shnum; ++s)
+            {
+                const posix::Elf32_Shdr& sectionHeader = sectionHeaders[s];
+                if (!(sectionHeader.sh_flags & SHF_ALLOC) || sectionHeader.sh_size == 0 || sectionHeader.sh_name >= namesHeader.sh_size ||
+                    sectionHeader.sh_addr < start || sectionHeader.sh_addr - start + sectionHeader.sh_size > size_)
+                    continue;
+                const char* name = (const char*)&data[namesHeader.sh_offset + sectionHeader.sh_name];
+                Memory::PageInfo section;
+                section.start = base_ + (sectionHeader.sh_addr - start);
+                section.size = sectionHeader.sh_size;
+                section.isReadable = true;
+                section.isWritable = sectionHeader.sh_flags & SHF_WRITE;
+                section.isExecutable = sectionHeader.sh_flags & SHF_EXECINSTR;
+                section.pathfile = pathfile;
+                sections_.emplace(std::string(name, strnlen(name, namesHeader.sh_size - sectionHeader.sh_name)), section);
+            }
+    }
+
+    // Shared objects only need their relative relocations applied, since pointers to other modules can't point anywhere useful anyway
+    isRelocated_ = header->e_type == ET_DYN || base_ == (uint8_t*)start;
+    const uint8_t* globalOffsetTable = nullptr;
+    if (header->e_type == ET_DYN && dynamicHeader != nullptr && dynamicHeader->p_vaddr >= start &&
+        dynamicHeader->p_vaddr - start + dynamicHeader->p_memsz <= size_)
+    {
+        const size_t relocationOffset = (size_t)base_ - start;
+        size_t relocations = 0;
+        size_t relocationsSize = 0;
+        const posix::Elf32_Dyn* dynamic = (const posix::Elf32_Dyn*)(base_ + (dynamicHeader->p_vaddr - start));
+        const posix::Elf32_Dyn* dynamicEnd = dynamic + dynamicHeader->p_memsz / sizeof(posix::Elf32_Dyn);
+        for (; dynamic < dynamicEnd && dynamic->d_tag != DT_NULL; ++dynamic)
+            if (dynamic->d_tag == DT_REL)
+                relocations = dynamic->d_un.d_ptr;
+            else if (dynamic->d_tag == DT_RELSZ)
+                relocationsSize = dynamic->d_un.d_val;
+            else if (dynamic->d_tag == DT_PLTGOT && dynamic->d_un.d_ptr >= start && dynamic->d_un.d_ptr - start < size_)
+                globalOffsetTable = base_ + (dynamic->d_un.d_ptr - start);
+        if (relocations >= start && relocations - start + relocationsSize <= size_)
+        {
+            const posix::Elf32_Rel* relocation = (const posix::Elf32_Rel*)(base_ + (relocations - start));
+            const posix::Elf32_Rel* relocationsEnd = relocation + relocationsSize / sizeof(posix::Elf32_Rel);
+            for (; relocation < relocationsEnd; ++relocation)
+                if (ELF32_R_TYPE(relocation->r_info) == R_386_RELATIVE && relocation->r_offset >= start &&
+                    relocation->r_offset - start + sizeof(uint32_t) <= size_)
+                    *(uint32_t*)(base_ + (relocation->r_offset - start)) += relocationOffset;
+        }
+    }
+    posix::mprotect(base_, size_, PROT_READ);
+
+    // After relocating, as .eh_frame can have absolute pointers. The section gives its size, but the header is still loaded if it's gone.
+    auto ehFrame = sections_.find(".eh_frame");
+    if (ehFrame != sections_.end())
+        functionIndex_.addEhFrame(ehFrame->second.start, ehFrame->second.start + ehFrame->second.size);
+    else if (ehFrameHeader != nullptr && ehFrameHeader->p_vaddr >= start && ehFrameHeader->p_vaddr - start + 8 <= size_)
+    {
+        const uint8_t* ehFrameStart = FunctionIndex::findEhFrame(base_ + (ehFrameHeader->p_vaddr - start));
+        if (ehFrameStart >= base_ && ehFrameStart < base_ + size_)
+            functionIndex_.addEhFrame(ehFrameStart, base_ + size_);
+    }
+    xrefIndex_.build(segments_);
+    stringIndex_.build(segments_, sections_, globalOffsetTable);
+
+    buildId_ = buildId;
+    fileHash_ = calculateFnv1aHash(data.data(), data.size()); // The same way modules are hashed when they have no build-id
+    symbols_.swap(symbols);
+#endif
+}
+
+void ElfImage::close() noexcept
+{
+#ifndef _WIN32
+    if (base_ != nullptr)
+        posix::munmap(base_, size_);
+#endif
+    base_ = nullptr;
+    size_ = 0;
+    isRelocated_ = false;
+    buildId_.clear();
+    fileHash_ = 0;
+    symbols_.clear();
+    segments_.clear();
+    sections_.clear();
+    functionIndex_ = FunctionIndex();
+    xrefIndex_ = XrefIndex();
+    stringIndex_ = StringIndex();
+    fileRanges_.clear();
+}
+
+bool ElfImage::getIsOpen() const
+{
+    return base_ != nullptr;
+}
+
+uint8_t* ElfImage::getBase() const
+{
+    if (base_ == nullptr)
+        throw std::logic_error("No image opened.");
+    return base_;
+}
+
+size_t ElfImage::getSize() const
+{
+    return size_;
+}
+
+bool ElfImage::getIsRelocated() const
+{
+    return isRelocated_;
+}
+
+uint8_t* ElfImage::getSymbol(const std::string& symbol) const
+{
+    auto found = symbols_.find(symbol);
+    if (found == symbols_.end())
+        throw std::runtime_error("Symbol \"" + symbol + "\" not found in the image.");
+    return getBase() + found->second;
+}
+
+std::string ElfImage::getBuildId() const
+{
+    if (base_ == nullptr)
+        throw std::logic_error("No image opened.");
+    return buildId_;
+}
+
+std::string ElfImage::getFingerprint() const
+{
+    if (base_ == nullptr)
+        throw std::logic_error("No image opened.");
+    return buildId_.empty() ? "fnv1a:" + itos(fileHash_) : buildId_;
+}
+
+const std::vector<Memory::PageInfo>& ElfImage::getSegments() const
+{
+    return segments_;
+}
+
+const std::map<std::string, Memory::PageInfo>& ElfImage::getSections() const
+{
+    return sections_;
+}
+
+const FunctionIndex& ElfImage::getFunctionIndex() const
+{
+    return functionIndex_;
+}
+
+const XrefIndex& ElfImage::getXrefIndex() const
+{
+    return xrefIndex_;
+}
+
+const StringIndex& ElfImage::getStringIndex() const
+{
+    return stringIndex_;
+}
+
+size_t ElfImage::getFileOffset(size_t rva, size_t size) const
+{
+    for (const auto& fileRange : fileRanges_)
+        if (rva >= fileRange.rva && rva - fileRange.rva + size <= fileRange.size)
+            return fileRange.offset + (rva - fileRange.rva);
+    throw std::runtime_error("RVA " + itos(rva) + " isn't loaded from the file.");
+}
@@ -0,0 +1,217 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <map>
+#include <algorithm>
+
+#include <cstring>
+
+#include "FunctionIndex.h"
+
+namespace
+{
+    // DWARF pointer encodings (DW_EH_PE_*)
+    const uint8_t omitEncoding = 0xff;
+    const uint8_t pcRelativeEncoding = 0x10;
+
+    size_t readUleb128(const uint8_t*& data, const uint8_t* end)
+    {
+        size_t result = 0;
+        for (unsigned shift = 0; data < end; shift += 7)
+        {
+            uint8_t byte = *data++;
+            if (shift < sizeof(size_t) * 8)
+                result |= (size_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80))
+                break;
+        }
+        return result;
+    }
+
+    ptrdiff_t readSleb128(const uint8_t*& data, const uint8_t* end)
+    {
+        ptrdiff_t result = 0;
+        unsigned shift = 0;
+        uint8_t byte = 0;
+        while (data < end)
+        {
+            byte = *data++;
+            if (shift < sizeof(ptrdiff_t) * 8)
+                result |= (ptrdiff_t)(byte & 0x7f) << shift;
+            shift += 7;
+            if (!(byte & 0x80))
+                break;
+        }
+        if (shift < sizeof(ptrdiff_t) * 8 && (byte & 0x40))
+            result |= -((ptrdiff_t)1 << shift);
+        return result;
+    }
+
+    template <class T>
+        bool readFixed(const uint8_t*& data, const uint8_t* end, size_t& result)
+    {
+        if (end - data < (ptrdiff_t)sizeof(T))
+            return false;
+        T value;
+        std::memcpy(&value, data, sizeof(T));
+        data += sizeof(T);
+        result = (size_t)value;
+        return true;
+    }
+
+    // Only what shows up in .eh_frame, so nothing relative to text or data bases and nothing indirect
+    bool readEncodedPointer(const uint8_t*& data, const uint8_t* end, uint8_t encoding, size_t& result)
+    {
+        const uint8_t* pointer = data;
+        bool isRead;
+        switch (encoding & 0x0f)
+        {
+            case 0x00 : isRead = readFixed<size_t>(data, end, result); break;
+            case 0x01 : result = readUleb128(data, end); isRead = data <= end; break;
+            case 0x02 : isRead = readFixed<uint16_t>(data, end, result); break;
+            case 0x03 : isRead = readFixed<uint32_t>(data, end, result); break;
+            case 0x04 : isRead = readFixed<uint64_t>(data, end, result); break;
+            case 0x09 : result = readSleb128(data, end); isRead = data <= end; break;
+            case 0x0a : isRead = readFixed<int16_t>(data, end, result); break;
+            case 0x0b : isRead = readFixed<int32_t>(data, end, result); break;
+            case 0x0c : isRead = readFixed<int64_t>(data, end, result); break;
+            default: return false;
+        }
+        if (!isRead)
+            return false;
+        switch (encoding & 0x70)
+        {
+            case 0x00 : return true;
+            case pcRelativeEncoding : result += (size_t)pointer; return true;
+            default: return false;
+        }
+    }
+}
+
+void FunctionIndex::addEhFrame(const uint8_t* ehFrame, const uint8_t* end)
+{
+    std::map<const uint8_t*, uint8_t> fdeEncodings; // By CIE
+    const uint8_t* entry = ehFrame;
+    while (end - entry >= 4)
+    {
+        const uint8_t* entryStart = entry;
+        size_t length;
+        readFixed<uint32_t>(entry, end, length);
+        if (length == 0) // The terminator
+            break;
+        if (length == 0xffffffff || length > (size_t)(end - entry)) // 64-bit lengths don't get used on i386
+            break;
+        const uint8_t* entryEnd = entry + length;
+        const uint8_t* id = entry;
+        size_t cieOffset;
+        readFixed<uint32_t>(entry, entryEnd, cieOffset);
+
+        if (cieOffset == 0)
+        {
+            // A CIE, which only matters for how its FDEs encode their addresses
+            uint8_t fdeEncoding = 0;
+            if (entry < entryEnd)
+            {
+                uint8_t version = *entry++;
+                const char* augmentation = (const char*)entry;
+                entry = (const uint8_t*)std::memchr(entry, 0, entryEnd - entry);
+                if (entry != nullptr)
+                {
+                    ++entry;
+                    size_t pointer;
+                    if (std::strstr(augmentation, "eh") != nullptr)
+                        readFixed<size_t>(entry, entryEnd, pointer);
+                    readUleb128(entry, entryEnd); // Code alignment
+                    readSleb128(entry, entryEnd); // Data alignment
+                    if (version == 1)
+                        ++entry;
+                    else
+                        readUleb128(entry, entryEnd); // Return address register
+                    if (augmentation[0] == 'z')
+                    {
+                        readUleb128(entry, entryEnd);
+                        for (const char* a = augmentation + 1; *a != 0 && entry < entryEnd; ++a)
+                            if (*a == 'R')
+                                fdeEncoding = *entry++;
+                            else if (*a == 'L')
+                                ++entry;
+                            else if (*a == 'P')
+                            {
+                                uint8_t personalityEncoding = *entry++;
+                                if (!readEncodedPointer(entry, entryEnd, personalityEncoding & 0x0f, pointer)) // Just to skip it
+                                    break;
+                            }
+                            else if (*a != 'S' && *a != 'B')
+                                break; // Whatever comes after can't be read
+                    }
+                }
+            }
+            fdeEncodings[entryStart] = fdeEncoding;
+        }
+        else
+        {
+            // An FDE, pointing back from here to its CIE
+            auto fdeEncoding = fdeEncodings.find(id - cieOffset);
+            size_t start;
+            size_t size;
+            if (fdeEncoding != fdeEncodings.end() && fdeEncoding->second != omitEncoding &&
+                readEncodedPointer(entry, entryEnd, fdeEncoding->second, start) &&
+                readEncodedPointer(entry, entryEnd, fdeEncoding->second & 0x0f, size) &&
+                start != 0 && size != 0)
+            {
+                Function function;
+                function.start = (uint8_t*)start;
+                function.size = size;
+                functions_.push_back(function);
+            }
+        }
+        entry = entryEnd;
+    }
+
+    std::sort(functions_.begin(), functions_.end(), [](const Function& a, const Function& b) { return a.start < b.start; });
+    functions_.erase(std::unique(functions_.begin(), functions_.end(), [](const Function& a, const Function& b) { return a.start == b.start; }), functions_.end());
+}
+
+const FunctionIndex::Function* FunctionIndex::find(const uint8_t* address) const
+{
+    // The last function starting at or before the address
+    auto function = std::upper_bound(functions_.cbegin(), functions_.cend(), address,
+        [](const uint8_t* address, const Function& function) { return address < function.start; });
+    if (function == functions_.cbegin())
+        return nullptr;
+    --function;
+    if (address >= function->start + function->size)
+        return nullptr;
+    return &*function;
+}
+
+const std::vector<FunctionIndex::Function>& FunctionIndex::getFunctions() const
+{
+    return functions_;
+}
+
+const uint8_t* FunctionIndex::findEhFrame(const uint8_t* ehFrameHeader)
+{
+    // The version, then how the pointer to .eh_frame is encoded, then the pointer
+    if (ehFrameHeader[0] != 1 || ehFrameHeader[1] == omitEncoding)
+        return nullptr;
+    const uint8_t* data = ehFrameHeader + 4;
+    size_t ehFrame;
+    if (!readEncodedPointer(data, data + 16, ehFrameHeader[1], ehFrame))
+        return nullptr;
+    return (const uint8_t*)ehFrame;
+}
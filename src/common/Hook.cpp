@@ -15,9 +15,12 @@
     along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
+
 #include <cassert>
 
 #include "Hook.h"
+#include "X86.h"
 
 namespace PatchData
 {
@@ -29,6 +32,8 @@ Hook::Hook():
     returnRva(0),
     extraStackSpace(0),
     stackSpaceToPopAfterReturn(0),
+    usedRegisters(UsedRegisters::ALL),
+    isJumpHook(false),
     hookType(Type::BLANK)
 {
 }
@@ -44,6 +49,8 @@ Hook::Hook(const Hook& rvalue):
     prologueInstructionsBytes(rvalue.prologueInstructionsBytes),
     epilogueInstructionsBytes(rvalue.epilogueInstructionsBytes),
     headerIncludes(rvalue.headerIncludes),
+    usedRegisters(rvalue.usedRegisters),
+    isJumpHook(rvalue.isJumpHook),
     hookType(Type::BLANK)
 {
     copyTypeFrom(rvalue);
@@ -63,6 +70,8 @@ Hook& Hook::operator=(const Hook& rvalue)
     prologueInstructionsBytes = rvalue.prologueInstructionsBytes;
     epilogueInstructionsBytes = rvalue.epilogueInstructionsBytes;
     headerIncludes = rvalue.headerIncludes;
+    usedRegisters = rvalue.usedRegisters;
+    isJumpHook = rvalue.isJumpHook;
     copyTypeFrom(rvalue);
     return *this;
 }
@@ -90,6 +99,8 @@ std::vector<uint8_t> Hook::serialise() const
     serialiseIntegralType(data, headerIncludes.size());
     for (const auto& headerInclude : headerIncludes)
         serialiseIntegralTypeContinuousContainer(data, headerInclude);
+    serialiseIntegralType(data, usedRegisters);
+    serialiseIntegralType(data, isJumpHook);
 
     // Serialise specialised hooks
     serialiseIntegralType(data, hookType);
@@ -103,6 +114,22 @@ std::vector<uint8_t> Hook::serialise() const
             serialiseIntegralTypeContinuousContainer(data, getTypeData<SearchHook>().serialise());
             break;
 
+        case Type::FUNCTION :
+            serialiseIntegralTypeContinuousContainer(data, getTypeData<FunctionHook>().serialise());
+            break;
+
+        case Type::IMPORT :
+            serialiseIntegralTypeContinuousContainer(data, getTypeData<ImportHook>().serialise());
+            break;
+
+        case Type::CALL :
+            serialiseIntegralTypeContinuousContainer(data, getTypeData<CallHook>().serialise());
+            break;
+
+        case Type::INSTRUCTION :
+            serialiseIntegralTypeContinuousContainer(data, getTypeData<InstructionHook>().serialise());
+            break;
+
         case Type::BLANK :
             break;
 
@@ -132,6 +159,8 @@ void Hook::deserialise(const std::vector<uint8_t>& data)
     headerIncludes.reserve(headerIncludesSize);
     for (std::vector<std::string>::size_type s = 0; s < headerIncludesSize; ++s)
         headerIncludes.push_back(deserialiseIntegralTypeContinuousContainer<std::vector<std::string>::value_type>(iterator));
+    deserialiseIntegralType(iterator, usedRegisters);
+    deserialiseIntegralType(iterator, isJumpHook);
 
     // Deserialise specialised hooks
     switch (deserialiseIntegralType<Type>(iterator))
@@ -144,6 +173,22 @@ void Hook::deserialise(const std::vector<uint8_t>& data)
             setType<SearchHook>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
             break;
 
+        case Type::FUNCTION :
+            setType<FunctionHook>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            break;
+
+        case Type::IMPORT :
+            setType<ImportHook>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            break;
+
+        case Type::CALL :
+            setType<CallHook>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            break;
+
+        case Type::INSTRUCTION :
+            setType<InstructionHook>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            break;
+
         case Type::BLANK :
             clearType();
             break;
@@ -165,6 +210,22 @@ void Hook::copyTypeFrom(const Hook& rvalue)
             setType<SearchHook>(rvalue.getTypeData<SearchHook>());
             break;
 
+        case Type::FUNCTION :
+            setType<FunctionHook>(rvalue.getTypeData<FunctionHook>());
+            break;
+
+        case Type::IMPORT :
+            setType<ImportHook>(rvalue.getTypeData<ImportHook>());
+            break;
+
+        case Type::CALL :
+            setType<CallHook>(rvalue.getTypeData<CallHook>());
+            break;
+
+        case Type::INSTRUCTION :
+            setType<InstructionHook>(rvalue.getTypeData<InstructionHook>());
+            break;
+
         case Type::BLANK :
             clearType();
             break;
@@ -186,6 +247,22 @@ void Hook::clearType()
             delete &getTypeData<SearchHook>();
             break;
 
+        case Type::FUNCTION :
+            delete &getTypeData<FunctionHook>();
+            break;
+
+        case Type::IMPORT :
+            delete &getTypeData<ImportHook>();
+            break;
+
+        case Type::CALL :
+            delete &getTypeData<CallHook>();
+            break;
+
+        case Type::INSTRUCTION :
+            delete &getTypeData<InstructionHook>();
+            break;
+
         case Type::BLANK :
             break;
 
@@ -202,6 +279,14 @@ Hook::Type Hook::getType() const
 
 void Hook::checkValid() const
 {
+    if (isJumpHook)
+    {
+        if (hookType == Type::FUNCTION || hookType == Type::IMPORT)
+            throw std::logic_error("Function and import hooks have a detour, so cannot also be jump hooks.");
+        if (returnRva != 0 || extraStackSpace != 0 || stackSpaceToPopAfterReturn != 0 || !prologueInstructionsBytes.empty() || !epilogueInstructionsBytes.empty())
+            throw std::logic_error("Jump hooks relocate the instructions they overwrite, so cannot have a return RVA, stack space or instructions bytes.");
+    }
+
     switch (hookType)
     {
         case Type::NAME :
@@ -212,6 +297,22 @@ void Hook::checkValid() const
             getTypeData<SearchHook>().checkValid(*this);
             break;
 
+        case Type::FUNCTION :
+            getTypeData<FunctionHook>().checkValid(*this);
+            break;
+
+        case Type::IMPORT :
+            getTypeData<ImportHook>().checkValid(*this);
+            break;
+
+        case Type::CALL :
+            getTypeData<CallHook>().checkValid(*this);
+            break;
+
+        case Type::INSTRUCTION :
+            getTypeData<InstructionHook>().checkValid(*this);
+            break;
+
         case Type::BLANK :
             throw std::logic_error("Hook cannot be blank.");
 
@@ -266,4 +367,168 @@ void SearchHook::checkValid(const Hook& parent) const
     Search::checkValid(parent.hookRva + 5 + parent.returnRva);
 }
 
+std::vector<uint8_t> CallHook::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, CallSearch::serialise());
+
+    return data;
+}
+
+void CallHook::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    CallSearch::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+}
+
+void CallHook::checkValid(const Hook& parent) const
+{
+    // Indirect calls are longer than the jump, so only relocating the whole call lands back on an instruction
+    if (!parent.isJumpHook || parent.hookRva != 0)
+        throw std::logic_error("Call hooks have to be jump hooks at the call, with a hook RVA of 0.");
+    if (callIndex == (size_t)-1)
+        throw std::logic_error("Call hooks have to pick one call, as each jump hook has a single trampoline.");
+    CallSearch::checkValid();
+}
+
+std::vector<uint8_t> InstructionHook::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, InstructionSearch::serialise());
+
+    return data;
+}
+
+void InstructionHook::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    InstructionSearch::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+}
+
+void InstructionHook::checkValid(const Hook& parent) const
+{
+    InstructionSearch::checkValid(parent.hookRva + 5 + parent.returnRva);
+}
+
+FunctionSignature::FunctionSignature():
+    callingConvention(CallingConvention::CDECL),
+    returnType("void")
+{
+}
+
+std::vector<uint8_t> FunctionSignature::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralType(data, callingConvention);
+    serialiseIntegralTypeContinuousContainer(data, returnType);
+    // parameters
+    serialiseIntegralType(data, parameters.size());
+    for (const auto& parameter : parameters)
+    {
+        serialiseIntegralTypeContinuousContainer(data, parameter.first);
+        serialiseIntegralTypeContinuousContainer(data, parameter.second);
+    }
+
+    return data;
+}
+
+void FunctionSignature::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralType(iterator, callingConvention);
+    deserialiseIntegralTypeContinuousContainer(iterator, returnType);
+    // parameters
+    std::vector<std::pair<std::string, std::string>>::size_type parametersSize = deserialiseIntegralType<std::vector<std::pair<std::string, std::string>>::size_type>(iterator);
+    parameters.clear();
+    parameters.reserve(parametersSize);
+    for (std::vector<std::pair<std::string, std::string>>::size_type p = 0; p < parametersSize; ++p)
+    {
+        std::string name = deserialiseIntegralTypeContinuousContainer<std::string>(iterator);
+        std::string type = deserialiseIntegralTypeContinuousContainer<std::string>(iterator);
+        parameters.push_back(std::make_pair(name, type));
+    }
+}
+
+void FunctionSignature::checkValid(const Hook& parent) const
+{
+    if (parent.hookRva != 0)
+        throw std::logic_error("Hooks with a function signature must have a hook RVA of 0.");
+    if (returnType.empty())
+        throw std::logic_error("The return type cannot be empty.");
+    for (const auto& parameter : parameters)
+        if (parameter.first.empty() || parameter.second.empty())
+            throw std::logic_error("Parameter names and types cannot be empty.");
+    if (callingConvention == CallingConvention::THISCALL && parameters.empty())
+        throw std::logic_error("Thiscall functions must have at least one parameter.");
+}
+
+FunctionHook::FunctionHook():
+    prologueSize(0)
+{
+}
+
+std::vector<uint8_t> FunctionHook::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, FunctionSignature::serialise());
+    serialiseIntegralType(data, prologueSize);
+    serialiseIntegralTypeContinuousContainer(data, NameSearch::serialise());
+
+    return data;
+}
+
+void FunctionHook::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    FunctionSignature::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+    deserialiseIntegralType(iterator, prologueSize);
+    NameSearch::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+}
+
+void FunctionHook::checkValid(const Hook& parent) const
+{
+    FunctionSignature::checkValid(parent);
+    if (prologueSize != 0 && prologueSize < X86::jumpSize)
+        throw std::logic_error("The prologue size must be at least 5 bytes to fit a jump.");
+
+    NameSearch::checkValid(std::max(prologueSize, X86::jumpSize));
+}
+
+std::vector<uint8_t> ImportHook::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, FunctionSignature::serialise());
+    serialiseIntegralTypeContinuousContainer(data, ImportSearch::serialise());
+
+    return data;
+}
+
+void ImportHook::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    FunctionSignature::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+    ImportSearch::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+}
+
+void ImportHook::checkValid(const Hook& parent) const
+{
+    FunctionSignature::checkValid(parent);
+    ImportSearch::checkValid();
+}
+
 }
@@ -0,0 +1,722 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+#include <stdexcept>
+
+#include <cctype>
+#include <cstring>
+
+#include "InstructionPattern.h"
+#include "X86.h"
+
+namespace
+{
+    // Where an instruction form has each of its operands
+    enum FormOperand : uint8_t
+    {
+        R8, // The ModRM reg field
+        R32,
+        RM8, // The ModRM r/m field
+        RM16,
+        RM32,
+        M, // The ModRM r/m field, but only memory, like lea's
+        OPCODE_R8, // The low 3 bits of the opcode
+        OPCODE_R32,
+        AL,
+        CL,
+        EAX,
+        ONE,
+        IMM8,
+        IMM8S, // Sign extended to the operand size
+        IMM16,
+        IMM32,
+        MOFFS, // Memory at an absolute address in the immediate
+        REL8,
+        REL32
+    };
+
+    const int modRmRegister = -1; // A /r form
+    const int noModRm = -2;
+
+    class Form final
+    {
+        public:
+            std::string mnemonic;
+            std::vector<uint8_t> opcode;
+            int modRmReg; // The ModRM reg field /0 to /7 forms have, or one of the constants above
+            std::vector<uint8_t> operands;
+    };
+
+    std::vector<Form> makeForms()
+    {
+        std::vector<Form> forms;
+        auto add = [&forms](const std::string& mnemonic, const std::vector<uint8_t>& opcode, int modRmReg, const std::vector<uint8_t>& operands)
+        {
+            Form form;
+            form.mnemonic = mnemonic;
+            form.opcode = opcode;
+            form.modRmReg = modRmReg;
+            form.operands = operands;
+            forms.push_back(form);
+        };
+
+        const char* arithmetics[] = {"add", "or", "adc", "sbb", "and", "sub", "xor", "cmp"};
+        for (uint8_t a = 0; a < 8; ++a)
+        {
+            uint8_t base = a * 8;
+            add(arithmetics[a], {(uint8_t)(base + 0)}, modRmRegister, {RM8, R8});
+            add(arithmetics[a], {(uint8_t)(base + 1)}, modRmRegister, {RM32, R32});
+            add(arithmetics[a], {(uint8_t)(base + 2)}, modRmRegister, {R8, RM8});
+            add(arithmetics[a], {(uint8_t)(base + 3)}, modRmRegister, {R32, RM32});
+            add(arithmetics[a], {(uint8_t)(base + 4)}, noModRm, {AL, IMM8});
+            add(arithmetics[a], {(uint8_t)(base + 5)}, noModRm, {EAX, IMM32});
+            add(arithmetics[a], {0x80}, a, {RM8, IMM8});
+            add(arithmetics[a], {0x81}, a, {RM32, IMM32});
+            add(arithmetics[a], {0x83}, a, {RM32, IMM8S});
+        }
+
+        add("mov", {0x88}, modRmRegister, {RM8, R8});
+        add("mov", {0x89}, modRmRegister, {RM32, R32});
+        add("mov", {0x8a}, modRmRegister, {R8, RM8});
+        add("mov", {0x8b}, modRmRegister, {R32, RM32});
+        add("mov", {0xa1}, noModRm, {EAX, MOFFS});
+        add("mov", {0xa3}, noModRm, {MOFFS, EAX});
+        add("mov", {0xb0}, noModRm, {OPCODE_R8, IMM8});
+        add("mov", {0xb8}, noModRm, {OPCODE_R32, IMM32});
+        add("mov", {0xc6}, 0, {RM8, IMM8});
+        add("mov", {0xc7}, 0, {RM32, IMM32});
+        add("movzx", {0x0f, 0xb6}, modRmRegister, {R32, RM8});
+        add("movzx", {0x0f, 0xb7}, modRmRegister, {R32, RM16});
+        add("movsx", {0x0f, 0xbe}, modRmRegister, {R32, RM8});
+        add("movsx", {0x0f, 0xbf}, modRmRegister, {R32, RM16});
+        add("lea", {0x8d}, modRmRegister, {R32, M});
+        add("xchg", {0x87}, modRmRegister, {RM32, R32});
+
+        add("test", {0x84}, modRmRegister, {RM8, R8});
+        add("test", {0x85}, modRmRegister, {RM32, R32});
+        add("test", {0xa8}, noModRm, {AL, IMM8});
+        add("test", {0xa9}, noModRm, {EAX, IMM32});
+        add("test", {0xf6}, 0, {RM8, IMM8});
+        add("test", {0xf7}, 0, {RM32, IMM32});
+
+        add("inc", {0x40}, noModRm, {OPCODE_R32});
+        add("inc", {0xfe}, 0, {RM8});
+        add("inc", {0xff}, 0, {RM32});
+        add("dec", {0x48}, noModRm, {OPCODE_R32});
+        add("dec", {0xfe}, 1, {RM8});
+        add("dec", {0xff}, 1, {RM32});
+        const char* unaries[] = {"not", "neg", "mul", "imul", "div", "idiv"};
+        for (uint8_t u = 0; u < 6; ++u)
+        {
+            add(unaries[u], {0xf6}, u + 2, {RM8});
+            add(unaries[u], {0xf7}, u + 2, {RM32});
+        }
+        add("imul", {0x0f, 0xaf}, modRmRegister, {R32, RM32});
+        add("imul", {0x6b}, modRmRegister, {R32, RM32, IMM8S});
+        add("imul", {0x69}, modRmRegister, {R32, RM32, IMM32});
+
+        const char* shifts[] = {"rol", "ror", "rcl", "rcr", "shl", "shr", "sal", "sar"};
+        for (uint8_t s = 0; s < 8; ++s)
+        {
+            add(shifts[s], {0xc0}, s, {RM8, IMM8});
+            add(shifts[s], {0xc1}, s, {RM32, IMM8});
+            add(shifts[s], {0xd0}, s, {RM8, ONE});
+            add(shifts[s], {0xd1}, s, {RM32, ONE});
+            add(shifts[s], {0xd2}, s, {RM8, CL});
+            add(shifts[s], {0xd3}, s, {RM32, CL});
+        }
+
+        add("push", {0x50}, noModRm, {OPCODE_R32});
+        add("push", {0x68}, noModRm, {IMM32});
+        add("push", {0x6a}, noModRm, {IMM8S});
+        add("push", {0xff}, 6, {RM32});
+        add("pop", {0x58}, noModRm, {OPCODE_R32});
+        add("pop", {0x8f}, 0, {RM32});
+
+        add("call", {0xe8}, noModRm, {REL32});
+        add("call", {0xff}, 2, {RM32});
+        add("jmp", {0xe9}, noModRm, {REL32});
+        add("jmp", {0xeb}, noModRm, {REL8});
+        add("jmp", {0xff}, 4, {RM32});
+        add("ret", {0xc3}, noModRm, {});
+        add("ret", {0xc2}, noModRm, {IMM16});
+
+        // Every alias of each condition code
+        const std::pair<uint8_t, const char*> conditions[] = {
+            {0x0, "o"}, {0x1, "no"}, {0x2, "b"}, {0x2, "c"}, {0x2, "nae"}, {0x3, "ae"}, {0x3, "nb"}, {0x3, "nc"},
+            {0x4, "e"}, {0x4, "z"}, {0x5, "ne"}, {0x5, "nz"}, {0x6, "be"}, {0x6, "na"}, {0x7, "a"}, {0x7, "nbe"},
+            {0x8, "s"}, {0x9, "ns"}, {0xa, "p"}, {0xa, "pe"}, {0xb, "np"}, {0xb, "po"}, {0xc, "l"}, {0xc, "nge"},
+            {0xd, "ge"}, {0xd, "nl"}, {0xe, "le"}, {0xe, "ng"}, {0xf, "g"}, {0xf, "nle"}};
+        for (const auto& condition : conditions)
+        {
+            add(std::string("j") + condition.second, {(uint8_t)(0x70 + condition.first)}, noModRm, {REL8});
+            add(std::string("j") + condition.second, {0x0f, (uint8_t)(0x80 + condition.first)}, noModRm, {REL32});
+            add(std::string("set") + condition.second, {0x0f, (uint8_t)(0x90 + condition.first)}, 0, {RM8});
+            add(std::string("cmov") + condition.second, {0x0f, (uint8_t)(0x40 + condition.first)}, modRmRegister, {R32, RM32});
+        }
+
+        add("nop", {0x90}, noModRm, {});
+        add("cdq", {0x99}, noModRm, {});
+        add("int3", {0xcc}, noModRm, {});
+        add("leave", {0xc9}, noModRm, {});
+        add("hlt", {0xf4}, noModRm, {});
+        return forms;
+    }
+
+    const std::vector<Form>& getForms()
+    {
+        static const std::vector<Form> forms = makeForms();
+        return forms;
+    }
+
+    bool hasOpcodeRegister(const Form& form)
+    {
+        return !form.operands.empty() && (form.operands[0] == OPCODE_R8 || form.operands[0] == OPCODE_R32);
+    }
+
+    size_t getFormOperandSize(uint8_t formOperand)
+    {
+        switch (formOperand)
+        {
+            case R8: case RM8: case OPCODE_R8: case AL: case CL: case IMM8: case IMM8S: case REL8:
+                return 1;
+            case RM16: case IMM16:
+                return 2;
+            case R32: case RM32: case OPCODE_R32: case EAX: case IMM32: case MOFFS: case REL32:
+                return 4;
+            default:
+                return 0; // lea's memory and the implicit 1 of shifts don't have one
+        }
+    }
+
+    // With a register in its ModRM, which is as short as it can be encoded
+    size_t getFormMinSize(const Form& form)
+    {
+        size_t size = form.opcode.size() + (form.modRmReg != noModRm ? 1 : 0);
+        for (const auto& operand : form.operands)
+            if (operand >= IMM8)
+                size += getFormOperandSize(operand);
+        return size;
+    }
+
+    std::string trim(const std::string& string)
+    {
+        size_t start = string.find_first_not_of(" \t\r");
+        if (start == std::string::npos)
+            return "";
+        return string.substr(start, string.find_last_not_of(" \t\r") - start + 1);
+    }
+
+    bool parseNumber(const std::string& text, int32_t& value)
+    {
+        if (text.empty() || !(std::isdigit(text[0]) || text[0] == '-'))
+            return false;
+        size_t end;
+        long long number;
+        try
+        {
+            number = std::stoll(text, &end, 0);
+        }
+        catch (const std::exception& e)
+        {
+            return false;
+        }
+        if (end != text.size() || number < INT32_MIN || number > UINT32_MAX)
+            return false;
+        value = (int32_t)(uint32_t)number;
+        return true;
+    }
+
+    // Register numbers by name, in ModRM order
+    bool parseRegister(const std::string& text, int& reg, size_t& size)
+    {
+        const char* names[][8] = {
+            {"al", "cl", "dl", "bl", "ah", "ch", "dh", "bh"},
+            {"ax", "cx", "dx", "bx", "sp", "bp", "si", "di"},
+            {"eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi"}};
+        const size_t sizes[] = {1, 2, 4};
+        for (size_t s = 0; s < 3; ++s)
+        {
+            if (text == "r" + itos(sizes[s] * 8))
+            {
+                reg = -1;
+                size = sizes[s];
+                return true;
+            }
+            for (int r = 0; r < 8; ++r)
+                if (text == names[s][r])
+                {
+                    reg = r;
+                    size = sizes[s];
+                    return true;
+                }
+        }
+        return false;
+    }
+}
+
+InstructionPattern::InstructionPattern(const std::string& pattern):
+    isFirstByte_(256, false)
+{
+    const std::vector<Form>& forms = getForms();
+    for (const auto& instruction : split(pattern, ";\n"))
+    {
+        std::string text = trim(instruction);
+        if (text.empty())
+            continue;
+        std::transform(text.begin(), text.end(), text.begin(), ::tolower);
+
+        Template_ instructionTemplate;
+        size_t mnemonicEnd = std::min(text.find_first_of(" \t"), text.size());
+        instructionTemplate.mnemonic = text.substr(0, mnemonicEnd);
+        std::string operands = trim(text.substr(mnemonicEnd));
+        if (!operands.empty())
+            for (const auto& operand : split(operands, ","))
+                instructionTemplate.operands.push_back(parseOperand_(trim(operand)));
+
+        if (instructionTemplate.mnemonic == "*")
+        {
+            if (!instructionTemplate.operands.empty())
+                throw std::logic_error("\"" + text + "\" can be any instruction, so it can't have operands.");
+            instructionTemplate.mnemonic.clear();
+            templates_.push_back(instructionTemplate);
+            continue;
+        }
+
+        bool isKnown = false;
+        for (size_t f = 0; f < forms.size(); ++f)
+        {
+            const Form& form = forms[f];
+            if (form.mnemonic != instructionTemplate.mnemonic)
+                continue;
+            isKnown = true;
+            if (form.operands.size() != instructionTemplate.operands.size())
+                continue;
+            bool isPossible = true;
+            for (size_t o = 0; o < form.operands.size() && isPossible; ++o)
+                isPossible = isOperandPossible_(instructionTemplate.operands[o], form.operands[o]);
+            if (isPossible)
+                instructionTemplate.forms.push_back(f);
+        }
+        if (!isKnown)
+            throw std::logic_error("Unknown instruction \"" + instructionTemplate.mnemonic + "\".");
+        if (instructionTemplate.forms.empty())
+            throw std::logic_error("\"" + instructionTemplate.mnemonic + "\" can't have the operands in \"" + text + "\".");
+        templates_.push_back(instructionTemplate);
+    }
+    if (templates_.empty())
+        throw std::logic_error("Instruction patterns need at least one instruction.");
+
+    if (templates_[0].mnemonic.empty())
+        isFirstByte_.assign(256, true);
+    for (const auto& f : templates_[0].forms)
+        for (uint8_t r = 0; r < (hasOpcodeRegister(forms[f]) ? 8 : 1); ++r)
+            isFirstByte_[forms[f].opcode[0] + r] = true;
+}
+
+bool InstructionPattern::isMatchAt(const uint8_t* code, const uint8_t* end, size_t& size) const
+{
+    const std::vector<Form>& forms = getForms();
+    const uint8_t* instructionStart = code;
+    for (const auto& instructionTemplate : templates_)
+    {
+        if (instructionStart >= end)
+            return false;
+
+        // The decoder reads as far as the longest instruction could go, so don't let it past the end
+        uint8_t buffer[X86::maxInstructionLength] = {};
+        const uint8_t* decodable = instructionStart;
+        if ((size_t)(end - instructionStart) < X86::maxInstructionLength)
+        {
+            std::memcpy(buffer, instructionStart, end - instructionStart);
+            decodable = buffer;
+        }
+        X86::Instruction instruction;
+        try
+        {
+            instruction = X86::decode(decodable);
+        }
+        catch (const std::exception& e)
+        {
+            return false;
+        }
+        if (instruction.length > (size_t)(end - instructionStart))
+            return false;
+
+        if (!instructionTemplate.mnemonic.empty())
+        {
+            if (instruction.prefixesSize != 0)
+                return false;
+            bool isMatch = false;
+            for (auto f = instructionTemplate.forms.cbegin(); f != instructionTemplate.forms.cend() && !isMatch; ++f)
+            {
+                const Form& form = forms[*f];
+                if (form.opcode.size() != instruction.opcodeSize ||
+                    !std::equal(form.opcode.cbegin(), form.opcode.cend() - 1, decodable) ||
+                    (hasOpcodeRegister(form) ? decodable[instruction.opcodeSize - 1] & 0xf8 : decodable[instruction.opcodeSize - 1]) != form.opcode.back() ||
+                    (form.modRmReg >= 0 && (decodable[instruction.opcodeSize] >> 3 & 0x07) != form.modRmReg))
+                    continue;
+                isMatch = true;
+                for (size_t o = 0; o < form.operands.size() && isMatch; ++o)
+                    isMatch = isOperandMatch_(instructionTemplate.operands[o], decodeOperand_(decodable, instruction, form.operands[o]));
+            }
+            if (!isMatch)
+                return false;
+        }
+        instructionStart += instruction.length;
+    }
+    size = instructionStart - code;
+    return true;
+}
+
+std::set<uint8_t*> InstructionPattern::find(const uint8_t* start, size_t size) const
+{
+    std::set<uint8_t*> results;
+    const uint8_t* end = start + size;
+    for (const uint8_t* code = start; code < end;)
+    {
+        size_t matchSize;
+        if (isFirstByte_[*code] && isMatchAt(code, end, matchSize))
+        {
+            results.insert((uint8_t*)code);
+            code += matchSize;
+        }
+        else
+            ++code;
+    }
+    return results;
+}
+
+size_t InstructionPattern::getMinSize() const
+{
+    const std::vector<Form>& forms = getForms();
+    size_t size = 0;
+    for (const auto& instructionTemplate : templates_)
+    {
+        size_t templateSize = instructionTemplate.forms.empty() ? 1 : (size_t)-1; // Any instruction is at least a byte
+        for (const auto& f : instructionTemplate.forms)
+            templateSize = std::min(templateSize, getFormMinSize(forms[f]));
+        size += templateSize;
+    }
+    return size;
+}
+
+size_t InstructionPattern::getMaxSize() const
+{
+    return templates_.size() * X86::maxInstructionLength;
+}
+
+// Private members
+
+InstructionPattern::Operand_ InstructionPattern::parseOperand_(const std::string& text)
+{
+    Operand_ operand = {};
+    if (text.empty())
+        throw std::logic_error("Operands can't be empty.");
+    if (text == "*")
+    {
+        operand.type = OperandType_::ANY;
+        return operand;
+    }
+
+    std::string memory = text;
+    const std::pair<const char*, size_t> sizeNames[] = {{"byte", 1}, {"word", 2}, {"dword", 4}};
+    for (const auto& sizeName : sizeNames)
+    {
+        size_t nameSize = std::strlen(sizeName.first);
+        if (text.compare(0, nameSize, sizeName.first) == 0 && text.size() > nameSize && (text[nameSize] == ' ' || text[nameSize] == '['))
+        {
+            operand.size = sizeName.second;
+            memory = trim(text.substr(nameSize));
+            if (memory.compare(0, 3, "ptr") == 0)
+                memory = trim(memory.substr(3));
+            if (memory.empty() || memory[0] != '[')
+                throw std::logic_error("\"" + text + "\" has a size, so it has to be memory.");
+        }
+    }
+    if (memory[0] == '[')
+    {
+        operand.type = OperandType_::MEMORY;
+        if (memory.back() != ']')
+            throw std::logic_error("\"" + text + "\" is missing a ].");
+        std::string address;
+        for (const auto& c : memory.substr(1, memory.size() - 2))
+            if (c != ' ' && c != '\t')
+                address += c;
+        if (address == "*")
+        {
+            operand.isAnyMemory = true;
+            return operand;
+        }
+
+        // Registers and displacements added together, where displacements can be subtracted too
+        for (size_t termStart = 0; termStart < address.size();)
+        {
+            bool isNegative = address[termStart] == '-';
+            if (address[termStart] == '+' || address[termStart] == '-')
+                ++termStart;
+            size_t termEnd = std::min(address.find_first_of("+-", termStart), address.size());
+            std::string term = address.substr(termStart, termEnd - termStart);
+            termStart = termEnd;
+
+            int32_t displacement;
+            if (term == "imm")
+                operand.isAnyValue = true;
+            else if (parseNumber(term, displacement))
+                operand.value += isNegative ? -displacement : displacement;
+            else
+            {
+                size_t scaleStart = term.find('*');
+                int reg;
+                size_t size;
+                size_t scale = 1;
+                if (scaleStart != std::string::npos)
+                {
+                    int32_t scaleValue;
+                    if (!parseNumber(term.substr(scaleStart + 1), scaleValue) || (scaleValue != 1 && scaleValue != 2 && scaleValue != 4 && scaleValue != 8))
+                        throw std::logic_error("\"" + text + "\" has a scale that isn't 1, 2, 4 or 8.");
+                    scale = scaleValue;
+                }
+                if (!parseRegister(term.substr(0, scaleStart), reg, size) || size != 4)
+                    throw std::logic_error("\"" + text + "\" has something that isn't a 32-bit register, number or imm.");
+                if (isNegative || operand.registersCount == 2)
+                    throw std::logic_error("\"" + text + "\" can't be addressed.");
+                operand.registers[operand.registersCount] = reg;
+                operand.scales[operand.registersCount] = scale;
+                ++operand.registersCount;
+            }
+        }
+        return operand;
+    }
+
+    if (parseRegister(text, operand.reg, operand.size))
+    {
+        operand.type = OperandType_::REGISTER;
+        return operand;
+    }
+
+    const std::pair<const char*, size_t> anyNames[] = {{"imm", 0}, {"imm8", 1}, {"imm16", 2}, {"imm32", 4}, {"rel", 0}, {"rel8", 1}, {"rel32", 4}};
+    for (const auto& anyName : anyNames)
+        if (text == anyName.first)
+        {
+            operand.type = text[0] == 'i' ? OperandType_::IMMEDIATE : OperandType_::RELATIVE;
+            operand.size = anyName.second;
+            operand.isAnyValue = true;
+            return operand;
+        }
+
+    if (parseNumber(text, operand.value))
+    {
+        operand.type = OperandType_::IMMEDIATE;
+        return operand;
+    }
+    throw std::logic_error("Unknown operand \"" + text + "\".");
+}
+
+bool InstructionPattern::isOperandPossible_(const Operand_& templateOperand, uint8_t formOperand)
+{
+    const size_t size = getFormOperandSize(formOperand);
+    switch (templateOperand.type)
+    {
+        case OperandType_::ANY :
+            return true;
+
+        case OperandType_::REGISTER :
+            switch (formOperand)
+            {
+                case AL: case EAX:
+                    return templateOperand.size == size && templateOperand.reg <= 0;
+                case CL:
+                    return templateOperand.size == size && (templateOperand.reg == -1 || templateOperand.reg == 1);
+                case R8: case R32: case RM8: case RM16: case RM32: case OPCODE_R8: case OPCODE_R32:
+                    return templateOperand.size == size;
+                default:
+                    return false;
+            }
+
+        case OperandType_::MEMORY :
+            return (formOperand == RM8 || formOperand == RM16 || formOperand == RM32 || formOperand == M || formOperand == MOFFS) &&
+                (templateOperand.size == 0 || templateOperand.size == size);
+
+        case OperandType_::IMMEDIATE :
+            if (formOperand == ONE)
+                return templateOperand.size == 0 && (templateOperand.isAnyValue || templateOperand.value == 1);
+            return (formOperand == IMM8 || formOperand == IMM8S || formOperand == IMM16 || formOperand == IMM32) &&
+                (templateOperand.size == 0 || templateOperand.size == size);
+
+        case OperandType_::RELATIVE :
+            return (formOperand == REL8 || formOperand == REL32) && (templateOperand.size == 0 || templateOperand.size == size);
+    }
+    return false;
+}
+
+InstructionPattern::Operand_ InstructionPattern::decodeOperand_(const uint8_t* code, const X86::Instruction& instruction, uint8_t formOperand)
+{
+    const uint8_t* opcode = code + instruction.prefixesSize;
+    const uint8_t* modRm = opcode + instruction.opcodeSize;
+    const uint8_t* immediate = code + instruction.immediateOffset;
+    Operand_ operand = {};
+    operand.size = getFormOperandSize(formOperand);
+    switch (formOperand)
+    {
+        case R8: case R32:
+            operand.type = OperandType_::REGISTER;
+            operand.reg = *modRm >> 3 & 0x07;
+            break;
+
+        case OPCODE_R8: case OPCODE_R32:
+            operand.type = OperandType_::REGISTER;
+            operand.reg = opcode[instruction.opcodeSize - 1] & 0x07;
+            break;
+
+        case AL: case CL: case EAX:
+            operand.type = OperandType_::REGISTER;
+            operand.reg = formOperand == CL ? 1 : 0;
+            break;
+
+        case ONE:
+            operand.type = OperandType_::IMMEDIATE;
+            operand.value = 1;
+            break;
+
+        case IMM8:
+            operand.type = OperandType_::IMMEDIATE;
+            operand.value = *immediate;
+            break;
+
+        case IMM8S:
+            operand.type = OperandType_::IMMEDIATE;
+            operand.value = (int8_t)*immediate;
+            break;
+
+        case IMM16:
+        {
+            operand.type = OperandType_::IMMEDIATE;
+            uint16_t value;
+            std::memcpy(&value, immediate, sizeof(value));
+            operand.value = value;
+            break;
+        }
+
+        case IMM32:
+            operand.type = OperandType_::IMMEDIATE;
+            std::memcpy(&operand.value, immediate, sizeof(operand.value));
+            break;
+
+        case MOFFS:
+            operand.type = OperandType_::MEMORY;
+            std::memcpy(&operand.value, immediate, sizeof(operand.value));
+            break;
+
+        case REL8: case REL32:
+            operand.type = OperandType_::RELATIVE;
+            break;
+
+        default: // The ModRM r/m field
+        {
+            const uint8_t mod = *modRm >> 6;
+            const uint8_t rm = *modRm & 0x07;
+            if (mod == 3)
+            {
+                operand.type = OperandType_::REGISTER;
+                operand.reg = rm;
+                break;
+            }
+            operand.type = OperandType_::MEMORY;
+            if (rm == 4)
+            {
+                const uint8_t base = modRm[1] & 0x07;
+                const uint8_t index = modRm[1] >> 3 & 0x07;
+                if (mod != 0 || base != 5)
+                {
+                    operand.registers[operand.registersCount] = base;
+                    operand.scales[operand.registersCount++] = 1;
+                }
+                if (index != 4)
+                {
+                    operand.registers[operand.registersCount] = index;
+                    operand.scales[operand.registersCount++] = 1 << (modRm[1] >> 6);
+                }
+            }
+            else if (mod != 0 || rm != 5)
+            {
+                operand.registers[operand.registersCount] = rm;
+                operand.scales[operand.registersCount++] = 1;
+            }
+            if (instruction.displacementSize == 1)
+                operand.value = (int8_t)code[instruction.displacementOffset];
+            else if (instruction.displacementSize == 4)
+                std::memcpy(&operand.value, code + instruction.displacementOffset, sizeof(operand.value));
+            break;
+        }
+    }
+    return operand;
+}
+
+bool InstructionPattern::isOperandMatch_(const Operand_& templateOperand, const Operand_& operand)
+{
+    if (templateOperand.type == OperandType_::ANY)
+        return true;
+    if (templateOperand.type != operand.type)
+        return false;
+    switch (operand.type)
+    {
+        case OperandType_::REGISTER :
+            return templateOperand.size == operand.size && (templateOperand.reg == -1 || templateOperand.reg == operand.reg);
+
+        case OperandType_::MEMORY :
+        {
+            if (templateOperand.size != 0 && templateOperand.size != operand.size)
+                return false;
+            if (templateOperand.isAnyMemory)
+                return true;
+            if ((!templateOperand.isAnyValue && templateOperand.value != operand.value) || templateOperand.registersCount != operand.registersCount)
+                return false;
+
+            // [eax+ebx] can be encoded with either as the base
+            auto isRegisterMatch = [&](size_t t, size_t r)
+            {
+                return (templateOperand.registers[t] == -1 || templateOperand.registers[t] == operand.registers[r]) &&
+                    templateOperand.scales[t] == operand.scales[r];
+            };
+            if (operand.registersCount == 0)
+                return true;
+            if (operand.registersCount == 1)
+                return isRegisterMatch(0, 0);
+            return (isRegisterMatch(0, 0) && isRegisterMatch(1, 1)) || (isRegisterMatch(0, 1) && isRegisterMatch(1, 0));
+        }
+
+        case OperandType_::IMMEDIATE :
+        {
+            if (templateOperand.size != 0 && templateOperand.size != operand.size)
+                return false;
+            if (templateOperand.isAnyValue || templateOperand.value == operand.value)
+                return true;
+
+            // Negative values match what they'd be encoded as in smaller operands, so "cmp al, -1" finds 3c ff
+            uint32_t mask = operand.size >= 4 || operand.size == 0 ? 0xffffffff : (1u << (8 * operand.size)) - 1;
+            return templateOperand.value < 0 && ((uint32_t)templateOperand.value & mask) == (uint32_t)operand.value;
+        }
+
+        case OperandType_::RELATIVE :
+            return templateOperand.size == 0 || templateOperand.size == operand.size;
+
+        default:
+            return false;
+    }
+}
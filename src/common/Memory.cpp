@@ -234,6 +234,26 @@ std::vector<PageInfo> changePageProtection(PageInfo page)
     return oldPages;
 }
 
+uint8_t* allocatePages(size_t size, bool isExecutable, const uint8_t* hint)
+{
+    uint8_t* start = (uint8_t*)hint;
+    alignPage((size_t&)start, size);
+#ifdef _WIN32
+    // Windows only takes the hint if it's free, so fall back to anywhere
+    win32::DWORD protect = isExecutable ? PAGE_EXECUTE_READ : PAGE_READONLY;
+    uint8_t* result = (uint8_t*)win32::VirtualAlloc(start, size, MEM_COMMIT | MEM_RESERVE, protect);
+    if (result == nullptr && start != nullptr)
+        result = (uint8_t*)win32::VirtualAlloc(nullptr, size, MEM_COMMIT | MEM_RESERVE, protect);
+    if (result == nullptr)
+        throw std::runtime_error(strErrorWin32(win32::GetLastError()));
+#else
+    uint8_t* result = (uint8_t*)posix::mmap(start, size, PROT_READ | (isExecutable ? PROT_EXEC : 0), MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED)
+        throw std::runtime_error(strError(errno));
+#endif
+    return result;
+}
+
 void safeCopy(const std::vector<uint8_t> from, uint8_t* to)
 {
     std::vector<PageInfo> oldPages = changePageProtection({ to, from.size(), true, true, true, "" });
@@ -242,4 +262,26 @@ void safeCopy(const std::vector<uint8_t> from, uint8_t* to)
         changePageProtection(oldPage);
 }
 
+void safeStorePointer(uint8_t** to, uint8_t* value)
+{
+    // Data pages like the GOT shouldn't become executable, even for a moment
+    std::vector<PageInfo> oldPages = queryPage((uint8_t*)to, sizeof(*to));
+    bool isProtectionChanged = false;
+    for (const auto& oldPage : oldPages)
+        if (!oldPage.isReadable || !oldPage.isWritable)
+        {
+            PageInfo newPage = oldPage;
+            newPage.isReadable = true;
+            newPage.isWritable = true;
+            changePageProtection(newPage);
+            isProtectionChanged = true;
+        }
+
+    __atomic_store_n(to, value, __ATOMIC_SEQ_CST);
+
+    if (isProtectionChanged)
+        for (const auto& oldPage : oldPages)
+            changePageProtection(oldPage);
+}
+
 }
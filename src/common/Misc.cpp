@@ -19,8 +19,10 @@
 #include <algorithm>
 #include <stdexcept>
 
+#include <cstdio>
 #include <cstring>
 #include <cstdlib>
+#include <cerrno>
 #include <csignal>
 
 #include "Misc.h"
@@ -147,6 +149,33 @@ bool getInodeAndDeviceId(const std::string& pathfile, uint64_t& inode, uint64_t&
     return true;
 }
 
+std::vector<uint8_t> readFile(const std::string& pathfile)
+{
+    std::FILE* file = std::fopen(pathfile.c_str(), "rb");
+    if (file == nullptr)
+        throw std::runtime_error(strError(errno));
+    std::vector<uint8_t> data;
+    std::vector<uint8_t> buffer(65536);
+    size_t bufferSize;
+    while ((bufferSize = std::fread(&buffer[0], 1, buffer.size(), file)) > 0)
+        data.insert(data.end(), buffer.begin(), buffer.begin() + bufferSize);
+    bool isError = std::ferror(file);
+    std::fclose(file);
+    if (isError)
+        throw std::runtime_error("Could not read \"" + pathfile + "\".");
+    return data;
+}
+
+void writeFile(const std::string& pathfile, const std::vector<uint8_t>& data)
+{
+    std::FILE* file = std::fopen(pathfile.c_str(), "wb");
+    if (file == nullptr)
+        throw std::runtime_error(strError(errno));
+    bool isError = !data.empty() && std::fwrite(&data[0], 1, data.size(), file) != data.size();
+    if (std::fclose(file) != 0 || isError)
+        throw std::runtime_error("Could not write \"" + pathfile + "\".");
+}
+
 uint32_t calculateCrc32Checksum(const std::vector<uint8_t>& data) noexcept
 {
     static bool isCrc32TableInitialised = false;
@@ -171,3 +200,45 @@ uint32_t calculateCrc32Checksum(const std::vector<uint8_t>& data) noexcept
         result = crc32Table[(result ^ d) & 0xff] ^ (result >> 8);
     return ~result;
 }
+
+uint64_t calculateFnv1aHash(const uint8_t* data, size_t size, uint64_t hash) noexcept
+{
+    for (size_t d = 0; d < size; ++d)
+        hash = (hash ^ data[d]) * 1099511628211ULL;
+    return hash;
+}
+
+bool isWildcardPattern(const std::string& pattern) noexcept
+{
+    return pattern.find_first_of("*?") != std::string::npos;
+}
+
+bool isWildcardMatch(const std::string& pattern, const std::string& string) noexcept
+{
+    // Greedy matching that backtracks to the last `*' on a mismatch
+    size_t p = 0;
+    size_t s = 0;
+    size_t starP = std::string::npos;
+    size_t starS = 0;
+    while (s < string.size())
+        if (p < pattern.size() && (pattern[p] == '?' || pattern[p] == string[s]))
+        {
+            ++p;
+            ++s;
+        }
+        else if (p < pattern.size() && pattern[p] == '*')
+        {
+            starP = p++;
+            starS = s;
+        }
+        else if (starP != std::string::npos)
+        {
+            p = starP + 1;
+            s = ++starS;
+        }
+        else
+            return false;
+    while (p < pattern.size() && pattern[p] == '*')
+        ++p;
+    return p == pattern.size();
+}
@@ -16,10 +16,18 @@
 */
 
 #include <memory>
+#include <map>
+#include <mutex>
+#include <utility>
+#include <algorithm>
+#include <sstream>
 #include <stdexcept>
 
+#include <cstdio>
 #include <cstring>
+#include <cerrno>
 #include <cstdlib>
+#include <cctype>
 #include <cassert>
 
 #include <stdint.h>
@@ -70,10 +78,127 @@ namespace posix
 
     using ::realpath; // POSIX stdlib.h function
 }
+
+#include <cxxabi.h>
 #endif
 
 #include "Module.h"
 
+namespace
+{
+    // What's slow to work out about a module, until it's unloaded. It's keyed by the module's base and fingerprint, so a different
+    // module loaded at the same base doesn't get it. Values are shared, so what's been given out outlives its entry.
+    template <typename T>
+    class ModuleCache final
+    {
+        public:
+            template <typename Build>
+            std::shared_ptr<const T> get(uint8_t* base, const std::string& fingerprint, Build build)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                auto found = values_.find(std::make_pair(base, fingerprint));
+                if (found != values_.end())
+                    return found->second;
+                std::shared_ptr<const T> value = std::make_shared<const T>(build());
+                values_.emplace(std::make_pair(base, fingerprint), value);
+                return value;
+            }
+
+            void erase(uint8_t* base)
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                values_.erase(values_.lower_bound(std::make_pair(base, std::string())), values_.lower_bound(std::make_pair(base + 1, std::string())));
+            }
+
+        private:
+            std::mutex mutex_;
+            std::map<std::pair<uint8_t*, std::string>, std::shared_ptr<const T>> values_;
+    };
+
+#ifndef _WIN32
+    // glibc relocates the dynamic section's pointers in place on most architectures, but not all of them
+    uint8_t* getDynamicPointer(const posix::LinkMap* map, size_t tag)
+    {
+        if (map->info[tag] == nullptr)
+            return nullptr;
+        posix::Elf32_Addr address = map->info[tag]->d_un.d_ptr;
+        if (address < map->relocationOffset)
+            address += map->relocationOffset;
+        return (uint8_t*)address;
+    }
+
+    size_t getDynamicValue(const posix::LinkMap* map, size_t tag)
+    {
+        return map->info[tag] == nullptr ? 0 : map->info[tag]->d_un.d_val;
+    }
+
+    // The dynamic symbol table's size isn't stored anywhere, but the hash tables give it away
+    size_t getDynamicSymbolsCount(const posix::LinkMap* map)
+    {
+        const uint32_t* hash = (const uint32_t*)getDynamicPointer(map, DT_HASH);
+        if (hash != nullptr)
+            return hash[1]; // The chain count
+
+        const uint32_t* gnuHash = (const uint32_t*)getDynamicPointer(map, DT_NUM + DT_THISPROCNUM + DT_VERSIONTAGNUM + DT_EXTRANUM + DT_VALNUM + DT_ADDRTAGIDX(DT_GNU_HASH));
+        if (gnuHash == nullptr)
+            return 0;
+        uint32_t bucketsCount = gnuHash[0];
+        uint32_t symbolsOffset = gnuHash[1];
+        const uint32_t* buckets = gnuHash + 4 + gnuHash[2]; // Skip the header and bloom filter
+        const uint32_t* chains = buckets + bucketsCount;
+
+        // Follow the chain of the last bucket to its end
+        uint32_t lastSymbol = 0;
+        for (uint32_t b = 0; b < bucketsCount; ++b)
+            lastSymbol = std::max(lastSymbol, buckets[b]);
+        if (lastSymbol < symbolsOffset)
+            return symbolsOffset;
+        while ((chains[lastSymbol - symbolsOffset] & 1) == 0)
+            ++lastSymbol;
+        return lastSymbol + 1;
+    }
+
+    bool isInsideSegments(const std::vector<Memory::PageInfo>& segments, const void* address, size_t size, bool isExecutable)
+    {
+        for (const auto& segment : segments)
+            if (segment.isReadable && (!isExecutable || segment.isExecutable) &&
+                (const uint8_t*)address >= segment.start && (const uint8_t*)address + size <= segment.start + segment.size)
+                return true;
+        return false;
+    }
+
+    // Only accepts names of classes, so that random data doesn't get mistaken for RTTI
+    std::string demangleTypeName(const char* mangledName)
+    {
+        if (*mangledName == '*') // Marks types local to the module
+            ++mangledName;
+        if (!std::isdigit((unsigned char)*mangledName) && *mangledName != 'N' && *mangledName != 'S')
+            return "";
+        for (const char* c = mangledName; *c != 0; ++c)
+            if (!std::isalnum((unsigned char)*c) && *c != '_')
+                return "";
+
+        int status;
+        char* demangledName = abi::__cxa_demangle(mangledName, nullptr, nullptr, &status);
+        if (status != 0)
+            return "";
+        std::string result = demangledName;
+        std::free(demangledName);
+        return result;
+    }
+
+    ModuleCache<std::map<std::string, Module::Vtable>> vtableIndexes;
+    ModuleCache<std::map<std::string, Memory::PageInfo>> sectionIndexes;
+    ModuleCache<std::map<std::string, uint8_t*>> functionSymbolIndexes;
+    ModuleCache<FunctionIndex> functionIndexes;
+    ModuleCache<XrefIndex> xrefIndexes;
+    ModuleCache<StringIndex> stringIndexes;
+#endif
+
+    std::mutex fingerprintsMutex;
+    std::map<std::pair<uint8_t*, std::string>, std::string> fingerprints; // File hashes by module base and pathfile, as they're slow
+}
+
 Module::Module():
     handle(nullptr),
     isLoaded(false)
@@ -175,6 +300,7 @@ void Module::unload(bool force)
 #endif
     handle = nullptr;
     isLoaded = false;
+    dropCachesIfUnloaded_();
 }
 
 bool Module::unloadNoThrow(bool force) noexcept
@@ -193,9 +319,37 @@ bool Module::unloadNoThrow(bool force) noexcept
 #endif
     handle = nullptr;
     isLoaded = false;
+    dropCachesIfUnloaded_();
     return true;
 }
 
+void Module::dropCachesIfUnloaded_() noexcept
+{
+    try
+    {
+#ifndef _WIN32
+        // Others can still have it loaded, in which case it stays where it is
+        void* otherHandle = posix::dlopen((path + "/" + file).c_str(), RTLD_LAZY | RTLD_NOLOAD);
+        if (otherHandle != nullptr)
+        {
+            posix::dlclose(otherHandle);
+            return;
+        }
+        vtableIndexes.erase(base);
+        sectionIndexes.erase(base);
+        functionSymbolIndexes.erase(base);
+        functionIndexes.erase(base);
+        xrefIndexes.erase(base);
+        stringIndexes.erase(base);
+#endif
+        std::lock_guard<std::mutex> lock(fingerprintsMutex);
+        fingerprints.erase(std::make_pair(base, path + file));
+    }
+    catch (...)
+    {
+    }
+}
+
 void Module::detach() noexcept
 {
     handle = nullptr;
@@ -354,11 +508,346 @@ uint8_t* Module::getSymbol(const std::string& symbol) const
     return result;
 }
 
+uint8_t* Module::getFunction(const std::string& name) const
+{
+    if (handle == nullptr)
+        throw std::logic_error("No module loaded or opened.");
+#ifdef _WIN32
+    return getSymbol(name);
+#else
+    uint8_t* exported = (uint8_t*)posix::dlsym(handle, name.c_str());
+    if (exported != nullptr)
+        return exported;
+    std::string error = posix::dlerror();
+
+    auto functions = functionSymbolIndexes.get(base, getFingerprint(), [this]() -> std::map<std::string, uint8_t*>
+    {
+        posix::LinkMap* map;
+        posix::dlinfo(handle, posix::RTLD_DI_LINKMAP, &map);
+
+        // .symtab isn't loaded, so read it and its strings from the file. It's often stripped, leaving nothing to find.
+        std::FILE* moduleFile = std::fopen((path + "/" + file).c_str(), "rb");
+        if (moduleFile == nullptr)
+            throw std::runtime_error(strError(errno));
+        posix::Elf32_Ehdr header;
+        std::vector<posix::Elf32_Shdr> sectionHeaders;
+        std::vector<posix::Elf32_Sym> symbols;
+        std::vector<char> names;
+        bool isRead = std::fread(&header, sizeof(header), 1, moduleFile) == 1 && header.e_shoff != 0 && header.e_shnum != 0 &&
+            header.e_shentsize == sizeof(posix::Elf32_Shdr);
+        if (isRead)
+        {
+            sectionHeaders.resize(header.e_shnum);
+            isRead = std::fseek(moduleFile, header.e_shoff, SEEK_SET) == 0 &&
+                std::fread(&sectionHeaders[0], sizeof(posix::Elf32_Shdr), sectionHeaders.size(), moduleFile) == sectionHeaders.size();
+        }
+        if (isRead)
+        {
+            auto symbolsHeader = std::find_if(sectionHeaders.cbegin(), sectionHeaders.cend(),
+                [&header](const posix::Elf32_Shdr& sectionHeader) { return sectionHeader.sh_type == SHT_SYMTAB && sectionHeader.sh_link < header.e_shnum; });
+            isRead = symbolsHeader != sectionHeaders.cend();
+            if (isRead)
+            {
+                const posix::Elf32_Shdr& namesHeader = sectionHeaders[symbolsHeader->sh_link];
+                symbols.resize(symbolsHeader->sh_size / sizeof(posix::Elf32_Sym));
+                names.resize(namesHeader.sh_size + 1); // Always ends with a terminator
+                isRead = std::fseek(moduleFile, symbolsHeader->sh_offset, SEEK_SET) == 0 &&
+                    std::fread(symbols.data(), sizeof(posix::Elf32_Sym), symbols.size(), moduleFile) == symbols.size() &&
+                    std::fseek(moduleFile, namesHeader.sh_offset, SEEK_SET) == 0 &&
+                    std::fread(&names[0], 1, namesHeader.sh_size, moduleFile) == namesHeader.sh_size;
+            }
+        }
+        std::fclose(moduleFile);
+
+        std::map<std::string, uint8_t*> result;
+        if (isRead)
+            for (const auto& symbol : symbols)
+                if (ELF32_ST_TYPE(symbol.st_info) == STT_FUNC && symbol.st_shndx != SHN_UNDEF && symbol.st_name != 0 && symbol.st_name < names.size())
+                    result.emplace(&names[symbol.st_name], (uint8_t*)symbol.st_value + (size_t)map->relocationOffset);
+        return result;
+    });
+
+    auto function = functions->find(name);
+    if (function == functions->end())
+        throw std::runtime_error(error);
+    return function->second;
+#endif
+}
+
+std::vector<uint8_t**> Module::getImportSlots(const std::string& symbol) const
+{
+    if (handle == nullptr)
+        throw std::logic_error("No module loaded or opened.");
+#ifdef _WIN32
+    (void)symbol;
+    throw std::logic_error("Module::getImportSlots() not implemented");
+#else
+    posix::LinkMap* map;
+    posix::dlinfo(handle, posix::RTLD_DI_LINKMAP, &map);
+
+    const posix::Elf32_Sym* symbolTable = (const posix::Elf32_Sym*)getDynamicPointer(map, DT_SYMTAB);
+    const char* stringTable = (const char*)getDynamicPointer(map, DT_STRTAB);
+    if (symbolTable == nullptr || stringTable == nullptr)
+        return {};
+
+    // Imported functions are in the PLT relocations, and imported data and functions taken by address are in the GOT ones
+    std::vector<uint8_t**> result;
+    const std::pair<size_t, size_t> relocationTables[] = {{DT_JMPREL, DT_PLTRELSZ}, {DT_REL, DT_RELSZ}};
+    for (const auto& relocationTable : relocationTables)
+    {
+        const posix::Elf32_Rel* relocations = (const posix::Elf32_Rel*)getDynamicPointer(map, relocationTable.first);
+        if (relocations == nullptr)
+            continue;
+        size_t relocationsCount = getDynamicValue(map, relocationTable.second) / sizeof(posix::Elf32_Rel);
+        for (size_t r = 0; r < relocationsCount; ++r)
+        {
+            size_t type = ELF32_R_TYPE(relocations[r].r_info);
+            if (type != R_386_JMP_SLOT && type != R_386_GLOB_DAT)
+                continue;
+            if (symbol != stringTable + symbolTable[ELF32_R_SYM(relocations[r].r_info)].st_name)
+                continue;
+            result.push_back((uint8_t**)(relocations[r].r_offset + map->relocationOffset));
+        }
+    }
+    return result;
+#endif
+}
+
 void* Module::getHandle() const
 {
     return handle;
 }
 
+uint8_t* Module::getBase() const
+{
+    return base;
+}
+
+std::string Module::getBuildId() const
+{
+    if (handle == nullptr)
+        throw std::logic_error("No module loaded or opened.");
+#ifdef _WIN32
+    return "";
+#else
+    posix::LinkMap* map;
+    posix::dlinfo(handle, posix::RTLD_DI_LINKMAP, &map);
+
+    // Look through the notes for the one the linker left with --build-id
+    for (size_t s = 0; s < map->programHeaderCount; ++s)
+    {
+        const posix::Elf32_Phdr& programHeader = map->programHeaders[s];
+        if (programHeader.p_type != PT_NOTE)
+            continue;
+        const uint8_t* note = (const uint8_t*)programHeader.p_vaddr + map->relocationOffset;
+        const uint8_t* notesEnd = note + programHeader.p_memsz;
+        while (note + sizeof(posix::Elf32_Nhdr) <= notesEnd)
+        {
+            const posix::Elf32_Nhdr* noteHeader = (const posix::Elf32_Nhdr*)note;
+            const char* name = (const char*)(noteHeader + 1);
+            const uint8_t* desc = (const uint8_t*)name + ((noteHeader->n_namesz + 3) & ~3);
+            if (noteHeader->n_type == NT_GNU_BUILD_ID && noteHeader->n_namesz == 4 && std::memcmp(name, "GNU", 4) == 0)
+            {
+                static const char hexDigits[] = "0123456789abcdef";
+                std::string result;
+                for (size_t b = 0; b < noteHeader->n_descsz; ++b)
+                {
+                    result += hexDigits[desc[b] >> 4];
+                    result += hexDigits[desc[b] & 0xf];
+                }
+                return result;
+            }
+            note = desc + ((noteHeader->n_descsz + 3) & ~3);
+        }
+    }
+    return "";
+#endif
+}
+
+std::string Module::getFingerprint() const
+{
+    std::string result = getBuildId();
+    if (result.empty())
+    {
+        std::lock_guard<std::mutex> lock(fingerprintsMutex);
+        auto found = fingerprints.find(std::make_pair(base, path + file));
+        if (found != fingerprints.end())
+            return found->second;
+
+        // Hash the file rather than the loaded segments, which get relocated and patched
+        std::FILE* moduleFile = std::fopen((path + "/" + file).c_str(), "rb");
+        if (moduleFile == nullptr)
+            throw std::runtime_error(strError(errno));
+        uint64_t hash = calculateFnv1aHash(nullptr, 0);
+        std::vector<uint8_t> buffer(65536);
+        size_t bufferSize;
+        while ((bufferSize = std::fread(&buffer[0], 1, buffer.size(), moduleFile)) > 0)
+            hash = calculateFnv1aHash(&buffer[0], bufferSize, hash);
+        std::fclose(moduleFile);
+        result = "fnv1a:" + itos(hash);
+        fingerprints.emplace(std::make_pair(base, path + file), result);
+    }
+    return result;
+}
+
+std::map<std::string, Memory::PageInfo> Module::getSections() const
+{
+    if (handle == nullptr)
+        throw std::logic_error("No module loaded or opened.");
+#ifdef _WIN32
+    throw std::logic_error("Module::getSections() not implemented");
+#else
+    return *sectionIndexes.get(base, getFingerprint(), [this]() -> std::map<std::string, Memory::PageInfo>
+    {
+        posix::LinkMap* map;
+        posix::dlinfo(handle, posix::RTLD_DI_LINKMAP, &map);
+
+        // Section headers aren't loaded, so read them from the file. Just the headers and their names, as the file could be huge.
+        std::FILE* moduleFile = std::fopen((path + "/" + file).c_str(), "rb");
+        if (moduleFile == nullptr)
+            throw std::runtime_error(strError(errno));
+        posix::Elf32_Ehdr header;
+        std::vector<posix::Elf32_Shdr> sectionHeaders;
+        std::vector<char> names;
+        bool isRead = std::fread(&header, sizeof(header), 1, moduleFile) == 1 && header.e_shoff != 0 &&
+            header.e_shentsize == sizeof(posix::Elf32_Shdr) && header.e_shstrndx < header.e_shnum;
+        if (isRead)
+        {
+            sectionHeaders.resize(header.e_shnum);
+            isRead = std::fseek(moduleFile, header.e_shoff, SEEK_SET) == 0 &&
+                std::fread(&sectionHeaders[0], sizeof(posix::Elf32_Shdr), sectionHeaders.size(), moduleFile) == sectionHeaders.size();
+        }
+        if (isRead)
+        {
+            const posix::Elf32_Shdr& namesHeader = sectionHeaders[header.e_shstrndx];
+            names.resize(namesHeader.sh_size + 1); // Always ends with a terminator
+            isRead = std::fseek(moduleFile, namesHeader.sh_offset, SEEK_SET) == 0 &&
+                std::fread(&names[0], 1, namesHeader.sh_size, moduleFile) == namesHeader.sh_size;
+        }
+        std::fclose(moduleFile);
+
+        std::map<std::string, Memory::PageInfo> result;
+        if (isRead)
+            for (const auto& sectionHeader : sectionHeaders)
+            {
+                if (!(sectionHeader.sh_flags & SHF_ALLOC) || sectionHeader.sh_size == 0 || sectionHeader.sh_name >= names.size())
+                    continue;
+                Memory::PageInfo section;
+                section.start = (uint8_t*)sectionHeader.sh_addr + (size_t)map->relocationOffset;
+                section.size = sectionHeader.sh_size;
+                section.isReadable = true;
+                section.isWritable = sectionHeader.sh_flags & SHF_WRITE;
+                section.isExecutable = sectionHeader.sh_flags & SHF_EXECINSTR;
+                section.pathfile = path + "/" + file;
+                result.emplace(&names[sectionHeader.sh_name], section);
+            }
+        return result;
+    });
+#endif
+}
+
+std::shared_ptr<const FunctionIndex> Module::getFunctionIndex() const
+{
+    if (handle == nullptr)
+        throw std::logic_error("No module loaded or opened.");
+#ifdef _WIN32
+    throw std::logic_error("Module::getFunctionIndex() not implemented");
+#else
+    return functionIndexes.get(base, getFingerprint(), [this]() -> FunctionIndex
+    {
+        posix::LinkMap* map;
+        posix::dlinfo(handle, posix::RTLD_DI_LINKMAP, &map);
+        FunctionIndex result;
+
+        // The header is loaded, so the file only has to be read if there isn't one
+        for (size_t s = 0; s < map->programHeaderCount; ++s)
+        {
+            const posix::Elf32_Phdr& programHeader = map->programHeaders[s];
+            if (programHeader.p_type != PT_GNU_EH_FRAME)
+                continue;
+            const uint8_t* ehFrame = FunctionIndex::findEhFrame((const uint8_t*)programHeader.p_vaddr + map->relocationOffset);
+
+            // .eh_frame's size isn't given, but it ends with a terminator and can't go past its segment
+            for (const auto& segment : originalSegments)
+                if (ehFrame >= segment.start && ehFrame < segment.start + segment.size)
+                    result.addEhFrame(ehFrame, segment.start + segment.size);
+        }
+        if (result.getFunctions().empty())
+        {
+            auto sections = getSections();
+            auto ehFrame = sections.find(".eh_frame");
+            if (ehFrame != sections.end())
+                result.addEhFrame(ehFrame->second.start, ehFrame->second.start + ehFrame->second.size);
+        }
+        return result;
+    });
+#endif
+}
+
+std::shared_ptr<const XrefIndex> Module::getXrefIndex() const
+{
+    if (handle == nullptr)
+        throw std::logic_error("No module loaded or opened.");
+#ifdef _WIN32
+    throw std::logic_error("Module::getXrefIndex() not implemented");
+#else
+    return xrefIndexes.get(base, getFingerprint(), [this]() -> XrefIndex
+    {
+        XrefIndex result;
+        result.build(originalSegments);
+        return result;
+    });
+#endif
+}
+
+std::shared_ptr<const StringIndex> Module::getStringIndex() const
+{
+    if (handle == nullptr)
+        throw std::logic_error("No module loaded or opened.");
+#ifdef _WIN32
+    throw std::logic_error("Module::getStringIndex() not implemented");
+#else
+    return stringIndexes.get(base, getFingerprint(), [this]() -> StringIndex
+    {
+        StringIndex result;
+        result.build(originalSegments, getSections(), getGlobalOffsetTable());
+        return result;
+    });
+#endif
+}
+
+uint8_t* Module::getGlobalOffsetTable() const
+{
+    if (handle == nullptr)
+        throw std::logic_error("No module loaded or opened.");
+#ifdef _WIN32
+    return nullptr;
+#else
+    posix::LinkMap* map;
+    posix::dlinfo(handle, posix::RTLD_DI_LINKMAP, &map);
+    return getDynamicPointer(map, DT_PLTGOT);
+#endif
+}
+
+std::string Module::getFunctionOffset(const uint8_t* address) const
+{
+    std::shared_ptr<const FunctionIndex> functionIndex = getFunctionIndex();
+    const FunctionIndex::Function* function = functionIndex->find(address);
+    if (function == nullptr)
+        return "";
+    std::ostringstream result;
+    result << std::hex;
+#ifndef _WIN32
+    posix::Dl_info info;
+    if (posix::dladdr(function->start, &info) != 0 && info.dli_sname != nullptr && info.dli_saddr == function->start)
+        result << info.dli_sname;
+    else
+#endif
+        result << "sub_" << (size_t)(function->start - base);
+    result << "+0x" << (size_t)(address - function->start);
+    return result.str();
+}
+
 std::string Module::getFile() const
 {
     return file;
@@ -379,6 +868,123 @@ const std::vector<Memory::PageInfo>& Module::getOriginalSegments() const
     return originalSegments;
 }
 
+std::map<std::string, Module::Vtable> Module::getVtables() const
+{
+    if (handle == nullptr)
+        throw std::logic_error("No module loaded or opened.");
+#ifdef _WIN32
+    throw std::logic_error("Module::getVtables() not implemented");
+#else
+    return *vtableIndexes.get(base, getFingerprint(), [this]() -> std::map<std::string, Vtable>
+    {
+        posix::LinkMap* map;
+        posix::dlinfo(handle, posix::RTLD_DI_LINKMAP, &map);
+        std::map<std::string, Vtable> result;
+
+        // A vtable's address point follows its offset-to-top (0 for a primary vtable) and typeinfo pointer
+        auto getClassName = [this](uint8_t** slot) -> std::string
+        {
+            if (slot[0] != nullptr || !isInsideSegments(originalSegments, slot[1], 2 * sizeof(uint8_t*), false))
+                return "";
+            const char* mangledName = ((const char**)slot[1])[1];
+            if (!isInsideSegments(originalSegments, mangledName, 1, false))
+                return "";
+            return demangleTypeName(mangledName);
+        };
+
+        // Virtual functions can be inherited from other modules, so slots may point at code anywhere. The primary vtable
+        // ends at the next vtable's offset-to-top, or at whatever follows it.
+        std::vector<Memory::PageInfo> allSegments = Memory::enumerateSegments();
+        auto makeVtable = [&allSegments](uint8_t** addressPoint, uint8_t** end) -> Vtable
+        {
+            Vtable vtable;
+            vtable.addressPoint = addressPoint;
+            vtable.slotsCount = 0;
+            while (addressPoint + vtable.slotsCount < end && isInsideSegments(allSegments, addressPoint[vtable.slotsCount], 1, true))
+                ++vtable.slotsCount;
+            return vtable;
+        };
+
+        // Exported vtables are found directly through their symbols
+        const posix::Elf32_Sym* symbolTable = (const posix::Elf32_Sym*)getDynamicPointer(map, DT_SYMTAB);
+        const char* stringTable = (const char*)getDynamicPointer(map, DT_STRTAB);
+        if (symbolTable != nullptr && stringTable != nullptr)
+        {
+            size_t symbolsCount = getDynamicSymbolsCount(map);
+            for (size_t s = 0; s < symbolsCount; ++s)
+            {
+                const char* name = stringTable + symbolTable[s].st_name;
+                if (std::strncmp(name, "_ZTV", 4) != 0 || symbolTable[s].st_shndx == SHN_UNDEF ||
+                    ELF32_ST_TYPE(symbolTable[s].st_info) != STT_OBJECT)
+                    continue;
+                uint8_t** vtable = (uint8_t**)(symbolTable[s].st_value + map->relocationOffset);
+                size_t vtableSize = symbolTable[s].st_size / sizeof(uint8_t*);
+                for (size_t w = 0; w + 2 < vtableSize; ++w)
+                {
+                    std::string className = getClassName(vtable + w);
+                    if (className.empty())
+                        continue;
+                    result.emplace(className, makeVtable(vtable + w + 2, vtable + vtableSize));
+                    break;
+                }
+            }
+        }
+
+        // Internal vtables are found by scanning for RTTI. Vtables of classes whose first virtual function is pure, or defined in
+        // another module, are missed unless they have a symbol.
+        for (const auto& segment : originalSegments)
+        {
+            if (!segment.isReadable)
+                continue;
+            uint8_t** slot = (uint8_t**)segment.start;
+            uint8_t** end = (uint8_t**)(segment.start + segment.size) - 2;
+            for (; slot < end; ++slot)
+            {
+                if (slot[0] != nullptr || slot[1] == nullptr || !isInsideSegments(originalSegments, slot[2], 1, true))
+                    continue;
+                std::string className = getClassName(slot);
+                if (!className.empty())
+                    result.emplace(className, makeVtable(slot + 2, (uint8_t**)(segment.start + segment.size)));
+            }
+        }
+
+        return result;
+    });
+#endif
+}
+
+Module::Vtable Module::getVtable(const std::string& className) const
+{
+    std::map<std::string, Vtable> vtables = getVtables();
+    auto found = vtables.find(className);
+    if (found == vtables.end())
+        throw std::runtime_error("No vtable for class " + className + " was found in " + file + ".");
+    return found->second;
+}
+
+std::vector<std::string> Module::enumerateModules()
+{
+    std::vector<std::string> result;
+#ifdef _WIN32
+    throw std::logic_error("Module::enumerateModules() not implemented");
+#else
+    void* mainHandle = posix::dlopen(nullptr, RTLD_NOW | RTLD_NOLOAD);
+    if (mainHandle == nullptr)
+        throw std::runtime_error(std::string(posix::dlerror()));
+    posix::LinkMap* map;
+    posix::dlinfo(mainHandle, posix::RTLD_DI_LINKMAP, &map);
+
+    // Walk the link map list. Modules without a path (like the vDSO) can't be opened by name, so are skipped.
+    for (; map != nullptr; map = map->next)
+        if (map->name[0] == 0)
+            result.push_back("");
+        else if (std::strchr(map->name, '/') != nullptr)
+            result.push_back(map->name);
+    posix::dlclose(mainHandle);
+#endif
+    return result;
+}
+
 // Private members
 
 bool Module::isPathfileMatch_(const std::string& a, const std::string& b)
@@ -18,6 +18,8 @@
 #include <cassert>
 
 #include "Patch.h"
+#include "Module.h"
+#include "X86.h"
 
 namespace PatchData
 {
@@ -68,6 +70,26 @@ std::vector<uint8_t> Patch::serialise() const
             serialiseIntegralTypeContinuousContainer(data, getTypeData<ReplaceSearchPatch>().serialise());
             break;
 
+        case Type::IMPORT :
+            serialiseIntegralTypeContinuousContainer(data, getTypeData<ImportPatch>().serialise());
+            break;
+
+        case Type::VTABLE_SLOT :
+            serialiseIntegralTypeContinuousContainer(data, getTypeData<VtableSlotPatch>().serialise());
+            break;
+
+        case Type::CAVE :
+            serialiseIntegralTypeContinuousContainer(data, getTypeData<CavePatch>().serialise());
+            break;
+
+        case Type::REPLACE_CALL :
+            serialiseIntegralTypeContinuousContainer(data, getTypeData<ReplaceCallPatch>().serialise());
+            break;
+
+        case Type::REPLACE_INSTRUCTIONS :
+            serialiseIntegralTypeContinuousContainer(data, getTypeData<ReplaceInstructionsPatch>().serialise());
+            break;
+
         case Type::BLANK :
             break;
 
@@ -96,6 +118,26 @@ void Patch::deserialise(const std::vector<uint8_t>& data)
             setType<ReplaceSearchPatch>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
             break;
 
+        case Type::IMPORT :
+            setType<ImportPatch>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            break;
+
+        case Type::VTABLE_SLOT :
+            setType<VtableSlotPatch>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            break;
+
+        case Type::CAVE :
+            setType<CavePatch>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            break;
+
+        case Type::REPLACE_CALL :
+            setType<ReplaceCallPatch>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            break;
+
+        case Type::REPLACE_INSTRUCTIONS :
+            setType<ReplaceInstructionsPatch>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            break;
+
         case Type::BLANK :
             clearType();
             break;
@@ -121,6 +163,26 @@ void Patch::copyTypeFrom(const Patch& rvalue)
             setType<ReplaceSearchPatch>(rvalue.getTypeData<ReplaceSearchPatch>());
             break;
 
+        case Type::IMPORT :
+            setType<ImportPatch>(rvalue.getTypeData<ImportPatch>());
+            break;
+
+        case Type::VTABLE_SLOT :
+            setType<VtableSlotPatch>(rvalue.getTypeData<VtableSlotPatch>());
+            break;
+
+        case Type::CAVE :
+            setType<CavePatch>(rvalue.getTypeData<CavePatch>());
+            break;
+
+        case Type::REPLACE_CALL :
+            setType<ReplaceCallPatch>(rvalue.getTypeData<ReplaceCallPatch>());
+            break;
+
+        case Type::REPLACE_INSTRUCTIONS :
+            setType<ReplaceInstructionsPatch>(rvalue.getTypeData<ReplaceInstructionsPatch>());
+            break;
+
         case Type::BLANK :
             clearType();
             break;
@@ -146,6 +208,26 @@ void Patch::clearType()
             delete &getTypeData<ReplaceSearchPatch>();
             break;
 
+        case Type::IMPORT :
+            delete &getTypeData<ImportPatch>();
+            break;
+
+        case Type::VTABLE_SLOT :
+            delete &getTypeData<VtableSlotPatch>();
+            break;
+
+        case Type::CAVE :
+            delete &getTypeData<CavePatch>();
+            break;
+
+        case Type::REPLACE_CALL :
+            delete &getTypeData<ReplaceCallPatch>();
+            break;
+
+        case Type::REPLACE_INSTRUCTIONS :
+            delete &getTypeData<ReplaceInstructionsPatch>();
+            break;
+
         case Type::BLANK :
             break;
 
@@ -176,6 +258,26 @@ void Patch::checkValid() const
             getTypeData<ReplaceSearchPatch>().checkValid(*this);
             break;
 
+        case Type::IMPORT :
+            getTypeData<ImportPatch>().checkValid(*this);
+            break;
+
+        case Type::VTABLE_SLOT :
+            getTypeData<VtableSlotPatch>().checkValid(*this);
+            break;
+
+        case Type::CAVE :
+            getTypeData<CavePatch>().checkValid(*this);
+            break;
+
+        case Type::REPLACE_CALL :
+            getTypeData<ReplaceCallPatch>().checkValid(*this);
+            break;
+
+        case Type::REPLACE_INSTRUCTIONS :
+            getTypeData<ReplaceInstructionsPatch>().checkValid(*this);
+            break;
+
         case Type::BLANK :
             throw std::logic_error("Patch cannot be blank.");
 
@@ -186,6 +288,11 @@ void Patch::checkValid() const
 
 // Patch data classes
 
+HookPatch::HookPatch():
+    usedRegisters(UsedRegisters::ALL)
+{
+}
+
 std::vector<uint8_t> HookPatch::serialise() const
 {
     std::vector<uint8_t> data;
@@ -193,6 +300,7 @@ std::vector<uint8_t> HookPatch::serialise() const
 
     serialiseIntegralTypeContinuousContainer(data, hookName);
     serialiseIntegralTypeContinuousContainer(data, functionBody);
+    serialiseIntegralType(data, usedRegisters);
 
     return data;
 }
@@ -203,6 +311,7 @@ void HookPatch::deserialise(const std::vector<uint8_t>& data)
 
     deserialiseIntegralTypeContinuousContainer(iterator, hookName);
     deserialiseIntegralTypeContinuousContainer(iterator, functionBody);
+    deserialiseIntegralType(iterator, usedRegisters);
 }
 
 void HookPatch::checkValid(const Patch& /*parent*/) const
@@ -275,14 +384,211 @@ void ReplaceSearchPatch::checkValid(const Patch& /*patch*/) const
         if (ignoredReplaceBytesRva >= replaceBytes.size())
             throw std::logic_error("All ignored replace byte RVAs must be less than the replace bytes length.");
 
-    // The replace bytes have to be the same size as the search bytes
-    if (replaceBytes.size() != searchBytes.size())
-        throw std::logic_error("Search bytes and replace bytes must be the same size.");
+    // The replace bytes have to be the same size as the search bytes, or fit in the shortest match of a pattern
+    if (pattern.empty() ? replaceBytes.size() != searchBytes.size() : replaceBytes.size() > getMinSize())
+        throw std::logic_error("Search bytes and replace bytes must be the same size, or no bigger than the pattern's shortest match.");
     Search::checkValid(replaceBytes.size());
 }
 
+std::vector<uint8_t> ImportPatch::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, targetModuleName);
+    serialiseIntegralTypeContinuousContainer(data, targetSymbol);
+    serialiseIntegralTypeContinuousContainer(data, ImportSearch::serialise());
+
+    return data;
+}
+
+void ImportPatch::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralTypeContinuousContainer(iterator, targetModuleName);
+    deserialiseIntegralTypeContinuousContainer(iterator, targetSymbol);
+    ImportSearch::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+}
+
+void ImportPatch::checkValid(const Patch& /*parent*/) const
+{
+    ImportSearch::checkValid();
+    if (targetModuleName.empty())
+        throw std::logic_error("The target module name cannot be empty.");
+    if (targetSymbol.empty())
+        throw std::logic_error("The target symbol cannot be empty.");
+}
+
+std::set<uint8_t*> ImportPatch::doSearch() const
+{
+    // Leave the target's own imports alone, so it can still call what it replaces
+    Module targetModule;
+    targetModule.open(targetModuleName);
+    const auto& segments = targetModule.getOriginalSegments();
+    std::set<uint8_t*> results = ImportSearch::doSearch();
+    for (auto result = results.begin(); result != results.end();)
+        if (!segments.empty() && *result >= segments.front().start && *result < segments.back().start + segments.back().size)
+            result = results.erase(result);
+        else
+            ++result;
+    return results;
+}
+
+uint8_t* ImportPatch::getTarget() const
+{
+    Module targetModule;
+    targetModule.open(targetModuleName);
+    return targetModule.getSymbol(targetSymbol);
+}
+
+std::vector<uint8_t> VtableSlotPatch::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, targetModuleName);
+    serialiseIntegralTypeContinuousContainer(data, targetSymbol);
+    serialiseIntegralTypeContinuousContainer(data, VtableSearch::serialise());
+
+    return data;
+}
+
+void VtableSlotPatch::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralTypeContinuousContainer(iterator, targetModuleName);
+    deserialiseIntegralTypeContinuousContainer(iterator, targetSymbol);
+    VtableSearch::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+}
+
+void VtableSlotPatch::checkValid(const Patch& /*parent*/) const
+{
+    VtableSearch::checkValid();
+    if (targetModuleName.empty())
+        throw std::logic_error("The target module name cannot be empty.");
+    if (targetSymbol.empty())
+        throw std::logic_error("The target symbol cannot be empty.");
+}
+
+uint8_t* VtableSlotPatch::getTarget() const
+{
+    Module targetModule;
+    targetModule.open(targetModuleName);
+    return targetModule.getSymbol(targetSymbol);
+}
+
+CavePatch::CavePatch():
+    caveRva(0),
+    isOriginalCodeKept(false)
+{
+}
+
+std::vector<uint8_t> CavePatch::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralType(data, caveRva);
+    serialiseIntegralTypeContinuousContainer(data, caveBytes);
+    serialiseIntegralType(data, isOriginalCodeKept);
+    serialiseIntegralTypeContinuousContainer(data, Search::serialise());
+
+    return data;
+}
+
+void CavePatch::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralType(iterator, caveRva);
+    deserialiseIntegralTypeContinuousContainer(iterator, caveBytes);
+    deserialiseIntegralType(iterator, isOriginalCodeKept);
+    Search::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+}
+
+void CavePatch::checkValid(const Patch& /*parent*/) const
+{
+    if (caveBytes.empty())
+        throw std::logic_error("The cave bytes cannot be empty.");
+    // The jump to the cave has to be over bytes that were searched for
+    Search::checkValid(caveRva + X86::jumpSize);
+}
+
+std::vector<uint8_t> ReplaceCallPatch::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, replaceBytes);
+    serialiseIntegralTypeContainer(data, ignoredReplaceBytesRvas);
+    serialiseIntegralTypeContinuousContainer(data, CallSearch::serialise());
+
+    return data;
+}
+
+void ReplaceCallPatch::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralTypeContinuousContainer(iterator, replaceBytes);
+    deserialiseIntegralTypeContainer(iterator, ignoredReplaceBytesRvas);
+    CallSearch::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+}
+
+void ReplaceCallPatch::checkValid(const Patch& /*parent*/) const
+{
+    // Check that the largest rva in `ignoredReplaceBytesRvas' is not larger than the replace bytes
+    for (const auto& ignoredReplaceBytesRva : ignoredReplaceBytesRvas)
+        if (ignoredReplaceBytesRva >= replaceBytes.size())
+            throw std::logic_error("All ignored replace byte RVAs must be less than the replace bytes length.");
+
+    if (replaceBytes.empty() || replaceBytes.size() > X86::jumpSize)
+        throw std::logic_error("The replace bytes must be 1 to " + itos(X86::jumpSize) + " bytes, so they only cover the call.");
+    CallSearch::checkValid();
+}
+
+std::vector<uint8_t> ReplaceInstructionsPatch::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, replaceBytes);
+    serialiseIntegralTypeContainer(data, ignoredReplaceBytesRvas);
+    serialiseIntegralTypeContinuousContainer(data, InstructionSearch::serialise());
+
+    return data;
+}
+
+void ReplaceInstructionsPatch::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralTypeContinuousContainer(iterator, replaceBytes);
+    deserialiseIntegralTypeContainer(iterator, ignoredReplaceBytesRvas);
+    InstructionSearch::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+}
+
+void ReplaceInstructionsPatch::checkValid(const Patch& /*parent*/) const
+{
+    // Check that the largest rva in `ignoredReplaceBytesRvas' is not larger than the replace bytes
+    for (const auto& ignoredReplaceBytesRva : ignoredReplaceBytesRvas)
+        if (ignoredReplaceBytesRva >= replaceBytes.size())
+            throw std::logic_error("All ignored replace byte RVAs must be less than the replace bytes length.");
+
+    if (replaceBytes.empty())
+        throw std::logic_error("The replace bytes cannot be empty.");
+    InstructionSearch::checkValid(replaceBytes.size());
+}
+
 // PatchPack class
 
+PatchPack::PatchPack():
+    isToggleable(false)
+{
+}
+
 std::vector<uint8_t> PatchPack::serialise() const
 {
     std::vector<uint8_t> data;
@@ -307,6 +613,8 @@ std::vector<uint8_t> PatchPack::serialise() const
         serialiseIntegralTypeContinuousContainer(data, sharedVariable.first);
         serialiseIntegralTypeContinuousContainer(data, sharedVariable.second);
     }
+    // isToggleable
+    serialiseIntegralType(data, isToggleable);
 
     return data;
 }
@@ -337,6 +645,76 @@ void PatchPack::deserialise(const std::vector<uint8_t>& data)
     for (std::map<std::string, std::string>::size_type s = 0; s < sharedVariablesSize; ++s)
         sharedVariables.insert(std::make_pair(deserialiseIntegralTypeContinuousContainer<std::string>(iterator),
                                               deserialiseIntegralTypeContinuousContainer<std::string>(iterator)));
+    // isToggleable
+    deserialiseIntegralType(iterator, isToggleable);
+}
+
+// BakedPatch class
+
+BakedPatch::BakedPatch():
+    rva(0)
+{
+}
+
+std::vector<uint8_t> BakedPatch::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralType(data, rva);
+    serialiseIntegralTypeContinuousContainer(data, originalBytes);
+    serialiseIntegralTypeContinuousContainer(data, patchedBytes);
+
+    return data;
+}
+
+void BakedPatch::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralType(iterator, rva);
+    deserialiseIntegralTypeContinuousContainer(iterator, originalBytes);
+    deserialiseIntegralTypeContinuousContainer(iterator, patchedBytes);
+}
+
+// BakeManifest class
+
+BakeManifest::BakeManifest():
+    patchesHash(0)
+{
+}
+
+std::vector<uint8_t> BakeManifest::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, patchPackName);
+    serialiseIntegralType(data, patchesHash);
+    serialiseIntegralTypeContinuousContainer(data, moduleName);
+    serialiseIntegralTypeContinuousContainer(data, moduleFingerprint);
+    serialiseSerialisableTypeContainer(data, bakedPatches);
+
+    return data;
+}
+
+void BakeManifest::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralTypeContinuousContainer(iterator, patchPackName);
+    deserialiseIntegralType(iterator, patchesHash);
+    deserialiseIntegralTypeContinuousContainer(iterator, moduleName);
+    deserialiseIntegralTypeContinuousContainer(iterator, moduleFingerprint);
+    deserialiseDeserialisableTypeContainer(iterator, bakedPatches);
+}
+
+uint64_t BakeManifest::getPatchesHash(const PatchPack& patchPack)
+{
+    // Only the patches, so enabling the patch pack or changing its extra settings doesn't count as an edit
+    std::vector<uint8_t> data;
+    serialiseSerialisableTypeContainer(data, patchPack.patches);
+    return calculateFnv1aHash(&data[0], data.size());
 }
 
 }
@@ -0,0 +1,160 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdexcept>
+
+#include <cstring>
+#include <cerrno>
+
+#include "ResolutionCache.h"
+
+#ifndef _WIN32
+namespace posix
+{
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+}
+#endif
+
+ResolutionCache::ResolutionCache():
+    data_(nullptr),
+    size_(0)
+{
+}
+
+ResolutionCache::~ResolutionCache()
+{
+    close();
+}
+
+void ResolutionCache::open(const std::string& pathfile)
+{
+    close();
+#ifdef _WIN32
+    (void)pathfile;
+    throw std::logic_error("ResolutionCache::open() not implemented");
+#else
+    int file = posix::open(pathfile.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (file == -1)
+        throw std::runtime_error(strError(errno));
+    size_t size = sizeof(Header_) + entriesCount_ * sizeof(Entry_);
+    struct posix::stat fileInfo;
+    if (posix::fstat(file, &fileInfo) == -1 || ((size_t)fileInfo.st_size != size && posix::ftruncate(file, size) == -1))
+    {
+        int error = errno;
+        posix::close(file);
+        throw std::runtime_error(strError(error));
+    }
+    void* data = posix::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    posix::close(file);
+    if (data == MAP_FAILED)
+        throw std::runtime_error(strError(errno));
+    data_ = (uint8_t*)data;
+    size_ = size;
+
+    // Start over with anything that doesn't look like this version of the cache
+    Header_* header = (Header_*)data_;
+    if (std::memcmp(header->magic, "MPRESCA", 8) != 0 || header->version != version_ || header->entriesCount != entriesCount_)
+    {
+        clear();
+        std::memcpy(header->magic, "MPRESCA", 8);
+        header->version = version_;
+        header->entriesCount = entriesCount_;
+    }
+#endif
+}
+
+void ResolutionCache::close() noexcept
+{
+    if (data_ == nullptr)
+        return;
+#ifndef _WIN32
+    posix::munmap(data_, size_);
+#endif
+    data_ = nullptr;
+    size_ = 0;
+}
+
+bool ResolutionCache::getIsOpen() const
+{
+    return data_ != nullptr;
+}
+
+void ResolutionCache::clear()
+{
+    if (data_ == nullptr)
+        throw std::logic_error("No resolution cache is open.");
+    std::memset(getEntries_(), 0, entriesCount_ * sizeof(Entry_));
+}
+
+bool ResolutionCache::find(uint64_t moduleFingerprint, uint64_t searchHash, std::vector<size_t>& rvas) const
+{
+    if (data_ == nullptr)
+        return false;
+    Entry_* entries = getEntries_();
+    for (size_t p = 0, e = (moduleFingerprint ^ searchHash) % entriesCount_; p < maxProbes_; ++p, e = (e + 1) % entriesCount_)
+    {
+        if (!__atomic_load_n(&entries[e].isValid, __ATOMIC_ACQUIRE) ||
+            entries[e].moduleFingerprint != moduleFingerprint || entries[e].searchHash != searchHash)
+            continue;
+        size_t rvasCount = entries[e].rvasCount;
+        if (rvasCount == 0 || rvasCount > maxRvas)
+            return false;
+        rvas.assign(entries[e].rvas, entries[e].rvas + rvasCount);
+        return true;
+    }
+    return false;
+}
+
+void ResolutionCache::store(uint64_t moduleFingerprint, uint64_t searchHash, const std::vector<size_t>& rvas)
+{
+    if (data_ == nullptr || rvas.empty() || rvas.size() > maxRvas)
+        return;
+
+    // Take the entry already used for this search, else the first free one, else evict the first one probed
+    Entry_* entries = getEntries_();
+    size_t first = (moduleFingerprint ^ searchHash) % entriesCount_;
+    Entry_* entry = nullptr;
+    for (size_t p = 0, e = first; p < maxProbes_; ++p, e = (e + 1) % entriesCount_)
+    {
+        bool isValid = __atomic_load_n(&entries[e].isValid, __ATOMIC_ACQUIRE);
+        if (isValid && entries[e].moduleFingerprint == moduleFingerprint && entries[e].searchHash == searchHash)
+        {
+            entry = &entries[e];
+            break;
+        }
+        if (!isValid && entry == nullptr)
+            entry = &entries[e];
+    }
+    if (entry == nullptr)
+        entry = &entries[first];
+
+    __atomic_store_n(&entry->isValid, 0, __ATOMIC_RELEASE);
+    entry->moduleFingerprint = moduleFingerprint;
+    entry->searchHash = searchHash;
+    entry->rvasCount = rvas.size();
+    for (size_t r = 0; r < rvas.size(); ++r)
+        entry->rvas[r] = rvas[r];
+    __atomic_store_n(&entry->isValid, 1, __ATOMIC_RELEASE);
+}
+
+ResolutionCache::Entry_* ResolutionCache::getEntries_() const
+{
+    return (Entry_*)(data_ + sizeof(Header_));
+}
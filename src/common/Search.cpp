@@ -15,19 +15,38 @@
     along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <memory>
 #include <utility>
 #include <algorithm>
 
+#include <cstring>
 #include <cassert>
 
 #include "Search.h"
 #include "Module.h"
+#include "ElfImage.h"
+#include "FunctionIndex.h"
+#include "XrefIndex.h"
+#include "StringIndex.h"
+#include "InstructionPattern.h"
+#include "BytePattern.h"
+#include "X86.h"
 
 namespace PatchData
 {
 
 // Search class
 
+Search::Search():
+    isExecutableOnly(false),
+    isWritableOnly(false),
+    anchorWindowOffset(0),
+    anchorWindowSize(0),
+    resultIndex((size_t)-1),
+    isUniqueResultRequired(false)
+{
+}
+
 std::vector<uint8_t> Search::serialise() const
 {
     std::vector<uint8_t> data;
@@ -37,6 +56,39 @@ std::vector<uint8_t> Search::serialise() const
     serialiseIntegralTypeContinuousContainer(data, searchBytes);
     serialiseIntegralTypeContainer(data, ignoredSearchBytesRvas);
     serialiseSerialisableTypeContainer(data, specialSearches);
+    serialiseIntegralType(data, rvaHints.size());
+    for (const auto& rvaHint : rvaHints)
+    {
+        serialiseIntegralTypeContinuousContainer(data, rvaHint.first);
+        serialiseIntegralType(data, rvaHint.second);
+    }
+    serialiseIntegralType(data, sectionNames.size());
+    for (const auto& sectionName : sectionNames)
+        serialiseIntegralTypeContinuousContainer(data, sectionName);
+    serialiseIntegralType(data, rvaRanges.size());
+    for (const auto& rvaRange : rvaRanges)
+    {
+        serialiseIntegralType(data, rvaRange.first);
+        serialiseIntegralType(data, rvaRange.second);
+    }
+    serialiseIntegralType(data, isExecutableOnly);
+    serialiseIntegralType(data, isWritableOnly);
+    serialiseIntegralTypeContinuousContainer(data, containingFunctionName);
+    serialiseIntegralTypeContinuousContainer(data, pattern);
+    serialiseIntegralType(data, anchorSearches.size());
+    for (const auto& anchorSearch : anchorSearches)
+    {
+        // Anchors can be instruction searches as well, so which one it is goes first
+        serialiseIntegralType(data, anchorSearch->getSearchType());
+        if (anchorSearch->getSearchType() == SearchType::INSTRUCTION)
+            serialiseIntegralTypeContinuousContainer(data, static_cast<const InstructionSearch&>(*anchorSearch).serialise());
+        else
+            serialiseIntegralTypeContinuousContainer(data, anchorSearch->serialise());
+    }
+    serialiseIntegralType(data, anchorWindowOffset);
+    serialiseIntegralType(data, anchorWindowSize);
+    serialiseIntegralType(data, resultIndex);
+    serialiseIntegralType(data, isUniqueResultRequired);
 
     return data;
 }
@@ -49,21 +101,86 @@ void Search::deserialise(const std::vector<uint8_t>& data)
     deserialiseIntegralTypeContinuousContainer(iterator, searchBytes);
     deserialiseIntegralTypeContainer(iterator, ignoredSearchBytesRvas);
     deserialiseDeserialisableTypeContainer(iterator, specialSearches);
+    std::map<std::string, size_t>::size_type rvaHintsSize = deserialiseIntegralType<std::map<std::string, size_t>::size_type>(iterator);
+    rvaHints.clear();
+    for (std::map<std::string, size_t>::size_type h = 0; h < rvaHintsSize; ++h)
+    {
+        std::string buildId = deserialiseIntegralTypeContinuousContainer<std::string>(iterator);
+        rvaHints[buildId] = deserialiseIntegralType<size_t>(iterator);
+    }
+    std::set<std::string>::size_type sectionNamesSize = deserialiseIntegralType<std::set<std::string>::size_type>(iterator);
+    sectionNames.clear();
+    for (std::set<std::string>::size_type s = 0; s < sectionNamesSize; ++s)
+        sectionNames.insert(deserialiseIntegralTypeContinuousContainer<std::string>(iterator));
+    std::vector<std::pair<size_t, size_t>>::size_type rvaRangesSize = deserialiseIntegralType<std::vector<std::pair<size_t, size_t>>::size_type>(iterator);
+    rvaRanges.clear();
+    for (std::vector<std::pair<size_t, size_t>>::size_type r = 0; r < rvaRangesSize; ++r)
+    {
+        size_t rvaRangeStart = deserialiseIntegralType<size_t>(iterator);
+        rvaRanges.push_back(std::make_pair(rvaRangeStart, deserialiseIntegralType<size_t>(iterator)));
+    }
+    deserialiseIntegralType(iterator, isExecutableOnly);
+    deserialiseIntegralType(iterator, isWritableOnly);
+    deserialiseIntegralTypeContinuousContainer(iterator, containingFunctionName);
+    deserialiseIntegralTypeContinuousContainer(iterator, pattern);
+    std::vector<std::shared_ptr<const Search>>::size_type anchorSearchesSize = deserialiseIntegralType<std::vector<std::shared_ptr<const Search>>::size_type>(iterator);
+    anchorSearches.clear();
+    for (std::vector<std::shared_ptr<const Search>>::size_type a = 0; a < anchorSearchesSize; ++a)
+    {
+        if (deserialiseIntegralType<SearchType>(iterator) == SearchType::INSTRUCTION)
+        {
+            auto instructionSearch = std::make_shared<InstructionSearch>();
+            instructionSearch->deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            anchorSearches.push_back(instructionSearch);
+        }
+        else
+        {
+            auto anchorSearch = std::make_shared<Search>();
+            anchorSearch->deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            anchorSearches.push_back(anchorSearch);
+        }
+    }
+    deserialiseIntegralType(iterator, anchorWindowOffset);
+    deserialiseIntegralType(iterator, anchorWindowSize);
+    deserialiseIntegralType(iterator, resultIndex);
+    deserialiseIntegralType(iterator, isUniqueResultRequired);
 }
 
 void Search::checkValid(const size_t minSearchBytes) const
 {
     if (moduleName.empty())
         throw std::logic_error("The module name cannot be empty.");
-    if (searchBytes.size() < minSearchBytes)
+    if (!pattern.empty() && (!searchBytes.empty() || !ignoredSearchBytesRvas.empty() || !specialSearches.empty()))
+        throw std::logic_error("Searches with a pattern can't have search bytes, ignored search bytes or special searches.");
+    size_t searchBytesSize = getMinSize(); // Checks the pattern is valid
+    if (searchBytesSize < minSearchBytes)
         throw std::logic_error("There must be at least " + itos(minSearchBytes) + " search byte(s).");
-    size_t searchBytesSize = searchBytes.size();
 
     // Check that the largest rva in `ignoredSearchBytesRvas' is not larger than the search bytes
     for (const auto& ignoredSearchBytesRva : ignoredSearchBytesRvas)
         if (ignoredSearchBytesRva >= searchBytesSize)
             throw std::logic_error("All ignored search byte RVAs must be less than the search bytes length.");
 
+    for (const auto& rvaRange : rvaRanges)
+        if (rvaRange.second < searchBytesSize)
+            throw std::logic_error("All RVA ranges must be at least as big as the search bytes.");
+    if (isExecutableOnly && isWritableOnly)
+        throw std::logic_error("Searches can't be limited to both executable and writable memory, as nothing loaded is both.");
+    if (anchorSearches.size() > 1)
+        throw std::logic_error("Searches can only have one anchor search.");
+    for (const auto& anchorSearch : anchorSearches)
+    {
+        if (anchorSearch == nullptr || anchorSearch->getSearchType() == SearchType::NAME)
+            throw std::logic_error("Anchor searches can only be searches or instruction searches.");
+        if (anchorSearch->moduleName != moduleName)
+            throw std::logic_error("Anchor searches have to be in the same module.");
+        if (anchorWindowSize < searchBytesSize || anchorWindowSize == 0)
+            throw std::logic_error("The anchor window must be at least as big as the search bytes.");
+        anchorSearch->checkValid(1);
+    }
+    if (isUniqueResultRequired && resultIndex != (size_t)-1)
+        throw std::logic_error("Searches can't require a unique result and pick one of them too.");
+
     // Check the special searches
     std::set<size_t> usedSearchBytesRvas; // Make sure every special search has a unique search bytes RVA
     for (const auto& specialSearch : specialSearches)
@@ -82,7 +199,329 @@ std::set<uint8_t*> Search::doSearch() const
     checkValid(searchBytes.size());
     Module module;
     module.open(moduleName);
-    return doSearch_(module.getSegments().front().start, (module.getSegments().back().start + module.getSegments().back().size) - module.getSegments().front().start);
+
+    // Each range on its own, as whatever's mapped between the segments isn't part of the module
+    std::vector<Memory::PageInfo> ranges = getScopedRanges_(module.getBase(), module.getOriginalSegments(),
+        sectionNames.empty() ? std::map<std::string, Memory::PageInfo>() : module.getSections());
+    if (!containingFunctionName.empty())
+    {
+        std::shared_ptr<const FunctionIndex> functionIndex = module.getFunctionIndex();
+        const FunctionIndex::Function* function = functionIndex->find(module.getFunction(containingFunctionName));
+        if (function == nullptr)
+            throw std::runtime_error("Function \"" + containingFunctionName + "\" has no unwind info to give its size.");
+        ranges = clipRanges_(ranges, function->start, function->size);
+    }
+    if (!anchorSearches.empty())
+        ranges = getAnchoredRanges_(ranges, anchorSearches.front()->doSearch());
+    // A hint can only stand in for the search when it keeps a single result, as it only gives one
+    std::set<uint8_t*> results;
+    if ((resultIndex != (size_t)-1 || isUniqueResultRequired) && doHintedSearch_(module, ranges, results))
+        return results;
+    std::shared_ptr<const XrefIndex> xrefIndex = hasCallSpecialSearch_() ? module.getXrefIndex() : nullptr;
+    std::shared_ptr<const StringIndex> stringIndex = hasStringReferenceSpecialSearch_() ? module.getStringIndex() : nullptr;
+    for (const auto& range : ranges)
+        for (const auto& result : doRangeSearch_(range, xrefIndex.get(), stringIndex.get()))
+            results.insert(result);
+    return selectResults_(results);
+}
+
+std::set<size_t> Search::doImageSearch(const ElfImage& image) const
+{
+    checkValid(searchBytes.size());
+    std::vector<Memory::PageInfo> ranges = getScopedRanges_(image.getBase(), image.getSegments(), image.getSections());
+    if (!containingFunctionName.empty())
+    {
+        const FunctionIndex::Function* function = image.getFunctionIndex().find(image.getSymbol(containingFunctionName));
+        if (function == nullptr)
+            throw std::runtime_error("Function \"" + containingFunctionName + "\" has no unwind info to give its size.");
+        ranges = clipRanges_(ranges, function->start, function->size);
+    }
+    if (!anchorSearches.empty())
+    {
+        std::set<uint8_t*> anchorResults;
+        for (const auto& anchorRva : anchorSearches.front()->doImageSearch(image))
+            anchorResults.insert(image.getBase() + anchorRva);
+        ranges = getAnchoredRanges_(ranges, anchorResults);
+    }
+    std::set<uint8_t*> results;
+    for (const auto& range : ranges)
+        for (const auto& result : doRangeSearch_(range, &image.getXrefIndex(), &image.getStringIndex()))
+            results.insert(result);
+    std::set<size_t> rvas;
+    for (const auto& result : selectResults_(results))
+        rvas.insert(result - image.getBase());
+    return rvas;
+}
+
+std::set<uint8_t*> Search::doFunctionSearch(const uint8_t* address) const
+{
+    checkValid(searchBytes.size());
+    Module module;
+    module.open(moduleName);
+    std::shared_ptr<const FunctionIndex> functionIndex = module.getFunctionIndex();
+    const FunctionIndex::Function* function = functionIndex->find(address);
+    if (function == nullptr)
+        throw std::runtime_error("The address isn't inside any function with unwind info.");
+    std::vector<Memory::PageInfo> ranges = clipRanges_(getScopedRanges_(module.getBase(), module.getOriginalSegments(),
+        sectionNames.empty() ? std::map<std::string, Memory::PageInfo>() : module.getSections()), function->start, function->size);
+    if (!anchorSearches.empty())
+        ranges = getAnchoredRanges_(ranges, anchorSearches.front()->doSearch());
+    std::set<uint8_t*> results;
+    std::shared_ptr<const XrefIndex> xrefIndex = hasCallSpecialSearch_() ? module.getXrefIndex() : nullptr;
+    std::shared_ptr<const StringIndex> stringIndex = hasStringReferenceSpecialSearch_() ? module.getStringIndex() : nullptr;
+    for (const auto& range : ranges)
+        for (const auto& result : doRangeSearch_(range, xrefIndex.get(), stringIndex.get()))
+            results.insert(result);
+    return selectResults_(results);
+}
+
+bool Search::isMatchAt(const uint8_t* address) const
+{
+    if (!pattern.empty())
+    {
+        // A pattern can match different sizes, so it can only go as far as the mapping it's in
+        BytePattern bytePattern(pattern);
+        Memory::PageInfo page = Memory::queryPage(address, 1).front();
+        size_t size;
+        return bytePattern.isMatchAt(address, std::min<const uint8_t*>(page.start + page.size, address + bytePattern.getMaxSize()), size);
+    }
+    for (size_t b = 0; b < searchBytes.size(); ++b)
+    {
+        for (const auto& specialSearch : specialSearches)
+            if (specialSearch.searchBytesRva == b && !specialSearch.doSearch(address + b))
+                return false;
+        if (ignoredSearchBytesRvas.count(b) == 0 && address[b] != searchBytes[b])
+            return false;
+    }
+    return true;
+}
+
+uint64_t Search::getHash() const
+{
+    Search search = *this;
+    search.rvaHints.clear();
+    std::vector<uint8_t> data = search.Search::serialise();
+    return calculateFnv1aHash(&data[0], data.size());
+}
+
+Search::SearchType Search::getSearchType() const
+{
+    return SearchType::SEARCH;
+}
+
+size_t Search::getMinSize() const
+{
+    return pattern.empty() ? searchBytes.size() : BytePattern(pattern).getMinSize();
+}
+
+bool Search::doHintedSearch_(const Module& module, const std::vector<Memory::PageInfo>& ranges, std::set<uint8_t*>& results) const
+{
+    if (rvaHints.empty())
+        return false;
+    auto rvaHint = rvaHints.find(module.getBuildId());
+    if (rvaHint == rvaHints.end())
+        return false;
+
+    // The search bytes are still the source of truth, so a wrong hint just means a full search
+    uint8_t* result = module.getBase() + rvaHint->second;
+    for (const auto& range : ranges)
+        if (range.isReadable && result >= range.start && result + getMinSize() <= range.start + range.size)
+        {
+            if (!isMatchAt(result))
+                return false;
+            results = {result};
+            return true;
+        }
+    return false;
+}
+
+std::set<uint8_t*> Search::doRangeSearch_(const Memory::PageInfo& range, const XrefIndex* xrefIndex, const StringIndex* stringIndex) const
+{
+    if (!pattern.empty())
+        return range.isReadable ? BytePattern(pattern).find(range.start, range.size) : std::set<uint8_t*>();
+    std::set<uint8_t*> candidates;
+    bool isStringIndexed = false;
+    if (!range.isReadable ||
+        !((isStringIndexed = stringIndex != nullptr && getStringReferenceCandidates_(*stringIndex, range.start, range.size, candidates)) ||
+          (xrefIndex != nullptr && getCallCandidates_(*xrefIndex, range.start, range.size, candidates))))
+        return doSearch_(range.start, range.size);
+
+    // Matches can't overlap, the same as when scanning
+    std::set<uint8_t*> results;
+    const uint8_t* nextStart = range.start;
+    for (const auto& candidate : candidates)
+        if (candidate >= nextStart && isMatchAt(candidate))
+        {
+            results.insert(candidate);
+            nextStart = candidate + searchBytes.size();
+        }
+    // The xref index is built once from the code as it was, so calls patches have written since are only found by scanning
+    if (results.empty() && !isStringIndexed)
+        return doSearch_(range.start, range.size);
+    return results;
+}
+
+bool Search::getCallCandidates_(const XrefIndex& xrefIndex, const uint8_t* start, size_t size, std::set<uint8_t*>& candidates) const
+{
+    // A match has to have its call special searches on calls, so the index gives every place one could be. Any one of them will do.
+    for (const auto& specialSearch : specialSearches)
+    {
+        std::vector<XrefIndex::Call> calls;
+        bool isIndirect = false;
+        switch (specialSearch.getType())
+        {
+            case SpecialSearch::Type::NAMED_RELATIVE_FUNCTION_CALL :
+            case SpecialSearch::Type::NAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL :
+                isIndirect = specialSearch.getType() == SpecialSearch::Type::NAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL;
+                try
+                {
+                    Module module;
+                    if (isIndirect)
+                    {
+                        const auto& namedSearch = specialSearch.getTypeData<NamedAbsoluteIndirectFunctionCallSpecialSearch>();
+                        module.open(namedSearch.moduleName);
+                        calls = xrefIndex.getCallers(module.getSymbol(namedSearch.functionName));
+                    }
+                    else
+                    {
+                        const auto& namedSearch = specialSearch.getTypeData<NamedRelativeFunctionCallSpecialSearch>();
+                        module.open(namedSearch.moduleName);
+                        calls = xrefIndex.getCallers(module.getSymbol(namedSearch.functionName));
+                    }
+                }
+                catch (const std::exception& e)
+                {
+                    return true; // Nothing can call a function that can't be found
+                }
+                break;
+
+            case SpecialSearch::Type::UNNAMED_RELATIVE_FUNCTION_CALL :
+            case SpecialSearch::Type::UNNAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL :
+                isIndirect = specialSearch.getType() == SpecialSearch::Type::UNNAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL;
+                calls = xrefIndex.getCalls(start + specialSearch.searchBytesRva, size);
+                break;
+
+            default:
+                continue;
+        }
+
+        for (const auto& call : calls)
+        {
+            if (call.isIndirect != isIndirect || call.site < start + specialSearch.searchBytesRva)
+                continue;
+            uint8_t* candidate = call.site - specialSearch.searchBytesRva;
+            if (candidate + searchBytes.size() <= start + size)
+                candidates.insert(candidate);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool Search::getStringReferenceCandidates_(const StringIndex& stringIndex, const uint8_t* start, size_t size, std::set<uint8_t*>& candidates) const
+{
+    // The same as with calls, but strings are much rarer, so the index narrows it down further
+    for (const auto& specialSearch : specialSearches)
+    {
+        if (specialSearch.getType() != SpecialSearch::Type::STRING_REFERENCE)
+            continue;
+        const auto& stringReferenceSearch = specialSearch.getTypeData<StringReferenceSpecialSearch>();
+        for (const auto& reference : stringIndex.getReferences(stringReferenceSearch.string))
+        {
+            if (reference.isGotRelative != stringReferenceSearch.isGotRelative || reference.site < start + specialSearch.searchBytesRva)
+                continue;
+            uint8_t* candidate = reference.site - specialSearch.searchBytesRva;
+            if (candidate + searchBytes.size() <= start + size)
+                candidates.insert(candidate);
+        }
+        return true;
+    }
+    return false;
+}
+
+bool Search::hasCallSpecialSearch_() const
+{
+    for (const auto& specialSearch : specialSearches)
+        if (specialSearch.getType() == SpecialSearch::Type::NAMED_RELATIVE_FUNCTION_CALL ||
+            specialSearch.getType() == SpecialSearch::Type::UNNAMED_RELATIVE_FUNCTION_CALL ||
+            specialSearch.getType() == SpecialSearch::Type::NAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL ||
+            specialSearch.getType() == SpecialSearch::Type::UNNAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL)
+            return true;
+    return false;
+}
+
+bool Search::hasStringReferenceSpecialSearch_() const
+{
+    for (const auto& specialSearch : specialSearches)
+        if (specialSearch.getType() == SpecialSearch::Type::STRING_REFERENCE)
+            return true;
+    return false;
+}
+
+std::vector<Memory::PageInfo> Search::getScopedRanges_(const uint8_t* base, const std::vector<Memory::PageInfo>& segments,
+                                                       const std::map<std::string, Memory::PageInfo>& sections) const
+{
+    std::vector<Memory::PageInfo> ranges;
+    if (sectionNames.empty())
+        ranges = segments;
+    else
+        for (const auto& sectionName : sectionNames)
+        {
+            auto section = sections.find(sectionName);
+            if (section == sections.end())
+                throw std::runtime_error("Section \"" + sectionName + "\" not found in module \"" + moduleName + "\".");
+            ranges.push_back(section->second);
+        }
+
+    std::vector<Memory::PageInfo> permittedRanges;
+    for (const auto& range : ranges)
+        if ((!isExecutableOnly || range.isExecutable) && (!isWritableOnly || range.isWritable))
+            permittedRanges.push_back(range);
+    if (rvaRanges.empty())
+        return permittedRanges;
+
+    std::vector<Memory::PageInfo> results;
+    for (const auto& rvaRange : rvaRanges)
+        for (const auto& range : clipRanges_(permittedRanges, base + rvaRange.first, rvaRange.second))
+            results.push_back(range);
+    return results;
+}
+
+std::vector<Memory::PageInfo> Search::clipRanges_(const std::vector<Memory::PageInfo>& ranges, const uint8_t* start, size_t size)
+{
+    std::vector<Memory::PageInfo> results;
+    for (const auto& range : ranges)
+    {
+        uint8_t* clippedStart = std::max(range.start, (uint8_t*)start);
+        uint8_t* clippedEnd = std::min(range.start + range.size, (uint8_t*)start + size);
+        if (clippedStart >= clippedEnd)
+            continue;
+        Memory::PageInfo result = range;
+        result.start = clippedStart;
+        result.size = clippedEnd - clippedStart;
+        results.push_back(result);
+    }
+    return results;
+}
+
+std::vector<Memory::PageInfo> Search::getAnchoredRanges_(const std::vector<Memory::PageInfo>& ranges, const std::set<uint8_t*>& anchorResults) const
+{
+    std::vector<Memory::PageInfo> results;
+    for (const auto& anchorResult : anchorResults)
+        for (const auto& range : clipRanges_(ranges, anchorResult + anchorWindowOffset, anchorWindowSize))
+            results.push_back(range);
+    return results;
+}
+
+std::set<uint8_t*> Search::selectResults_(const std::set<uint8_t*>& results) const
+{
+    if (isUniqueResultRequired && results.size() > 1)
+        return {};
+    if (resultIndex == (size_t)-1)
+        return results;
+    if (resultIndex >= results.size())
+        return {};
+    return {*std::next(results.cbegin(), resultIndex)};
 }
 
 std::set<uint8_t*> Search::doSearch_(const uint8_t* start, size_t size) const
@@ -130,9 +569,9 @@ std::set<uint8_t*> Search::doSearch_(const uint8_t* start, size_t size) const
             isProtectionChanged = true;
         }
 
-        // Actual search
-        uint8_t* searchStart = segment.start;
-        uint8_t* searchEnd = searchStart + segment.size;
+        // Actual search, only inside what was asked for as the pages go on around it
+        uint8_t* searchStart = std::max(segment.start, (uint8_t*)start);
+        uint8_t* searchEnd = std::min(segment.start + segment.size, (uint8_t*)start + size);
         while (searchStart < searchEnd)
         {
             uint8_t* result = std::search(searchStart, searchEnd, flaggedSearchBytes.begin(), flaggedSearchBytes.end(),
@@ -185,6 +624,10 @@ void NameSearch::checkValid(const size_t minSearchBytes) const
     Search::checkValid(minSearchBytes);
     if (functionName.empty())
         throw std::logic_error("The function name cannot be empty.");
+    if (!pattern.empty())
+        throw std::logic_error("Name searches can't have a pattern, as they only check the bytes at the function.");
+    if (!anchorSearches.empty())
+        throw std::logic_error("Name searches can't have an anchor search, as they're found by name.");
 }
 
 void NameSearch::checkOverlapWith(const NameSearch& rvalue) const
@@ -206,9 +649,319 @@ std::set<uint8_t*> NameSearch::doSearch() const
     checkValid(searchBytes.size());
     Module module;
     module.open(moduleName);
+    std::set<uint8_t*> results;
+    if (doHintedSearch_(module, module.getOriginalSegments(), results))
+        return results;
     return doSearch_(module.getSymbol(functionName) + functionRva, searchBytes.size());
 }
 
+std::set<size_t> NameSearch::doImageSearch(const ElfImage& image) const
+{
+    checkValid(searchBytes.size());
+    std::set<size_t> results;
+    for (const auto& result : doSearch_(image.getSymbol(functionName) + functionRva, searchBytes.size()))
+        results.insert(result - image.getBase());
+    return results;
+}
+
+Search::SearchType NameSearch::getSearchType() const
+{
+    return SearchType::NAME;
+}
+
+uint64_t NameSearch::getHash() const
+{
+    NameSearch search = *this;
+    search.rvaHints.clear();
+    std::vector<uint8_t> data = search.NameSearch::serialise();
+    return calculateFnv1aHash(&data[0], data.size());
+}
+
+// InstructionSearch class
+
+InstructionSearch::InstructionSearch()
+{
+    isExecutableOnly = true;
+}
+
+std::vector<uint8_t> InstructionSearch::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, Search::serialise());
+    serialiseIntegralTypeContinuousContainer(data, instructions);
+
+    return data;
+}
+
+void InstructionSearch::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    Search::deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+    deserialiseIntegralTypeContinuousContainer(iterator, instructions);
+}
+
+void InstructionSearch::checkValid(const size_t minSearchBytes) const
+{
+    if (!searchBytes.empty() || !ignoredSearchBytesRvas.empty() || !specialSearches.empty() || !pattern.empty())
+        throw std::logic_error("Instruction searches can't have search bytes, ignored search bytes, special searches or a pattern.");
+    Search::checkValid(0); // Checks the instructions are valid
+    if (getMinSize() < minSearchBytes)
+        throw std::logic_error("The instructions must be at least " + itos(minSearchBytes) + " byte(s) long.");
+}
+
+bool InstructionSearch::isMatchAt(const uint8_t* address) const
+{
+    // There's no search bytes size to know how far it goes, so only as far as the mapping it's in
+    InstructionPattern pattern(instructions);
+    Memory::PageInfo page = Memory::queryPage(address, 1).front();
+    size_t size;
+    return pattern.isMatchAt(address, std::min<const uint8_t*>(page.start + page.size, address + pattern.getMaxSize()), size);
+}
+
+Search::SearchType InstructionSearch::getSearchType() const
+{
+    return SearchType::INSTRUCTION;
+}
+
+size_t InstructionSearch::getMinSize() const
+{
+    return InstructionPattern(instructions).getMinSize();
+}
+
+uint64_t InstructionSearch::getHash() const
+{
+    InstructionSearch search = *this;
+    search.rvaHints.clear();
+    std::vector<uint8_t> data = search.InstructionSearch::serialise();
+    return calculateFnv1aHash(&data[0], data.size());
+}
+
+std::set<uint8_t*> InstructionSearch::doRangeSearch_(const Memory::PageInfo& range, const XrefIndex* xrefIndex, const StringIndex* stringIndex) const
+{
+    (void)xrefIndex;
+    (void)stringIndex;
+    if (!range.isReadable)
+        return {};
+    return InstructionPattern(instructions).find(range.start, range.size);
+}
+
+// ImportSearch class
+
+std::vector<uint8_t> ImportSearch::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, moduleName);
+    serialiseIntegralTypeContinuousContainer(data, importName);
+
+    return data;
+}
+
+void ImportSearch::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralTypeContinuousContainer(iterator, moduleName);
+    deserialiseIntegralTypeContinuousContainer(iterator, importName);
+}
+
+void ImportSearch::checkValid() const
+{
+    if (moduleName.empty())
+        throw std::logic_error("The module name cannot be empty.");
+    if (importName.empty())
+        throw std::logic_error("The import name cannot be empty.");
+}
+
+void ImportSearch::checkOverlapWith(const ImportSearch& rvalue) const
+{
+    // Wildcards could match anything, so only different import names are sure to not overlap
+    if (importName == rvalue.importName &&
+        (moduleName == rvalue.moduleName || isWildcardPattern(moduleName) || isWildcardPattern(rvalue.moduleName)))
+        throw std::logic_error("The import search overlaps with another import search.");
+}
+
+std::set<uint8_t*> ImportSearch::doSearch() const
+{
+    checkValid();
+    std::set<uint8_t*> results;
+    if (!isWildcardPattern(moduleName))
+    {
+        Module module;
+        module.open(moduleName);
+        for (const auto& slot : module.getImportSlots(importName))
+            results.insert((uint8_t*)slot);
+        return results;
+    }
+
+    for (const auto& pathfile : Module::enumerateModules())
+    {
+        Module module;
+        try
+        {
+            module.open(pathfile);
+        } catch (...)
+        {
+            continue; // Unloaded since it was enumerated
+        }
+        if (!isWildcardMatch(moduleName, module.getFile()))
+            continue;
+        for (const auto& slot : module.getImportSlots(importName))
+            results.insert((uint8_t*)slot);
+    }
+    return results;
+}
+
+// VtableSearch class
+
+VtableSearch::VtableSearch():
+    slotIndex(0)
+{
+}
+
+std::vector<uint8_t> VtableSearch::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, moduleName);
+    serialiseIntegralTypeContinuousContainer(data, className);
+    serialiseIntegralType(data, slotIndex);
+
+    return data;
+}
+
+void VtableSearch::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralTypeContinuousContainer(iterator, moduleName);
+    deserialiseIntegralTypeContinuousContainer(iterator, className);
+    deserialiseIntegralType(iterator, slotIndex);
+}
+
+void VtableSearch::checkValid() const
+{
+    if (moduleName.empty())
+        throw std::logic_error("The module name cannot be empty.");
+    if (className.empty())
+        throw std::logic_error("The class name cannot be empty.");
+}
+
+void VtableSearch::checkOverlapWith(const VtableSearch& rvalue) const
+{
+    if (moduleName == rvalue.moduleName &&
+        className == rvalue.className &&
+        slotIndex == rvalue.slotIndex)
+        throw std::logic_error("The vtable search overlaps with another vtable search.");
+}
+
+std::set<uint8_t*> VtableSearch::doSearch() const
+{
+    checkValid();
+    Module module;
+    module.open(moduleName);
+    Module::Vtable vtable = module.getVtable(className);
+    if (slotIndex >= vtable.slotsCount)
+        throw std::runtime_error("The vtable of class " + className + " only has " + itos(vtable.slotsCount) + " slots.");
+    bool isCodePointer = false;
+    for (const auto& segment : Memory::enumerateSegments())
+        if (segment.isExecutable && vtable.addressPoint[slotIndex] >= segment.start && vtable.addressPoint[slotIndex] < segment.start + segment.size)
+            isCodePointer = true;
+    if (!isCodePointer)
+        throw std::runtime_error("Slot " + itos(slotIndex) + " of the vtable of class " + className + " doesn't point at code.");
+    return {(uint8_t*)(vtable.addressPoint + slotIndex)};
+}
+
+// CallSearch class
+
+CallSearch::CallSearch():
+    callIndex(0)
+{
+}
+
+std::vector<uint8_t> CallSearch::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, moduleName);
+    serialiseIntegralTypeContinuousContainer(data, callerName);
+    serialiseIntegralTypeContinuousContainer(data, calleeModuleName);
+    serialiseIntegralTypeContinuousContainer(data, calleeName);
+    serialiseIntegralType(data, callIndex);
+
+    return data;
+}
+
+void CallSearch::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralTypeContinuousContainer(iterator, moduleName);
+    deserialiseIntegralTypeContinuousContainer(iterator, callerName);
+    deserialiseIntegralTypeContinuousContainer(iterator, calleeModuleName);
+    deserialiseIntegralTypeContinuousContainer(iterator, calleeName);
+    deserialiseIntegralType(iterator, callIndex);
+}
+
+void CallSearch::checkValid() const
+{
+    if (moduleName.empty() || calleeModuleName.empty())
+        throw std::logic_error("The module names cannot be empty.");
+    if (callerName.empty() || calleeName.empty())
+        throw std::logic_error("The function names cannot be empty.");
+}
+
+std::set<uint8_t*> CallSearch::doSearch() const
+{
+    checkValid();
+    Module module;
+    module.open(moduleName);
+    std::shared_ptr<const FunctionIndex> functionIndex = module.getFunctionIndex();
+    const FunctionIndex::Function* caller = functionIndex->find(module.getFunction(callerName));
+    if (caller == nullptr)
+        throw std::runtime_error("Function \"" + callerName + "\" has no unwind info to give its size.");
+    Module calleeModule;
+    calleeModule.open(calleeModuleName);
+    const uint8_t* callee = calleeModule.getFunction(calleeName);
+
+    // Walk the caller's instructions so bytes that only look like a call inside another instruction aren't counted.
+    // Whatever the decoder can't follow is left to the index, which could count one of those.
+    std::shared_ptr<const XrefIndex> xrefIndex = module.getXrefIndex();
+    std::vector<XrefIndex::Call> calls;
+    const uint8_t* callerEnd = caller->start + caller->size;
+    const uint8_t* instruction = caller->start;
+    try
+    {
+        for (; instruction < callerEnd; instruction += X86::getInstructionLength(instruction))
+        {
+            const XrefIndex::Call* call = xrefIndex->getCallAt(instruction);
+            if (call != nullptr)
+                calls.push_back(*call);
+        }
+    }
+    catch (const std::exception& e)
+    {
+        for (const auto& call : xrefIndex->getCalls(instruction, callerEnd - instruction))
+            calls.push_back(call);
+    }
+
+    std::vector<uint8_t*> sites;
+    for (const auto& call : calls)
+        if (call.isIndirect ? *(uint8_t**)call.target == callee : call.target == callee)
+            sites.push_back(call.site);
+    if (callIndex == (size_t)-1)
+        return std::set<uint8_t*>(sites.cbegin(), sites.cend());
+    if (callIndex < sites.size())
+        return {sites[callIndex]};
+    return {};
+}
+
 // SpecialSearch class
 
 SpecialSearch::SpecialSearch():
@@ -267,6 +1020,10 @@ std::vector<uint8_t> SpecialSearch::serialise() const
             serialiseIntegralTypeContinuousContainer(data, getTypeData<DataPointerSpecialSearch>().serialise());
             break;
 
+        case Type::STRING_REFERENCE :
+            serialiseIntegralTypeContinuousContainer(data, getTypeData<StringReferenceSpecialSearch>().serialise());
+            break;
+
         case Type::BLANK :
             break;
 
@@ -304,6 +1061,10 @@ void SpecialSearch::deserialise(const std::vector<uint8_t>& data)
             setType<DataPointerSpecialSearch>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
             break;
 
+        case Type::STRING_REFERENCE :
+            setType<StringReferenceSpecialSearch>().deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
+            break;
+
         case Type::BLANK :
             clearType();
             break;
@@ -337,6 +1098,10 @@ void SpecialSearch::copyTypeFrom(const SpecialSearch& rvalue)
             setType<DataPointerSpecialSearch>(rvalue.getTypeData<DataPointerSpecialSearch>());
             break;
 
+        case Type::STRING_REFERENCE :
+            setType<StringReferenceSpecialSearch>(rvalue.getTypeData<StringReferenceSpecialSearch>());
+            break;
+
         case Type::BLANK :
             clearType();
             break;
@@ -370,6 +1135,10 @@ void SpecialSearch::clearType()
             delete &getTypeData<DataPointerSpecialSearch>();
             break;
 
+        case Type::STRING_REFERENCE :
+            delete &getTypeData<StringReferenceSpecialSearch>();
+            break;
+
         case Type::BLANK :
             break;
 
@@ -408,6 +1177,10 @@ void SpecialSearch::checkValid(const Search& parent) const
             getTypeData<DataPointerSpecialSearch>().checkValid(*this, parent);
             break;
 
+        case Type::STRING_REFERENCE :
+            getTypeData<StringReferenceSpecialSearch>().checkValid(*this, parent);
+            break;
+
         case Type::BLANK :
             throw std::logic_error("Special search cannot be blank.");
 
@@ -435,6 +1208,9 @@ bool SpecialSearch::doSearch(const uint8_t* address) const
         case Type::DATA_POINTER :
             return getTypeData<DataPointerSpecialSearch>().doSearch(address);
 
+        case Type::STRING_REFERENCE :
+            return getTypeData<StringReferenceSpecialSearch>().doSearch(address);
+
         case Type::BLANK :
             break;
     }
@@ -468,19 +1244,16 @@ void NamedRelativeFunctionCallSpecialSearch::checkValid(const SpecialSearch& par
 
 bool NamedRelativeFunctionCallSpecialSearch::doSearch(const uint8_t* address) const
 {
-    class
-    {
-        public:
-            uint8_t opCode; // 0xe8
-            size_t functionRva;
-    } instruction = *(decltype(instruction)*)address;
-    if (instruction.opCode != 0xe8)
+    // e8 rel32
+    if (address[0] != 0xe8)
         return false;
+    int32_t functionRva;
+    std::memcpy(&functionRva, address + 1, sizeof(functionRva));
     try
     {
         Module module;
         module.open(moduleName);
-        if (address + sizeof(decltype(instruction)) + instruction.functionRva != module.getSymbol(functionName))
+        if (address + 5 + functionRva != module.getSymbol(functionName))
             return false;
     }
     catch (const std::exception& e)
@@ -508,21 +1281,14 @@ void UnnamedRelativeFunctionCallSpecialSearch::checkValid(const SpecialSearch& p
 
 bool UnnamedRelativeFunctionCallSpecialSearch::doSearch(const uint8_t* address) const
 {
-    class
-    {
-        public:
-            uint8_t opCode; // 0xe8
-            size_t functionRva;
-    } instruction = *(decltype(instruction)*)address;
-    if (instruction.opCode != 0xe8)
+    // e8 rel32
+    if (address[0] != 0xe8)
         return false;
+    int32_t functionRva;
+    std::memcpy(&functionRva, address + 1, sizeof(functionRva));
 
-    // Create a data pointer special search to do the actual checking
-    DataPointerSpecialSearch dataPointerSpecialSearch;
-    dataPointerSpecialSearch.searchBytes = searchBytes;
-    dataPointerSpecialSearch.ignoredSearchBytesRvas = ignoredSearchBytesRvas;
-    dataPointerSpecialSearch.specialSearches = specialSearches;
-    return dataPointerSpecialSearch.doSearch(address + sizeof(decltype(instruction)) + instruction.functionRva);
+    // The function's own code is what's checked, so it's searched for right where the call goes
+    return doSearch_(address + 5 + functionRva, searchBytes.size()).size() > 0;
 }
 
 std::vector<uint8_t> NamedAbsoluteIndirectFunctionCallSpecialSearch::serialise() const
@@ -552,14 +1318,8 @@ void NamedAbsoluteIndirectFunctionCallSpecialSearch::checkValid(const SpecialSea
 
 bool NamedAbsoluteIndirectFunctionCallSpecialSearch::doSearch(const uint8_t* address) const
 {
-    class
-    {
-        public:
-            uint8_t opCode1; // 0xff
-            uint8_t opCode2; // 0x15
-            uint8_t** functionAddressAddress; // Points to an address which contains an address to the function
-    } instruction = *(decltype(instruction)*)address;
-    if (instruction.opCode1 != 0xff && instruction.opCode2 != 0x15)
+    // ff 15 followed by the address of the slot holding the function's address
+    if (address[0] != 0xff || address[1] != 0x15)
         return false;
     try
     {
@@ -568,10 +1328,10 @@ bool NamedAbsoluteIndirectFunctionCallSpecialSearch::doSearch(const uint8_t* add
         module.open(moduleName);
         uint8_t* function = module.getSymbol(functionName);
 
-        // Create a data pointer special search to do the actual checking
+        // Create a data pointer special search on the slot's address to do the actual checking
         DataPointerSpecialSearch dataPointerSpecialSearch;
         serialiseIntegralType(dataPointerSpecialSearch.searchBytes, function);
-        return dataPointerSpecialSearch.doSearch((uint8_t*)instruction.functionAddressAddress);
+        return dataPointerSpecialSearch.doSearch(address + 2);
     }
     catch (const std::exception& e)
     {
@@ -597,14 +1357,8 @@ void UnnamedAbsoluteIndirectFunctionCallSpecialSearch::checkValid(const SpecialS
 
 bool UnnamedAbsoluteIndirectFunctionCallSpecialSearch::doSearch(const uint8_t* address) const
 {
-    class
-    {
-        public:
-            uint8_t opCode1; // 0xff
-            uint8_t opCode2; // 0x15
-            uint8_t** functionAddressAddress; // Points to an address which contains an address to the function
-    } instruction = *(decltype(instruction)*)address;
-    if (instruction.opCode1 != 0xff && instruction.opCode2 != 0x15)
+    // ff 15 followed by the address of the slot holding the function's address
+    if (address[0] != 0xff || address[1] != 0x15)
         return false;
 
     // Create a data pointer special search to do the actual checking
@@ -620,7 +1374,8 @@ bool UnnamedAbsoluteIndirectFunctionCallSpecialSearch::doSearch(const uint8_t* a
     dataPointerSpecialSearch2.specialSearches = specialSearches;
     dataPointerSpecialSearch.specialSearches.push_back(specialSearch2);
 
-    return dataPointerSpecialSearch.doSearch((uint8_t*)instruction.functionAddressAddress);
+    // From the slot's address in the instruction, to the slot, to the function
+    return dataPointerSpecialSearch.doSearch(address + 2);
 }
 
 std::vector<uint8_t> DataPointerSpecialSearch::serialise() const
@@ -644,4 +1399,64 @@ bool DataPointerSpecialSearch::doSearch(const uint8_t* address) const
     return doSearch_(*(uint8_t**)address, searchBytes.size()).size() > 0;
 }
 
+StringReferenceSpecialSearch::StringReferenceSpecialSearch():
+    isGotRelative(false)
+{
+}
+
+std::vector<uint8_t> StringReferenceSpecialSearch::serialise() const
+{
+    std::vector<uint8_t> data;
+    data.reserve(1024);
+
+    serialiseIntegralTypeContinuousContainer(data, string);
+    serialiseIntegralType(data, isGotRelative);
+    serialiseIntegralTypeContinuousContainer(data, moduleName);
+
+    return data;
+}
+
+void StringReferenceSpecialSearch::deserialise(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+
+    deserialiseIntegralTypeContinuousContainer(iterator, string);
+    deserialiseIntegralType(iterator, isGotRelative);
+    deserialiseIntegralTypeContinuousContainer(iterator, moduleName);
+}
+
+void StringReferenceSpecialSearch::checkValid(const SpecialSearch& parent, const Search& parentParent) const
+{
+    if (parent.searchBytesRva + 4 > parentParent.searchBytes.size())
+        throw std::logic_error("String reference special searches require at least 4 bytes from the RVA.");
+    if (string.empty())
+        throw std::logic_error("String reference special searches require a string.");
+}
+
+bool StringReferenceSpecialSearch::doSearch(const uint8_t* address) const
+{
+    // Create a data pointer special search on the string and its terminator to do the actual checking
+    DataPointerSpecialSearch dataPointerSpecialSearch;
+    dataPointerSpecialSearch.searchBytes.assign(string.cbegin(), string.cend());
+    dataPointerSpecialSearch.searchBytes.push_back(0);
+    if (!isGotRelative)
+        return dataPointerSpecialSearch.doSearch(address);
+    try
+    {
+        Module module;
+        module.open(moduleName);
+        uint8_t* globalOffsetTable = module.getGlobalOffsetTable();
+        if (globalOffsetTable == nullptr)
+            return false;
+        int32_t offset;
+        std::memcpy(&offset, address, sizeof(offset));
+        uint8_t* pointer = globalOffsetTable + offset;
+        return dataPointerSpecialSearch.doSearch((const uint8_t*)&pointer);
+    }
+    catch (const std::exception& e)
+    {
+        return false;
+    }
+}
+
 }
@@ -0,0 +1,133 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include <cstring>
+
+#include "StringIndex.h"
+
+namespace
+{
+    bool isPrintable(uint8_t byte)
+    {
+        return (byte >= 0x20 && byte < 0x7f) || byte == '\t' || byte == '\n' || byte == '\r';
+    }
+}
+
+void StringIndex::build(const std::vector<Memory::PageInfo>& segments, const std::map<std::string, Memory::PageInfo>& sections,
+                        const uint8_t* globalOffsetTable)
+{
+    strings_.clear();
+    stringAddresses_.clear();
+    references_.clear();
+
+    std::vector<Memory::PageInfo> stringRanges;
+    auto rodata = sections.find(".rodata");
+    if (rodata != sections.end())
+        stringRanges.push_back(rodata->second);
+    else
+        for (const auto& segment : segments)
+            if (segment.isReadable && !segment.isWritable)
+                stringRanges.push_back(segment);
+
+    // memchr is vectorised, so let it find the terminators, then walk back over each run of printable bytes before one
+    for (const auto& range : stringRanges)
+    {
+        const uint8_t* rangeEnd = range.start + range.size;
+        const uint8_t* runStart = range.start;
+        for (const uint8_t* terminator = (const uint8_t*)std::memchr(runStart, 0, rangeEnd - runStart);
+             terminator != nullptr;
+             terminator = runStart < rangeEnd ? (const uint8_t*)std::memchr(runStart, 0, rangeEnd - runStart) : nullptr)
+        {
+            const uint8_t* stringStart = terminator;
+            while (stringStart > runStart && isPrintable(stringStart[-1]))
+                --stringStart;
+            if ((size_t)(terminator - stringStart) >= minStringSize)
+            {
+                String_ string;
+                string.start = (uint8_t*)stringStart;
+                string.size = terminator - stringStart;
+                strings_.push_back(string);
+                stringAddresses_[std::string((const char*)stringStart, string.size)].push_back(string.start);
+            }
+            runStart = terminator + 1;
+        }
+    }
+    std::sort(strings_.begin(), strings_.end(), [](const String_& a, const String_& b) { return a.start < b.start; });
+    if (strings_.empty())
+        return;
+
+    // Every 4 bytes of code could be an immediate or displacement, but data only holds aligned pointers
+    for (const auto& segment : segments)
+    {
+        if (!segment.isReadable)
+            continue;
+        const size_t step = segment.isExecutable ? 1 : sizeof(uint32_t);
+        for (const uint8_t* site = segment.start; site + sizeof(uint32_t) <= segment.start + segment.size; site += step)
+        {
+            uint32_t value;
+            std::memcpy(&value, site, sizeof(value));
+            addReference_((uint8_t*)site, (uint8_t*)value, false);
+            if (segment.isExecutable && globalOffsetTable != nullptr)
+                addReference_((uint8_t*)site, (uint8_t*)globalOffsetTable + (int32_t)value, true);
+        }
+    }
+}
+
+std::vector<uint8_t*> StringIndex::getStrings(const std::string& string) const
+{
+    auto found = stringAddresses_.find(string);
+    if (found == stringAddresses_.end())
+        return {};
+    return found->second;
+}
+
+const std::vector<StringIndex::Reference>& StringIndex::getReferences(const std::string& string) const
+{
+    static const std::vector<Reference> noReferences;
+    auto found = references_.find(string);
+    if (found == references_.end())
+        return noReferences;
+    return found->second;
+}
+
+size_t StringIndex::getStringsCount() const
+{
+    return strings_.size();
+}
+
+// Private members
+
+void StringIndex::addReference_(uint8_t* site, uint8_t* address, bool isGotRelative)
+{
+    // Most values aren't anywhere near the strings, so rule them out before looking
+    if (address < strings_.front().start || address >= strings_.back().start + strings_.back().size)
+        return;
+    auto string = std::upper_bound(strings_.cbegin(), strings_.cend(), address, [](const uint8_t* address, const String_& string) { return address < string.start; });
+    if (string == strings_.cbegin())
+        return;
+    --string;
+    if (address >= string->start + string->size)
+        return;
+
+    Reference reference;
+    reference.site = site;
+    reference.string = address;
+    reference.isGotRelative = isGotRelative;
+    references_[std::string((const char*)address, string->start + string->size - address)].push_back(reference); // Sites are visited in order
+}
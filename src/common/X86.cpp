@@ -0,0 +1,369 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdexcept>
+
+#include <cstring>
+
+#include "X86.h"
+
+namespace X86
+{
+
+namespace
+{
+    enum OperandFlags : uint8_t
+    {
+        NONE = 0,
+        MODRM = 1 << 0,
+        IMM8 = 1 << 1,
+        IMM16 = 1 << 2,
+        IMMZ = 1 << 3, // 16 or 32 bits depending on the operand size
+        MOFFS = 1 << 4, // 16 or 32 bits depending on the address size
+        RELATIVE = 1 << 5,
+        GROUP3 = 1 << 6, // f6 and f7 only have an immediate for /0 and /1
+        INVALID = 1 << 7
+    };
+
+    uint8_t getOneByteOpcodeFlags(uint8_t opcode)
+    {
+        if (opcode < 0x40)
+        {
+            switch (opcode & 0x07)
+            {
+                case 0: case 1: case 2: case 3:
+                    return MODRM;
+                case 4:
+                    return IMM8;
+                case 5:
+                    return IMMZ;
+                default:
+                    return NONE; // push/pop segment, prefixes and the BCD adjusts
+            }
+        }
+        if (opcode < 0x60)
+            return NONE;
+        if (opcode >= 0x70 && opcode <= 0x7f)
+            return IMM8 | RELATIVE;
+        if (opcode >= 0x84 && opcode <= 0x8f)
+            return MODRM;
+        if (opcode >= 0x90 && opcode <= 0x9f)
+            return opcode == 0x9a ? IMMZ | IMM16 : NONE;
+        if (opcode >= 0xb0 && opcode <= 0xb7)
+            return IMM8;
+        if (opcode >= 0xb8 && opcode <= 0xbf)
+            return IMMZ;
+        if (opcode >= 0xd8 && opcode <= 0xdf)
+            return MODRM;
+
+        switch (opcode)
+        {
+            case 0x62: case 0x63: case 0xc4: case 0xc5: case 0xd0: case 0xd1: case 0xd2: case 0xd3: case 0xfe: case 0xff:
+                return MODRM;
+            case 0x68: case 0xa9:
+                return IMMZ;
+            case 0x69: case 0x81: case 0xc7:
+                return MODRM | IMMZ;
+            case 0x6a: case 0xa8: case 0xcd: case 0xd4: case 0xd5: case 0xe4: case 0xe5: case 0xe6: case 0xe7:
+                return IMM8;
+            case 0x6b: case 0x80: case 0x82: case 0x83: case 0xc0: case 0xc1: case 0xc6:
+                return MODRM | IMM8;
+            case 0xa0: case 0xa1: case 0xa2: case 0xa3:
+                return MOFFS;
+            case 0xc2: case 0xca:
+                return IMM16;
+            case 0xc8:
+                return IMM16 | IMM8;
+            case 0xe0: case 0xe1: case 0xe2: case 0xe3: case 0xeb:
+                return IMM8 | RELATIVE;
+            case 0xe8: case 0xe9:
+                return IMMZ | RELATIVE;
+            case 0xea:
+                return IMMZ | IMM16;
+            case 0xf6: case 0xf7:
+                return MODRM | GROUP3;
+            default:
+                return NONE;
+        }
+    }
+
+    uint8_t getTwoByteOpcodeFlags(uint8_t opcode)
+    {
+        if (opcode >= 0x80 && opcode <= 0x8f)
+            return IMMZ | RELATIVE;
+        if (opcode >= 0xc8 && opcode <= 0xcf)
+            return NONE; // bswap
+
+        switch (opcode)
+        {
+            case 0x04: case 0x0a: case 0x0c: case 0x24: case 0x25: case 0x26: case 0x27: case 0x36: case 0x39:
+            case 0x3b: case 0x3c: case 0x3d: case 0x3e: case 0x3f: case 0xa6: case 0xa7:
+                return INVALID;
+            case 0x05: case 0x06: case 0x07: case 0x08: case 0x09: case 0x0b: case 0x0e: case 0x30: case 0x31:
+            case 0x32: case 0x33: case 0x34: case 0x35: case 0x37: case 0x77: case 0xa0: case 0xa1: case 0xa2:
+            case 0xa8: case 0xa9: case 0xaa:
+                return NONE;
+            case 0x0f: case 0x70: case 0x71: case 0x72: case 0x73: case 0xa4: case 0xac: case 0xba: case 0xc2:
+            case 0xc4: case 0xc5: case 0xc6:
+                return MODRM | IMM8;
+            default:
+                return MODRM;
+        }
+    }
+
+    bool isPrefix(uint8_t byte)
+    {
+        switch (byte)
+        {
+            case 0x26: case 0x2e: case 0x36: case 0x3e: case 0x64: case 0x65: case 0x66: case 0x67: case 0xf0: case 0xf2: case 0xf3:
+                return true;
+            default:
+                return false;
+        }
+    }
+
+    size_t getModRmOperandsSize(const uint8_t* modRm, bool isAddressSize16, size_t& displacementSize)
+    {
+        uint8_t mod = *modRm >> 6;
+        uint8_t rm = *modRm & 0x07;
+
+        displacementSize = 0;
+        if (mod == 3)
+            return 1;
+
+        if (isAddressSize16)
+        {
+            if (mod == 1)
+                displacementSize = 1;
+            else if (mod == 2 || rm == 6)
+                displacementSize = 2;
+            return 1 + displacementSize;
+        }
+
+        size_t size = 1;
+        if (rm == 4)
+        {
+            ++size; // SIB
+            if (mod == 0 && (modRm[1] & 0x07) == 5)
+                displacementSize = 4;
+        }
+        if (mod == 1)
+            displacementSize = 1;
+        else if (mod == 2 || (mod == 0 && rm == 5))
+            displacementSize = 4;
+        return size + displacementSize;
+    }
+
+    int32_t readSigned(const uint8_t* data, size_t size)
+    {
+        switch (size)
+        {
+            case 1:
+                return (int8_t)*data;
+            case 2:
+            {
+                int16_t value;
+                memcpy(&value, data, sizeof(value));
+                return value;
+            }
+            case 4:
+            {
+                int32_t value;
+                memcpy(&value, data, sizeof(value));
+                return value;
+            }
+            default:
+                throw std::logic_error("Invalid immediate size.");
+        }
+    }
+
+    void appendInt32(std::vector<uint8_t>& data, int32_t value)
+    {
+        uint8_t bytes[sizeof(value)];
+        memcpy(bytes, &value, sizeof(value));
+        data.insert(data.end(), bytes, bytes + sizeof(bytes));
+    }
+}
+
+Instruction decode(const uint8_t* code)
+{
+    Instruction instruction = {};
+
+    bool isOperandSize16 = false;
+    bool isAddressSize16 = false;
+    while (isPrefix(code[instruction.prefixesSize]))
+    {
+        if (code[instruction.prefixesSize] == 0x66)
+            isOperandSize16 = true;
+        else if (code[instruction.prefixesSize] == 0x67)
+            isAddressSize16 = true;
+        if (++instruction.prefixesSize >= maxInstructionLength)
+            throw std::runtime_error("Instruction has too many prefixes.");
+    }
+
+    const uint8_t* opcode = code + instruction.prefixesSize;
+    uint8_t flags;
+    if (opcode[0] != 0x0f)
+    {
+        instruction.opcodeSize = 1;
+        flags = getOneByteOpcodeFlags(opcode[0]);
+
+        // In 32-bit code, c4 and c5 with a register operand are VEX prefixes rather than les and lds
+        if ((opcode[0] == 0xc4 || opcode[0] == 0xc5) && opcode[1] >> 6 == 3)
+            throw std::runtime_error("VEX encoded instructions are not supported.");
+        if (flags & GROUP3 && (opcode[1] >> 3 & 0x07) < 2)
+            flags |= opcode[0] == 0xf6 ? IMM8 : IMMZ;
+    }
+    else if (opcode[1] == 0x38)
+    {
+        instruction.opcodeSize = 3;
+        flags = MODRM;
+    }
+    else if (opcode[1] == 0x3a)
+    {
+        instruction.opcodeSize = 3;
+        flags = MODRM | IMM8;
+    }
+    else
+    {
+        instruction.opcodeSize = 2;
+        flags = getTwoByteOpcodeFlags(opcode[1]);
+    }
+    if (flags & INVALID)
+        throw std::runtime_error("Unknown instruction.");
+
+    size_t length = instruction.prefixesSize + instruction.opcodeSize;
+    if (flags & MODRM)
+    {
+        instruction.hasModRm = true;
+        size_t displacementSize;
+        size_t operandsSize = getModRmOperandsSize(code + length, isAddressSize16, displacementSize);
+        if (displacementSize != 0)
+        {
+            instruction.displacementOffset = length + operandsSize - displacementSize;
+            instruction.displacementSize = displacementSize;
+        }
+        length += operandsSize;
+    }
+
+    instruction.immediateOffset = length;
+    if (flags & IMMZ)
+        instruction.immediateSize += isOperandSize16 ? 2 : 4;
+    if (flags & MOFFS)
+        instruction.immediateSize += isAddressSize16 ? 2 : 4;
+    if (flags & IMM16)
+        instruction.immediateSize += 2;
+    if (flags & IMM8)
+        instruction.immediateSize += 1;
+    if (instruction.immediateSize == 0)
+        instruction.immediateOffset = 0;
+    length += instruction.immediateSize;
+
+    instruction.isRelative = flags & RELATIVE;
+    if (length > maxInstructionLength)
+        throw std::runtime_error("Instruction is too long.");
+    instruction.length = length;
+    return instruction;
+}
+
+size_t getInstructionLength(const uint8_t* code)
+{
+    return decode(code).length;
+}
+
+size_t getCoveringSize(const uint8_t* code, size_t size)
+{
+    size_t coveringSize = 0;
+    while (coveringSize < size)
+        coveringSize += getInstructionLength(code + coveringSize);
+    return coveringSize;
+}
+
+std::vector<uint8_t> relocate(const uint8_t* code, size_t size, const uint8_t* newAddress)
+{
+    std::vector<uint8_t> result;
+    result.reserve(getMaxRelocatedSize(size));
+
+    size_t offset = 0;
+    while (offset < size)
+    {
+        const uint8_t* instructionStart = code + offset;
+        Instruction instruction = decode(instructionStart);
+        if (offset + instruction.length > size)
+            throw std::runtime_error("Code to relocate does not end on an instruction boundary.");
+
+        if (!instruction.isRelative)
+        {
+            result.insert(result.end(), instructionStart, instructionStart + instruction.length);
+            offset += instruction.length;
+            continue;
+        }
+
+        if (instruction.immediateSize == 2)
+            throw std::runtime_error("Cannot relocate a 16-bit relative branch.");
+        const uint8_t* target = instructionStart + instruction.length + readSigned(instructionStart + instruction.immediateOffset, instruction.immediateSize);
+        if (target > code && target < code + size)
+            throw std::runtime_error("Cannot relocate a branch into the code being relocated.");
+
+        // Calls would push a return address inside the new code, which breaks callees that read it (such as
+        // get_pc_thunk in PIC code), so push the original one and jump instead. The callee then returns past
+        // the relocated code, so the call has to be the last instruction in it.
+        if (instructionStart[instruction.prefixesSize] == 0xe8)
+        {
+            if (offset + instruction.length != size)
+                throw std::runtime_error("Cannot relocate a call that is followed by other relocated instructions.");
+            result.push_back(0x68);
+            appendInt32(result, (int32_t)(uintptr_t)(instructionStart + instruction.length));
+            result.push_back(0xe9);
+            appendInt32(result, target - (newAddress + result.size() + 4));
+            offset += instruction.length;
+            continue;
+        }
+
+        // Keep the prefixes (branch hints, mostly) and widen short branches to rel32
+        result.insert(result.end(), instructionStart, instructionStart + instruction.prefixesSize);
+        const uint8_t* opcode = instructionStart + instruction.prefixesSize;
+        if (instruction.immediateSize == 4)
+            result.insert(result.end(), opcode, opcode + instruction.opcodeSize);
+        else if (*opcode == 0xeb)
+            result.push_back(0xe9);
+        else if (*opcode >= 0x70 && *opcode <= 0x7f)
+        {
+            result.push_back(0x0f);
+            result.push_back(0x80 | (*opcode & 0x0f));
+        }
+        else
+            throw std::runtime_error("Cannot relocate loop or jcxz instructions.");
+        appendInt32(result, target - (newAddress + result.size() + 4));
+
+        offset += instruction.length;
+    }
+
+    return result;
+}
+
+std::vector<uint8_t> makeJump(const uint8_t* from, const uint8_t* to)
+{
+    std::vector<uint8_t> jump;
+    jump.reserve(jumpSize);
+    jump.push_back(0xe9);
+    appendInt32(jump, to - (from + jumpSize));
+    return jump;
+}
+
+}
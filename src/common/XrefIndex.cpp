@@ -0,0 +1,128 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <algorithm>
+
+#include <cstring>
+
+#include "XrefIndex.h"
+
+namespace
+{
+    bool isInside(const std::vector<Memory::PageInfo>& segments, const uint8_t* address, size_t size, bool isCode)
+    {
+        for (const auto& segment : segments)
+            if (address >= segment.start && address + size <= segment.start + segment.size && (isCode ? segment.isExecutable : segment.isReadable))
+                return true;
+        return false;
+    }
+}
+
+void XrefIndex::build(const std::vector<Memory::PageInfo>& segments)
+{
+    callsBySite_.clear();
+    for (const auto& segment : segments)
+    {
+        if (!segment.isExecutable || !segment.isReadable)
+            continue;
+        const uint8_t* segmentEnd = segment.start + segment.size;
+
+        // memchr is vectorised, so let it skip over everything that can't be a call. Any "e8" or "ff 15" could
+        // just be part of another instruction though, so only keep the ones that point somewhere that makes sense.
+        for (const uint8_t* site = (const uint8_t*)std::memchr(segment.start, 0xe8, segment.size);
+             site != nullptr && segmentEnd - site >= 5;
+             site = (const uint8_t*)std::memchr(site + 1, 0xe8, segmentEnd - (site + 1)))
+        {
+            int32_t displacement;
+            std::memcpy(&displacement, site + 1, sizeof(displacement));
+            const uint8_t* target = site + 5 + displacement;
+            if (!isInside(segments, target, 1, true))
+                continue;
+            Call call;
+            call.site = (uint8_t*)site;
+            call.target = (uint8_t*)target;
+            call.isIndirect = false;
+            callsBySite_.push_back(call);
+        }
+        for (const uint8_t* site = (const uint8_t*)std::memchr(segment.start, 0xff, segment.size);
+             site != nullptr && segmentEnd - site >= 6;
+             site = (const uint8_t*)std::memchr(site + 1, 0xff, segmentEnd - (site + 1)))
+        {
+            if (site[1] != 0x15)
+                continue;
+            uint8_t* slot;
+            std::memcpy(&slot, site + 2, sizeof(slot));
+            if (!isInside(segments, slot, sizeof(uint8_t*), false))
+                continue;
+            Call call;
+            call.site = (uint8_t*)site;
+            call.target = slot;
+            call.isIndirect = true;
+            callsBySite_.push_back(call);
+        }
+    }
+
+    std::sort(callsBySite_.begin(), callsBySite_.end(), [](const Call& a, const Call& b) { return a.site < b.site; });
+    directCallsByTarget_.clear();
+    indirectCallsBySlot_.clear();
+    for (const auto& call : callsBySite_)
+        (call.isIndirect ? indirectCallsBySlot_ : directCallsByTarget_).push_back(call);
+    std::stable_sort(directCallsByTarget_.begin(), directCallsByTarget_.end(), [](const Call& a, const Call& b) { return a.target < b.target; });
+    std::stable_sort(indirectCallsBySlot_.begin(), indirectCallsBySlot_.end(), [](const Call& a, const Call& b) { return a.target < b.target; });
+}
+
+std::vector<XrefIndex::Call> XrefIndex::getCallers(const uint8_t* function) const
+{
+    std::vector<Call> results;
+    auto targetIsLess = [](const Call& call, const uint8_t* target) { return call.target < target; };
+    for (auto call = std::lower_bound(directCallsByTarget_.cbegin(), directCallsByTarget_.cend(), function, targetIsLess);
+         call != directCallsByTarget_.cend() && call->target == function; ++call)
+        results.push_back(*call);
+
+    // Slots can change as modules get loaded, so read them now. There are far fewer slots than calls.
+    for (auto call = indirectCallsBySlot_.cbegin(); call != indirectCallsBySlot_.cend(); )
+    {
+        bool isCaller = *(uint8_t**)call->target == function;
+        const uint8_t* slot = call->target;
+        for (; call != indirectCallsBySlot_.cend() && call->target == slot; ++call)
+            if (isCaller)
+                results.push_back(*call);
+    }
+
+    std::sort(results.begin(), results.end(), [](const Call& a, const Call& b) { return a.site < b.site; });
+    return results;
+}
+
+std::vector<XrefIndex::Call> XrefIndex::getCalls(const uint8_t* start, size_t size) const
+{
+    auto siteIsLess = [](const Call& call, const uint8_t* site) { return call.site < site; };
+    return std::vector<Call>(std::lower_bound(callsBySite_.cbegin(), callsBySite_.cend(), start, siteIsLess),
+                             std::lower_bound(callsBySite_.cbegin(), callsBySite_.cend(), start + size, siteIsLess));
+}
+
+const XrefIndex::Call* XrefIndex::getCallAt(const uint8_t* site) const
+{
+    auto call = std::lower_bound(callsBySite_.cbegin(), callsBySite_.cend(), site, [](const Call& call, const uint8_t* site) { return call.site < site; });
+    if (call == callsBySite_.cend() || call->site != site)
+        return nullptr;
+    return &*call;
+}
+
+size_t XrefIndex::getCallsCount() const
+{
+    return callsBySite_.size();
+}
@@ -0,0 +1,62 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef BYTEPATTERN_H
+#define BYTEPATTERN_H
+
+#include <string>
+#include <vector>
+#include <set>
+
+#include <stdint.h>
+
+#include "Misc.h"
+
+// Byte patterns that plain search bytes can't express, compiled to a small bytecode so the text only
+// has to be parsed where the patch pack is made. The text is made of:
+//     8b          A byte
+//     ??          Any byte
+//     4? ?5       A byte with one nibble set
+//     [80-8f c3]  A byte in a set of bytes and ranges, or [^..] for one not in it
+//     (e8|ff 15)  One of the alternatives, which can be different lengths
+//     {4} {3,12}  That many bytes of anything, or anywhere from the first to the second many
+// Whitespace between them is optional.
+class COMMON_EXPORT BytePattern final
+{
+    public:
+        BytePattern();
+        explicit BytePattern(const std::vector<uint8_t>& code); // Throws std::logic_error if the bytecode is invalid
+
+        static std::vector<uint8_t> compile(const std::string& pattern); // Throws std::logic_error saying what's wrong with it
+
+        bool isMatchAt(const uint8_t* address, const uint8_t* end, size_t& size) const; // `size' is set to the size of the first match, trying alternatives in order and gaps shortest first
+        std::set<uint8_t*> find(const uint8_t* start, size_t size) const; // Matches don't overlap. Has to be readable.
+        size_t getMinSize() const;
+        size_t getMaxSize() const;
+
+    private:
+        bool isMatchAt_(size_t pc, const uint8_t* address, const uint8_t* end, const uint8_t*& matchEnd) const;
+
+        std::vector<uint8_t> code_;
+        size_t minSize_;
+        size_t maxSize_;
+        std::vector<uint8_t> anchor_; // The longest run of exact bytes at a fixed offset from the start, to find candidates with memmem()
+        size_t anchorOffset_;
+};
+
+#endif
@@ -0,0 +1,85 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef ELFIMAGE_H
+#define ELFIMAGE_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <stdint.h>
+
+#include "Memory.h"
+#include "Misc.h"
+#include "FunctionIndex.h"
+#include "XrefIndex.h"
+#include "StringIndex.h"
+
+// An ELF file on disk laid out in memory the way the loader would, without running any of it, so
+// searches can be run against a module before it's ever loaded. RVAs are from getBase(), the same
+// as from Module::getBase() once it's loaded.
+class COMMON_EXPORT ElfImage final
+{
+    public:
+        ElfImage();
+        ElfImage(const ElfImage&) = delete;
+        ElfImage& operator=(const ElfImage&) = delete;
+        ~ElfImage();
+
+        void open(const std::string& pathfile);
+        void close() noexcept;
+        bool getIsOpen() const;
+
+        uint8_t* getBase() const;
+        size_t getSize() const;
+        bool getIsRelocated() const; // If absolute pointers inside the image point into the image
+        uint8_t* getSymbol(const std::string& symbol) const; // From the symbol table if it wasn't stripped, otherwise the dynamic one
+        std::string getBuildId() const; // The GNU build-id in hex, or "" if it doesn't have one
+        std::string getFingerprint() const; // The same as Module::getFingerprint() gives once it's loaded
+        const std::vector<Memory::PageInfo>& getSegments() const; // With the protection they'd be loaded with
+        const std::map<std::string, Memory::PageInfo>& getSections() const; // Loaded sections by name, the same as Module::getSections() gives
+        const FunctionIndex& getFunctionIndex() const;
+        const XrefIndex& getXrefIndex() const;
+        const StringIndex& getStringIndex() const;
+        size_t getFileOffset(size_t rva, size_t size) const; // Where bytes in the image came from in the file. Throws if they didn't all come from it.
+
+    private:
+        class FileRange_ final
+        {
+            public:
+                size_t rva;
+                size_t offset;
+                size_t size;
+        };
+
+        uint8_t* base_;
+        size_t size_;
+        bool isRelocated_;
+        std::string buildId_;
+        uint64_t fileHash_;
+        std::map<std::string, size_t> symbols_; // RVAs by name
+        std::vector<Memory::PageInfo> segments_;
+        std::map<std::string, Memory::PageInfo> sections_;
+        FunctionIndex functionIndex_;
+        XrefIndex xrefIndex_;
+        StringIndex stringIndex_;
+        std::vector<FileRange_> fileRanges_;
+};
+
+#endif
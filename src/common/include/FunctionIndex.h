@@ -0,0 +1,51 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef FUNCTIONINDEX_H
+#define FUNCTIONINDEX_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "Misc.h"
+
+// Where functions start and end, from the unwind info in .eh_frame. Compilers leave it in for
+// exceptions and backtraces even when the symbols are stripped, so it covers almost every function.
+class COMMON_EXPORT FunctionIndex final
+{
+    public:
+        class Function final
+        {
+            public:
+                uint8_t* start;
+                size_t size;
+        };
+
+        void addEhFrame(const uint8_t* ehFrame, const uint8_t* end); // .eh_frame where it's loaded, as its pointers can be relative to themselves
+        const Function* find(const uint8_t* address) const; // The function containing the address, or nullptr
+        const std::vector<Function>& getFunctions() const; // Sorted by start
+
+        static const uint8_t* findEhFrame(const uint8_t* ehFrameHeader); // From .eh_frame_hdr, which PT_GNU_EH_FRAME points to. Returns nullptr if it can't be read.
+
+    private:
+        std::vector<Function> functions_;
+};
+
+#endif
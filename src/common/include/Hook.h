@@ -21,6 +21,7 @@
 
 #include <string>
 #include <vector>
+#include <utility>
 #include <stdexcept>
 
 #include <stdint.h>
@@ -31,8 +32,31 @@
 namespace PatchData
 {
 
+// Bit flags for the registers a hook or hook patch uses. Hooks are only
+// built to save and pass the registers their hook patches need.
+namespace UsedRegisters
+{
+    enum : uint8_t
+    {
+        NONE = 0,
+        EAX = 1 << 0,
+        EBX = 1 << 1,
+        ECX = 1 << 2,
+        EDX = 1 << 3,
+        ESP = 1 << 4,
+        EBP = 1 << 5,
+        ESI = 1 << 6,
+        EDI = 1 << 7,
+        ALL = 0xff
+    };
+}
+
 class NameHook;
 class SearchHook;
+class FunctionHook;
+class ImportHook;
+class CallHook;
+class InstructionHook;
 class COMMON_EXPORT Hook final
 {
     public:
@@ -44,7 +68,7 @@ class COMMON_EXPORT Hook final
         std::vector<uint8_t> serialise() const;
         void deserialise(const std::vector<uint8_t>& data);
 
-        enum class Type { BLANK, NAME, SEARCH };
+        enum class Type { BLANK, NAME, SEARCH, FUNCTION, IMPORT, CALL, INSTRUCTION };
 
         void copyTypeFrom(const Hook& rvalue);
         template <class H>
@@ -52,13 +76,25 @@ class COMMON_EXPORT Hook final
         {
             static_assert(
                 SameType<H, NameHook>::result ||
-                SameType<H, SearchHook>::result,
+                SameType<H, SearchHook>::result ||
+                SameType<H, FunctionHook>::result ||
+                SameType<H, ImportHook>::result ||
+                SameType<H, CallHook>::result ||
+                SameType<H, InstructionHook>::result,
                 "Invalid type passed to Hook::setType().");
             clearType();
             if (SameType<H, NameHook>::result)
                 hookType = Type::NAME;
             else if (SameType<H, SearchHook>::result)
                 hookType = Type::SEARCH;
+            else if (SameType<H, FunctionHook>::result)
+                hookType = Type::FUNCTION;
+            else if (SameType<H, ImportHook>::result)
+                hookType = Type::IMPORT;
+            else if (SameType<H, CallHook>::result)
+                hookType = Type::CALL;
+            else if (SameType<H, InstructionHook>::result)
+                hookType = Type::INSTRUCTION;
             return *(H*)(hookData = new H(h));
         }
         template <class H>
@@ -66,12 +102,20 @@ class COMMON_EXPORT Hook final
         {
             static_assert(
                 SameType<H, NameHook>::result ||
-                SameType<H, SearchHook>::result,
+                SameType<H, SearchHook>::result ||
+                SameType<H, FunctionHook>::result ||
+                SameType<H, ImportHook>::result ||
+                SameType<H, CallHook>::result ||
+                SameType<H, InstructionHook>::result,
                 "Invalid type passed to Hook::getTypeData().");
             if (hookType == Type::BLANK)
                 throw std::logic_error("No type set.");
             if ((SameType<H, NameHook>::result && hookType == Type::NAME) ||
-                (SameType<H, SearchHook>::result && hookType == Type::SEARCH))
+                (SameType<H, SearchHook>::result && hookType == Type::SEARCH) ||
+                (SameType<H, FunctionHook>::result && hookType == Type::FUNCTION) ||
+                (SameType<H, ImportHook>::result && hookType == Type::IMPORT) ||
+                (SameType<H, CallHook>::result && hookType == Type::CALL) ||
+                (SameType<H, InstructionHook>::result && hookType == Type::INSTRUCTION))
                 return *(H*)hookData;
             throw std::logic_error("Incorrect type passed to Hook::getTypeData().");
         }
@@ -90,6 +134,8 @@ class COMMON_EXPORT Hook final
         std::vector<uint8_t> prologueInstructionsBytes; // These two must not have any instructions that modifies esp, because it will change the return address!
         std::vector<uint8_t> epilogueInstructionsBytes; // As will writing to what esp points to with a negative offset. Reading is fine though.
         std::vector<std::string> headerIncludes;
+        uint8_t usedRegisters; // Registers read or written by the prologue and epilogue functions
+        bool isJumpHook; // Jump to the wrapper and relocate the instructions the jump overwrites, instead of calling it. Only a `hookRva' is needed.
 
     private:
         Type hookType;
@@ -114,6 +160,73 @@ class COMMON_EXPORT SearchHook final : public Search
         void checkValid(const Hook& parent) const;
 };
 
+// The signature of a hooked function. Hooks with one get a detour with the same signature
+// instead of the register saving wrapper, and their hook patches get the arguments typed.
+// Only `name' and `headerIncludes' of the parent hook are used, and its `hookRva' must be 0.
+class COMMON_EXPORT FunctionSignature
+{
+    public:
+        FunctionSignature();
+        virtual ~FunctionSignature() = default;
+
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        void checkValid(const Hook& parent) const;
+
+        enum class CallingConvention { CDECL, STDCALL, THISCALL };
+
+        CallingConvention callingConvention;
+        std::string returnType;
+        std::vector<std::pair<std::string, std::string>> parameters; // Name and type
+};
+
+// Hooks the entry of a function by jumping to its detour. The instructions the jump overwrites
+// are relocated to a trampoline so the original function can still be called.
+class COMMON_EXPORT FunctionHook final : public NameSearch, public FunctionSignature
+{
+    public:
+        FunctionHook();
+
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        void checkValid(const Hook& parent) const;
+
+        size_t prologueSize; // 0 to use the whole instructions covering the jump. Otherwise must end on an instruction boundary.
+};
+
+// Hooks calls to an imported function by pointing the importing modules' GOT/PLT slots at its
+// detour. The function's code isn't touched, and calling through the slot costs nothing extra.
+class COMMON_EXPORT ImportHook final : public ImportSearch, public FunctionSignature
+{
+    public:
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        void checkValid(const Hook& parent) const;
+};
+
+class COMMON_EXPORT InstructionHook final : public InstructionSearch
+{
+    public:
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        void checkValid(const Hook& parent) const;
+};
+
+// Hooks one of the calls a function makes to another. It has to be a jump hook, so the call is
+// relocated to the trampoline and still made after the hook function.
+class COMMON_EXPORT CallHook final : public CallSearch
+{
+    public:
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        void checkValid(const Hook& parent) const;
+};
+
 }
 
 #endif
@@ -0,0 +1,100 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef INSTRUCTIONPATTERN_H
+#define INSTRUCTIONPATTERN_H
+
+#include <string>
+#include <vector>
+#include <set>
+
+#include <stdint.h>
+
+#include "Misc.h"
+
+namespace X86
+{
+    class Instruction;
+}
+
+// Instruction templates separated by ';', like "mov r32, [r32+0x1c]; call rel32; test eax, eax",
+// matched by decoding the code instead of comparing bytes, so they still match after the compiler
+// picks different registers or offsets. Each template is a mnemonic, or * for any instruction, and
+// its operands, which can be:
+//     eax, cx, al          A register
+//     r32, r16, r8         Any register of that size
+//     [ebx+esi*4+0x1c]     Memory. Registers can be r32, the displacement imm, and [*] is any memory.
+//     byte/word/dword [..] Memory of that size
+//     0x1c, -4             An immediate
+//     imm, imm8, imm32     Any immediate, or any of that encoded size
+//     rel, rel8, rel32     Any branch target, or any of that encoded size
+//     *                    Any operand
+// Only the common integer instructions without prefixes are known.
+class COMMON_EXPORT InstructionPattern final
+{
+    public:
+        InstructionPattern() = default;
+        explicit InstructionPattern(const std::string& pattern); // Throws std::logic_error saying what's wrong with it
+
+        bool isMatchAt(const uint8_t* code, const uint8_t* end, size_t& size) const; // `size' is set to the size of the matching instructions
+        std::set<uint8_t*> find(const uint8_t* start, size_t size) const; // Matches don't overlap. Has to be readable.
+        size_t getMinSize() const; // Of the instructions any match could be, at the least
+        size_t getMaxSize() const; // Of the instructions any match could be
+
+    private:
+        enum class OperandType_ : uint8_t
+        {
+            ANY,
+            REGISTER,
+            MEMORY,
+            IMMEDIATE,
+            RELATIVE
+        };
+
+        class Operand_ final
+        {
+            public:
+                OperandType_ type;
+                size_t size; // 0 for any. Immediates and branch targets are the size they're encoded as.
+                int reg; // -1 for any
+                bool isAnyMemory;
+                size_t registersCount;
+                int registers[2]; // -1 for any
+                size_t scales[2];
+                bool isAnyValue; // The displacement of memory or the value of an immediate
+                int32_t value;
+        };
+
+        class Template_ final
+        {
+            public:
+                std::string mnemonic; // "" for any instruction
+                std::vector<Operand_> operands;
+                std::vector<size_t> forms; // The instruction forms it could be
+        };
+
+        static Operand_ parseOperand_(const std::string& operand);
+        static bool isOperandPossible_(const Operand_& templateOperand, uint8_t formOperand); // If an instruction form could have it at all
+        static Operand_ decodeOperand_(const uint8_t* code, const X86::Instruction& instruction, uint8_t formOperand);
+        static bool isOperandMatch_(const Operand_& templateOperand, const Operand_& operand);
+
+        std::vector<Template_> templates_;
+        std::vector<bool> isFirstByte_; // Where a match could start, so most places are ruled out without decoding them
+};
+
+#endif
@@ -45,7 +45,10 @@ namespace Memory
     std::vector<PageInfo> queryPage(const uint8_t* start, size_t size);
     std::vector<PageInfo> changePageProtection(PageInfo page);
 
+    uint8_t* allocatePages(size_t size, bool isExecutable, const uint8_t* hint = nullptr); // Read-only, write them with safeCopy()
+
     void safeCopy(const std::vector<uint8_t> from, uint8_t* to);
+    void safeStorePointer(uint8_t** to, uint8_t* value); // Atomic, and only adds write access
 }
 
 #endif
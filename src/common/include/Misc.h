@@ -210,9 +210,20 @@ COMMON_EXPORT std::string strError(int error);
 // Get inode and device id of a file. Returns false if file doesn't exist, otherwise true
 COMMON_EXPORT bool getInodeAndDeviceId(const std::string& pathfile, uint64_t& inode, uint64_t& deviceId) noexcept;
 
+// Read or write a whole file as bytes
+COMMON_EXPORT std::vector<uint8_t> readFile(const std::string& pathfile);
+COMMON_EXPORT void writeFile(const std::string& pathfile, const std::vector<uint8_t>& data);
+
 // Calculate the CRC-32 checksum of an array of bytes.
 // Warning: Don't compare the checksum generated with a checksum generated by another
 // CRC-32 algorithm because they aren't compatible!
 COMMON_EXPORT uint32_t calculateCrc32Checksum(const std::vector<uint8_t>& data) noexcept;
 
+// Calculate the 64-bit FNV-1a hash of an array of bytes. Pass the previous result as `hash' to continue a hash over several arrays.
+COMMON_EXPORT uint64_t calculateFnv1aHash(const uint8_t* data, size_t size, uint64_t hash = 14695981039346656037ULL) noexcept;
+
+// Shell-style wildcard matching, where `*' matches any run of characters and `?' any one character
+COMMON_EXPORT bool isWildcardPattern(const std::string& pattern) noexcept;
+COMMON_EXPORT bool isWildcardMatch(const std::string& pattern, const std::string& string) noexcept;
+
 #endif
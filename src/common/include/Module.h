@@ -21,15 +21,27 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <memory>
 
 #include <stdint.h>
 
 #include "Memory.h"
 #include "Misc.h"
+#include "FunctionIndex.h"
+#include "XrefIndex.h"
+#include "StringIndex.h"
 
 class COMMON_EXPORT Module final
 {
     public:
+        class Vtable final
+        {
+            public:
+                uint8_t** addressPoint; // Where slot 0 is
+                size_t slotsCount; // Of the primary vtable, up to the first entry that doesn't point at code
+        };
+
         Module();
         Module(const Module&) = delete;
         Module(Module&& rvalue);
@@ -48,15 +60,32 @@ class COMMON_EXPORT Module final
         void updateInfo();
 
         uint8_t* getSymbol(const std::string& symbol) const;
+        uint8_t* getFunction(const std::string& name) const; // Like getSymbol(), but also finds static and hidden functions from the file's .symtab
+        std::vector<uint8_t**> getImportSlots(const std::string& symbol) const; // GOT/PLT entries the module calls or reads `symbol' through
         void* getHandle() const;
+        uint8_t* getBase() const;
+        std::string getBuildId() const; // The GNU build-id in hex, or "" if it doesn't have one
+        std::string getFingerprint() const; // The build-id, or else a hash of the file. Cached per module.
+        std::map<std::string, Memory::PageInfo> getSections() const; // Loaded sections by name, from the file's section headers. Cached per module.
+        std::shared_ptr<const FunctionIndex> getFunctionIndex() const; // Cached per module
+        std::shared_ptr<const XrefIndex> getXrefIndex() const; // Of the original code. Cached per module.
+        std::shared_ptr<const StringIndex> getStringIndex() const; // Cached per module
+        uint8_t* getGlobalOffsetTable() const; // What position-independent code addresses data from, or nullptr if it has none
+        std::string getFunctionOffset(const uint8_t* address) const; // Like "name+0x1f", or "sub_1a30+0x1f" from the module base if it has no symbol. "" if not in a function.
+        std::map<std::string, Vtable> getVtables() const; // By demangled class name. Cached per module.
+        Vtable getVtable(const std::string& className) const;
         std::string getFile() const;
         std::string getPath() const;
         const std::vector<Memory::PageInfo>& getSegments() const;
         const std::vector<Memory::PageInfo>& getOriginalSegments() const;
 
+        static std::vector<std::string> enumerateModules(); // Pathfiles of every loaded module. The main executable is "".
+
     private:
         static bool isPathfileMatch_(const std::string& a, const std::string& b);
 
+        void dropCachesIfUnloaded_() noexcept;
+
         void* handle;
         uint8_t* base;
         std::string file;
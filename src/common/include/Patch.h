@@ -30,6 +30,7 @@
 
 #include "Misc.h"
 #include "Search.h"
+#include "Hook.h"
 #include "Info.h"
 
 namespace PatchData
@@ -38,6 +39,11 @@ namespace PatchData
 class HookPatch;
 class ReplaceNamePatch;
 class ReplaceSearchPatch;
+class ImportPatch;
+class VtableSlotPatch;
+class CavePatch;
+class ReplaceCallPatch;
+class ReplaceInstructionsPatch;
 class COMMON_EXPORT Patch
 {
     public:
@@ -49,7 +55,7 @@ class COMMON_EXPORT Patch
         std::vector<uint8_t> serialise() const;
         void deserialise(const std::vector<uint8_t>& data);
 
-        enum class Type { BLANK, HOOK, REPLACE_NAME, REPLACE_SEARCH };
+        enum class Type { BLANK, HOOK, REPLACE_NAME, REPLACE_SEARCH, IMPORT, VTABLE_SLOT, CAVE, REPLACE_CALL, REPLACE_INSTRUCTIONS };
 
         void copyTypeFrom(const Patch& rvalue);
         template <class P>
@@ -58,7 +64,12 @@ class COMMON_EXPORT Patch
             static_assert(
                 SameType<P, HookPatch>::result ||
                 SameType<P, ReplaceNamePatch>::result ||
-                SameType<P, ReplaceSearchPatch>::result,
+                SameType<P, ReplaceSearchPatch>::result ||
+                SameType<P, ImportPatch>::result ||
+                SameType<P, VtableSlotPatch>::result ||
+                SameType<P, CavePatch>::result ||
+                SameType<P, ReplaceCallPatch>::result ||
+                SameType<P, ReplaceInstructionsPatch>::result,
                 "Invalid type passed to Patch::setType().");
             clearType();
             if (SameType<P, HookPatch>::result)
@@ -67,6 +78,16 @@ class COMMON_EXPORT Patch
                 patchType = Type::REPLACE_NAME;
             else if (SameType<P, ReplaceSearchPatch>::result)
                 patchType = Type::REPLACE_SEARCH;
+            else if (SameType<P, ImportPatch>::result)
+                patchType = Type::IMPORT;
+            else if (SameType<P, VtableSlotPatch>::result)
+                patchType = Type::VTABLE_SLOT;
+            else if (SameType<P, CavePatch>::result)
+                patchType = Type::CAVE;
+            else if (SameType<P, ReplaceCallPatch>::result)
+                patchType = Type::REPLACE_CALL;
+            else if (SameType<P, ReplaceInstructionsPatch>::result)
+                patchType = Type::REPLACE_INSTRUCTIONS;
             return *(P*)(patchData = new P(p));
         }
         template <class P>
@@ -75,13 +96,23 @@ class COMMON_EXPORT Patch
             static_assert(
                 SameType<P, HookPatch>::result ||
                 SameType<P, ReplaceNamePatch>::result ||
-                SameType<P, ReplaceSearchPatch>::result,
+                SameType<P, ReplaceSearchPatch>::result ||
+                SameType<P, ImportPatch>::result ||
+                SameType<P, VtableSlotPatch>::result ||
+                SameType<P, CavePatch>::result ||
+                SameType<P, ReplaceCallPatch>::result ||
+                SameType<P, ReplaceInstructionsPatch>::result,
                 "Invalid type passed to Patch::getTypeData().");
             if (patchType == Type::BLANK)
                 throw std::logic_error("No type set.");
             if ((SameType<P, HookPatch>::result && patchType == Type::HOOK) ||
                 (SameType<P, ReplaceNamePatch>::result && patchType == Type::REPLACE_NAME) ||
-                (SameType<P, ReplaceSearchPatch>::result && patchType == Type::REPLACE_SEARCH))
+                (SameType<P, ReplaceSearchPatch>::result && patchType == Type::REPLACE_SEARCH) ||
+                (SameType<P, ImportPatch>::result && patchType == Type::IMPORT) ||
+                (SameType<P, VtableSlotPatch>::result && patchType == Type::VTABLE_SLOT) ||
+                (SameType<P, CavePatch>::result && patchType == Type::CAVE) ||
+                (SameType<P, ReplaceCallPatch>::result && patchType == Type::REPLACE_CALL) ||
+                (SameType<P, ReplaceInstructionsPatch>::result && patchType == Type::REPLACE_INSTRUCTIONS))
                 return *(P*)patchData;
             throw std::logic_error("Incorrect type passed to Patch::getTypeData().");
         }
@@ -98,6 +129,8 @@ class COMMON_EXPORT Patch
 class COMMON_EXPORT HookPatch final
 {
     public:
+        HookPatch();
+
         std::vector<uint8_t> serialise() const;
         void deserialise(const std::vector<uint8_t>& data);
 
@@ -105,6 +138,7 @@ class COMMON_EXPORT HookPatch final
 
         std::string hookName;
         std::string functionBody;
+        uint8_t usedRegisters; // Registers read by the function body
 };
 
 class COMMON_EXPORT ReplaceNamePatch final : public NameSearch
@@ -131,9 +165,89 @@ class COMMON_EXPORT ReplaceSearchPatch final : public Search
         std::set<size_t> ignoredReplaceBytesRvas;
 };
 
+// Redirects the GOT/PLT slots an import is called through to another exported symbol,
+// with a single pointer store per slot. The target's own module is never redirected.
+class COMMON_EXPORT ImportPatch final : public ImportSearch
+{
+    public:
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        void checkValid(const Patch& parent) const;
+
+        virtual std::set<uint8_t*> doSearch() const override;
+        uint8_t* getTarget() const;
+
+        std::string targetModuleName;
+        std::string targetSymbol;
+};
+
+// Points a virtual function slot of a class at another exported symbol, with a single pointer store.
+// Only objects of exactly this class are affected, as subclasses have vtables of their own.
+class COMMON_EXPORT VtableSlotPatch final : public VtableSearch
+{
+    public:
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        void checkValid(const Patch& parent) const;
+
+        uint8_t* getTarget() const;
+
+        std::string targetModuleName;
+        std::string targetSymbol;
+};
+
+// Replaces the instructions at `caveRva' with a jump to a code cave holding `caveBytes', which
+// ends with a jump back to after them. No hook function or compiler is involved.
+class COMMON_EXPORT CavePatch final : public Search
+{
+    public:
+        CavePatch();
+
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        void checkValid(const Patch& parent) const;
+
+        size_t caveRva; // Where in the search bytes the jump to the cave goes
+        std::vector<uint8_t> caveBytes; // Has to be position independent
+        bool isOriginalCodeKept; // Run the overwritten instructions after the cave bytes
+};
+
+// Overwrites the calls a function makes to another. The replace bytes start at each call instruction,
+// so they can be no bigger than a relative call, the shortest call that's found.
+class COMMON_EXPORT ReplaceCallPatch final : public CallSearch
+{
+    public:
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        void checkValid(const Patch& parent) const;
+
+        std::vector<uint8_t> replaceBytes;
+        std::set<size_t> ignoredReplaceBytesRvas;
+};
+
+// Like a replace search patch, but found by its instructions. The replace bytes can be no bigger than the shortest
+// the instructions could be.
+class COMMON_EXPORT ReplaceInstructionsPatch final : public InstructionSearch
+{
+    public:
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        void checkValid(const Patch& parent) const;
+
+        std::vector<uint8_t> replaceBytes;
+        std::set<size_t> ignoredReplaceBytesRvas;
+};
+
 class COMMON_EXPORT PatchPack final
 {
     public:
+        PatchPack();
+
         std::vector<uint8_t> serialise() const;
         void deserialise(const std::vector<uint8_t>& data);
 
@@ -143,6 +257,38 @@ class COMMON_EXPORT PatchPack final
         // These two are for use by hook patches only
         std::vector<std::string> headerIncludes;
         std::map<std::string, std::string> sharedVariables; // Name; Type
+        bool isToggleable; // Keep the patches in place when disabled, so re-enabling is a byte swap instead of a search
+};
+
+class COMMON_EXPORT BakedPatch final
+{
+    public:
+        BakedPatch();
+
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        size_t rva;
+        std::vector<uint8_t> originalBytes;
+        std::vector<uint8_t> patchedBytes;
+};
+
+// What baking a patch pack in to a copy of a module's file changed, so cores can tell if they're running the copy
+class COMMON_EXPORT BakeManifest final
+{
+    public:
+        BakeManifest();
+
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        static uint64_t getPatchesHash(const PatchPack& patchPack); // Changes whenever the patch pack's patches are edited
+
+        std::string patchPackName;
+        uint64_t patchesHash; // Of the patch pack when it was baked
+        std::string moduleName;
+        std::string moduleFingerprint; // Of the baked copy
+        std::vector<BakedPatch> bakedPatches;
 };
 
 }
@@ -0,0 +1,78 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef RESOLUTIONCACHE_H
+#define RESOLUTIONCACHE_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "Misc.h"
+
+// A file of where searches were found in modules, keyed by module fingerprint and search hash,
+// that's memory mapped and shared by every core. Entries are only hints: they can be overwritten or
+// torn by another core at any time, so whatever's found has to be checked against the search.
+class COMMON_EXPORT ResolutionCache final
+{
+    public:
+        ResolutionCache();
+        ResolutionCache(const ResolutionCache&) = delete;
+        ResolutionCache& operator=(const ResolutionCache&) = delete;
+        ~ResolutionCache();
+
+        void open(const std::string& pathfile); // Created or reset if it isn't a valid cache file
+        void close() noexcept;
+        bool getIsOpen() const;
+        void clear();
+
+        bool find(uint64_t moduleFingerprint, uint64_t searchHash, std::vector<size_t>& rvas) const;
+        void store(uint64_t moduleFingerprint, uint64_t searchHash, const std::vector<size_t>& rvas); // Too many RVAs are not stored
+
+        static const size_t maxRvas = 10;
+
+    private:
+        static const size_t entriesCount_ = 4096;
+        static const size_t maxProbes_ = 16;
+        static const uint32_t version_ = 1;
+
+        class Header_ final
+        {
+            public:
+                char magic[8];
+                uint32_t version;
+                uint32_t entriesCount;
+        };
+        class Entry_ final // 64 bytes
+        {
+            public:
+                uint64_t moduleFingerprint;
+                uint64_t searchHash;
+                uint32_t isValid; // Cleared while the entry is being written
+                uint32_t rvasCount;
+                uint32_t rvas[maxRvas];
+        };
+
+        Entry_* getEntries_() const;
+
+        uint8_t* data_;
+        size_t size_;
+};
+
+#endif
@@ -22,11 +22,19 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
+#include <memory>
 #include <stdexcept>
 
 #include <stdint.h>
 
 #include "Misc.h"
+#include "Memory.h"
+
+class Module;
+class ElfImage;
+class XrefIndex;
+class StringIndex;
 
 namespace PatchData
 {
@@ -37,22 +45,60 @@ class SpecialSearch;
 class COMMON_EXPORT Search
 {
     public:
+        Search();
         virtual ~Search(){}
 
         std::vector<uint8_t> serialise() const;
         void deserialise(const std::vector<uint8_t>& data);
 
+        enum class SearchType : uint8_t { SEARCH, NAME, INSTRUCTION };
+        virtual SearchType getSearchType() const; // Which kind it is, as anchor searches are kept by pointer
+
         virtual void checkValid(const size_t minSearchBytes) const;
 
         virtual std::set<uint8_t*> doSearch() const;
+        virtual std::set<size_t> doImageSearch(const ElfImage& image) const; // Results are RVAs into the image
+        std::set<uint8_t*> doFunctionSearch(const uint8_t* address) const; // Only inside the function containing the address, like another search's result
+        virtual bool isMatchAt(const uint8_t* address) const; // Checks an address found before, like from a cache. Has to be readable.
+        virtual uint64_t getHash() const; // Identifies what's searched for, not where it's found
+        virtual size_t getMinSize() const; // Of what it matches, which is just the search bytes unless there's a pattern
 
         std::string moduleName;
         std::vector<uint8_t> searchBytes;
         std::set<size_t> ignoredSearchBytesRvas;
         std::vector<SpecialSearch> specialSearches; // Special searches take priority over ignored search bytes
+        std::vector<uint8_t> pattern; // From BytePattern::compile(). Searched for instead of the search bytes, which have to be empty along with the ignored ones and special searches.
+        std::map<std::string, size_t> rvaHints; // Where it's known to be from the module base, by build-id. Checked before searching, if only one result is kept.
+
+        // Where in the module to search, each narrowing the others down. Left empty, every segment is searched.
+        std::set<std::string> sectionNames; // Like ".text" or ".rodata"
+        std::vector<std::pair<size_t, size_t>> rvaRanges; // Start and size from the module base
+        bool isExecutableOnly; // Code patterns should set this, so data is never touched
+        bool isWritableOnly;
+        std::string containingFunctionName; // The symbol of the function to search in, which doesn't have to be exported. Its size comes from .eh_frame.
+
+        // Only searches the windows around where another search in the same module is found, which is found first
+        std::vector<std::shared_ptr<const Search>> anchorSearches; // Empty, or the one search or instruction search to anchor to
+        int32_t anchorWindowOffset; // From each of the anchor's results to its window, so it can be before it
+        size_t anchorWindowSize; // Results have to be wholly inside a window
+
+        // Which results are kept, in address order. Results found from an RVA hint are always kept.
+        size_t resultIndex; // Only keeps the one at this index, or all of them if it's (size_t)-1
+        bool isUniqueResultRequired; // Nothing's found if there's more than one
 
     protected:
         virtual std::set<uint8_t*> doSearch_(const uint8_t* start, size_t size) const final;
+        bool doHintedSearch_(const Module& module, const std::vector<Memory::PageInfo>& ranges, std::set<uint8_t*>& results) const;
+        virtual std::set<uint8_t*> doRangeSearch_(const Memory::PageInfo& range, const XrefIndex* xrefIndex, const StringIndex* stringIndex) const; // Uses the indexes given for call and string reference special searches, scanning if the calls aren't indexed
+        bool getCallCandidates_(const XrefIndex& xrefIndex, const uint8_t* start, size_t size, std::set<uint8_t*>& candidates) const;
+        bool getStringReferenceCandidates_(const StringIndex& stringIndex, const uint8_t* start, size_t size, std::set<uint8_t*>& candidates) const;
+        bool hasCallSpecialSearch_() const;
+        bool hasStringReferenceSpecialSearch_() const;
+        std::vector<Memory::PageInfo> getScopedRanges_(const uint8_t* base, const std::vector<Memory::PageInfo>& segments,
+                                                       const std::map<std::string, Memory::PageInfo>& sections) const;
+        static std::vector<Memory::PageInfo> clipRanges_(const std::vector<Memory::PageInfo>& ranges, const uint8_t* start, size_t size);
+        std::vector<Memory::PageInfo> getAnchoredRanges_(const std::vector<Memory::PageInfo>& ranges, const std::set<uint8_t*>& anchorResults) const;
+        std::set<uint8_t*> selectResults_(const std::set<uint8_t*>& results) const;
 };
 
 class COMMON_EXPORT NameSearch : public Search
@@ -67,9 +113,97 @@ class COMMON_EXPORT NameSearch : public Search
         void checkOverlapWith(const NameSearch& rvalue) const;
 
         virtual std::set<uint8_t*> doSearch() const override;
+        virtual std::set<size_t> doImageSearch(const ElfImage& image) const override;
+        virtual uint64_t getHash() const override;
+        virtual SearchType getSearchType() const override;
 
         std::string functionName;
-        size_t functionRva;
+        size_t functionRva; // The search scope isn't used, as it's only looked for here
+};
+
+// Finds instructions by what they do rather than their bytes, so it keeps working when a rebuild picks
+// different registers or offsets. `instructions' is an InstructionPattern, and replaces the search bytes,
+// ignored bytes, special searches and byte pattern, which have to be left empty. Results are the first instructions.
+class COMMON_EXPORT InstructionSearch : public Search
+{
+    public:
+        InstructionSearch();
+        virtual ~InstructionSearch() = default;
+
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        virtual void checkValid(const size_t minSearchBytes) const override; // `minSearchBytes' is checked against the shortest the instructions could be
+        virtual bool isMatchAt(const uint8_t* address) const override;
+        virtual uint64_t getHash() const override;
+        virtual size_t getMinSize() const override;
+        virtual SearchType getSearchType() const override;
+
+        std::string instructions; // Like "mov r32, [r32+0x1c]; call rel32; test eax, eax"
+
+    protected:
+        virtual std::set<uint8_t*> doRangeSearch_(const Memory::PageInfo& range, const XrefIndex* xrefIndex, const StringIndex* stringIndex) const override;
+};
+
+// Finds the GOT/PLT slots modules import a symbol through. `moduleName' can have shell-style
+// wildcards, so "*" finds the slots of every loaded module that imports `importName'.
+class COMMON_EXPORT ImportSearch
+{
+    public:
+        virtual ~ImportSearch() = default;
+
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        virtual void checkValid() const;
+        void checkOverlapWith(const ImportSearch& rvalue) const;
+
+        virtual std::set<uint8_t*> doSearch() const; // Results are the addresses of the slots
+
+        std::string moduleName;
+        std::string importName;
+};
+
+class COMMON_EXPORT VtableSearch
+{
+    public:
+        VtableSearch();
+        virtual ~VtableSearch() = default;
+
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        virtual void checkValid() const;
+        void checkOverlapWith(const VtableSearch& rvalue) const;
+
+        std::set<uint8_t*> doSearch() const; // The result is the address of the slot
+
+        std::string moduleName;
+        std::string className; // Demangled, like "ns::Foo"
+        size_t slotIndex; // From the address point, so virtual destructors usually take slots 0 and 1
+};
+
+// Finds the calls a function makes to another, by the order they're made in. The callee is matched by
+// what each call ends up at, so calls through import slots count but calls to PLT stubs don't. Calls are
+// looked up in the module's xref index, so calls patches write afterwards aren't found.
+class COMMON_EXPORT CallSearch
+{
+    public:
+        CallSearch();
+        virtual ~CallSearch() = default;
+
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        virtual void checkValid() const;
+
+        std::set<uint8_t*> doSearch() const; // Results are the call instructions
+
+        std::string moduleName; // Where the calls are made from
+        std::string callerName; // The function they're made in, which doesn't have to be exported but needs unwind info to give its size
+        std::string calleeModuleName;
+        std::string calleeName;
+        size_t callIndex; // Which call, counting from 0 in address order. (size_t)-1 for all of them.
 };
 
 // Long class names ftw :D
@@ -78,6 +212,7 @@ class UnnamedRelativeFunctionCallSpecialSearch;
 class NamedAbsoluteIndirectFunctionCallSpecialSearch;
 class UnnamedAbsoluteIndirectFunctionCallSpecialSearch;
 class DataPointerSpecialSearch;
+class StringReferenceSpecialSearch;
 class COMMON_EXPORT SpecialSearch final
 {
     public:
@@ -96,7 +231,8 @@ class COMMON_EXPORT SpecialSearch final
             UNNAMED_RELATIVE_FUNCTION_CALL,
             NAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL,
             UNNAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL,
-            DATA_POINTER
+            DATA_POINTER,
+            STRING_REFERENCE
         };
 
         void copyTypeFrom(const SpecialSearch& rvalue);
@@ -108,7 +244,8 @@ class COMMON_EXPORT SpecialSearch final
                 SameType<S, UnnamedRelativeFunctionCallSpecialSearch>::result ||
                 SameType<S, NamedAbsoluteIndirectFunctionCallSpecialSearch>::result ||
                 SameType<S, UnnamedAbsoluteIndirectFunctionCallSpecialSearch>::result ||
-                SameType<S, DataPointerSpecialSearch>::result,
+                SameType<S, DataPointerSpecialSearch>::result ||
+                SameType<S, StringReferenceSpecialSearch>::result,
                 "Invalid type passed to SpecialSearch::setType().");
             clearType();
             if (SameType<S, NamedRelativeFunctionCallSpecialSearch>::result)
@@ -121,6 +258,8 @@ class COMMON_EXPORT SpecialSearch final
                 specialSearchType = Type::UNNAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL;
             else if (SameType<S, DataPointerSpecialSearch>::result)
                 specialSearchType = Type::DATA_POINTER;
+            else if (SameType<S, StringReferenceSpecialSearch>::result)
+                specialSearchType = Type::STRING_REFERENCE;
             return *(S*)(specialSearchData = new S(s));
         }
         template <class S>
@@ -131,7 +270,8 @@ class COMMON_EXPORT SpecialSearch final
                 SameType<S, UnnamedRelativeFunctionCallSpecialSearch>::result ||
                 SameType<S, NamedAbsoluteIndirectFunctionCallSpecialSearch>::result ||
                 SameType<S, UnnamedAbsoluteIndirectFunctionCallSpecialSearch>::result ||
-                SameType<S, DataPointerSpecialSearch>::result,
+                SameType<S, DataPointerSpecialSearch>::result ||
+                SameType<S, StringReferenceSpecialSearch>::result,
                 "Invalid type passed to SpecialSearch::getTypeData().");
             if (specialSearchType == Type::BLANK)
                 throw std::logic_error("No type set.");
@@ -139,7 +279,8 @@ class COMMON_EXPORT SpecialSearch final
                 (SameType<S, UnnamedRelativeFunctionCallSpecialSearch>::result && specialSearchType == Type::UNNAMED_RELATIVE_FUNCTION_CALL) ||
                 (SameType<S, NamedAbsoluteIndirectFunctionCallSpecialSearch>::result && specialSearchType == Type::NAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL) ||
                 (SameType<S, UnnamedAbsoluteIndirectFunctionCallSpecialSearch>::result && specialSearchType == Type::UNNAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL) ||
-                (SameType<S, DataPointerSpecialSearch>::result && specialSearchType == Type::DATA_POINTER))
+                (SameType<S, DataPointerSpecialSearch>::result && specialSearchType == Type::DATA_POINTER) ||
+                (SameType<S, StringReferenceSpecialSearch>::result && specialSearchType == Type::STRING_REFERENCE))
                 return *(S*)specialSearchData;
             throw std::logic_error("Incorrect type passed to SpecialSearch::getTypeData().");
         }
@@ -212,6 +353,23 @@ class MANAGER_EXPORT DataPointerSpecialSearch final : public Search
         bool doSearch(const uint8_t* address) const; // moduleName member is ignored
 };
 
+// Matches 4 bytes that address a string literal, either absolutely or from the GOT like position-independent code does
+class MANAGER_EXPORT StringReferenceSpecialSearch final
+{
+    public:
+        StringReferenceSpecialSearch();
+
+        std::vector<uint8_t> serialise() const;
+        void deserialise(const std::vector<uint8_t>& data);
+
+        void checkValid(const SpecialSearch& parent, const Search& parentParent) const;
+        bool doSearch(const uint8_t* address) const;
+
+        std::string string; // Without the terminator, which has to be there
+        bool isGotRelative; // If the 4 bytes are from the GOT of `moduleName', like in position-independent code, instead of an address
+        std::string moduleName;
+};
+
 }
 
 #endif
@@ -52,9 +52,11 @@ namespace Socket
         PATCH_PACK, PATCH_PACK_REMOVE,
         PATCH_HOOK, PATCH_HOOK_REMOVE,
         PATCH_LIB_LOAD, PATCH_LIB_UNLOAD,
+        RESOLUTION_CACHE, RESOLUTION,
+        BAKE_MANIFEST, SHARED_PAGES, HUGE_PAGES,
         CUSTOM
     };
-    enum class ClientOpCode { CONNECT, DISCONNECT, READY, LOG, CUSTOM };
+    enum class ClientOpCode { CONNECT, DISCONNECT, READY, LOG, RESOLUTION, METRIC, CUSTOM };
 
     class ServerHeader final
     {
@@ -0,0 +1,69 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef STRINGINDEX_H
+#define STRINGINDEX_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+#include <stdint.h>
+
+#include "Memory.h"
+#include "Misc.h"
+
+// The string literals in a module's read-only data and everywhere they're referenced from, either as a
+// 4 byte absolute address in code or data, or relative to the GOT in position-independent code. Log and
+// assert messages hardly ever change between versions, so the code around them is easy to find again.
+class COMMON_EXPORT StringIndex final
+{
+    public:
+        class Reference final
+        {
+            public:
+                uint8_t* site; // Where the 4 byte address or offset is, like an instruction's immediate or displacement
+                uint8_t* string;
+                bool isGotRelative;
+        };
+
+        // Strings are taken from .rodata if there is one, otherwise from every read-only segment.
+        // `globalOffsetTable' can be nullptr if the code isn't position-independent.
+        void build(const std::vector<Memory::PageInfo>& segments, const std::map<std::string, Memory::PageInfo>& sections,
+                   const uint8_t* globalOffsetTable);
+        std::vector<uint8_t*> getStrings(const std::string& string) const; // Where copies of it are
+        const std::vector<Reference>& getReferences(const std::string& string) const; // Sorted by site. Strings linkers merged into the ends of others count.
+        size_t getStringsCount() const;
+
+        static const size_t minStringSize = 4; // Shorter runs of printable bytes are too likely to be something else
+
+    private:
+        void addReference_(uint8_t* site, uint8_t* address, bool isGotRelative);
+
+        class String_ final
+        {
+            public:
+                uint8_t* start;
+                size_t size; // Not counting the terminator
+        };
+        std::vector<String_> strings_; // Sorted by start
+        std::map<std::string, std::vector<uint8_t*>> stringAddresses_;
+        std::map<std::string, std::vector<Reference>> references_;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#pragma once
+#ifndef X86_H
+#define X86_H
+
+#include <vector>
+
+#include <stdint.h>
+
+#include "Misc.h"
+
+// A small 32-bit x86 instruction length decoder and relocator. It only decodes enough of each
+// instruction to know its length and where its operands are, which is all that's needed to move
+// whole instructions out of the way of a jump.
+namespace X86
+{
+    const size_t maxInstructionLength = 15;
+    const size_t jumpSize = 5; // e9 rel32
+
+    class COMMON_EXPORT Instruction final
+    {
+        public:
+            size_t length;
+            size_t prefixesSize;
+            size_t opcodeSize; // 1 to 3 bytes, including any 0f escapes
+            bool hasModRm;
+            size_t displacementOffset; // Offsets are from the start of the instruction
+            size_t displacementSize;
+            size_t immediateOffset;
+            size_t immediateSize; // Total size of all the immediates
+            bool isRelative; // The immediate is a branch target relative to the end of the instruction
+    };
+
+    Instruction decode(const uint8_t* code);
+    size_t getInstructionLength(const uint8_t* code);
+    // The size of the whole instructions starting at `code' that cover at least `size' bytes
+    size_t getCoveringSize(const uint8_t* code, size_t size);
+
+    // Copies the whole instructions in `code' to something that runs the same when placed at
+    // `newAddress'. Relative branches are retargeted, with short ones widened to rel32. Calls
+    // become a push of their original return address and a jump, so they can only come last.
+    std::vector<uint8_t> relocate(const uint8_t* code, size_t size, const uint8_t* newAddress);
+    std::vector<uint8_t> makeJump(const uint8_t* from, const uint8_t* to);
+
+    // Upper bounds for sizing trampolines before the code they'll hold is known
+    inline size_t getMaxCoveringSize(size_t size) { return size + maxInstructionLength - 1; }
+    inline size_t getMaxRelocatedSize(size_t size) { return size * 3; } // Widening a 2 byte jcc rel8 to rel32 adds 4 bytes
+    inline size_t getMaxTrampolineSize(size_t size) { return getMaxRelocatedSize(getMaxCoveringSize(size)) + jumpSize; }
+}
+
+#endif
@@ -0,0 +1,56 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef XREFINDEX_H
+#define XREFINDEX_H
+
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+#include "Memory.h"
+#include "Misc.h"
+
+// Every call instruction in a module's code, by where it is and what it calls, so finding the callers of a
+// function doesn't mean decoding every byte of the module. Built from the bytes as they are, so calls patches
+// add afterwards aren't in it and calls they remove still are. Check the bytes at any site that matters.
+class COMMON_EXPORT XrefIndex final
+{
+    public:
+        class Call final
+        {
+            public:
+                uint8_t* site; // Where the instruction starts
+                uint8_t* target; // What it calls, or the slot it reads that from for an indirect call
+                bool isIndirect; // "call [absolute]" (ff 15) rather than "call relative" (e8)
+        };
+
+        void build(const std::vector<Memory::PageInfo>& segments); // Scans the readable executable ones
+        std::vector<Call> getCallers(const uint8_t* function) const; // Indirect calls are checked against what their slots hold now
+        std::vector<Call> getCalls(const uint8_t* start, size_t size) const; // Made from inside the range, in order
+        const Call* getCallAt(const uint8_t* site) const; // nullptr if there isn't one
+        size_t getCallsCount() const;
+
+    private:
+        std::vector<Call> callsBySite_;
+        std::vector<Call> directCallsByTarget_; // Sorted by target, then site
+        std::vector<Call> indirectCallsBySlot_; // Sorted by slot, then site
+};
+
+#endif
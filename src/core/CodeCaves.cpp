@@ -0,0 +1,100 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdexcept>
+
+#include "CodeCaves.h"
+#include "Memory.h"
+#include "Module.h"
+
+CodeCaves& CodeCaves::getSingleton()
+{
+    static CodeCaves singleton;
+    return singleton;
+}
+
+uint8_t* CodeCaves::allocate(size_t size, const std::string& moduleName)
+{
+    if (size == 0)
+        throw std::logic_error("Code caves cannot be empty.");
+    size = (size + caveAlignment_ - 1) & ~(caveAlignment_ - 1);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    Pool_& pool = pools_[moduleName];
+
+    // Reuse the smallest freed cave that fits, returning what's left of it
+    uint8_t* result;
+    auto freeList = pool.freeLists.lower_bound(size);
+    if (freeList != pool.freeLists.end())
+    {
+        result = freeList->second.back();
+        size_t freeSize = freeList->first;
+        freeList->second.pop_back();
+        if (freeList->second.empty())
+            pool.freeLists.erase(freeList);
+        if (freeSize > size)
+            pool.freeLists[freeSize - size].push_back(result + size);
+    }
+    else
+    {
+        if ((size_t)(pool.end - pool.next) < size)
+        {
+            // Start a new page near the module, keeping the rest of the old one for smaller caves
+            if (pool.end != pool.next)
+                pool.freeLists[pool.end - pool.next].push_back(pool.next);
+            const uint8_t* hint = nullptr;
+            if (!pool.pages.empty())
+                hint = pool.end;
+            else
+            {
+                Module module;
+                module.open(moduleName);
+                if (!module.getOriginalSegments().empty())
+                    hint = module.getOriginalSegments().back().start + module.getOriginalSegments().back().size;
+            }
+            size_t pageSize = Memory::getPageAlignment();
+            pageSize = ((size + pageSize - 1) / pageSize) * pageSize;
+            uint8_t* page = Memory::allocatePages(pageSize, true, hint);
+            pool.pages.push_back({page, pageSize});
+            pool.next = page;
+            pool.end = page + pageSize;
+        }
+        result = pool.next;
+        pool.next += size;
+    }
+    allocations_[result] = {moduleName, size};
+    return result;
+}
+
+void CodeCaves::free(uint8_t* cave)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto allocation = allocations_.find(cave);
+    if (allocation == allocations_.end())
+        throw std::logic_error("No such code cave was allocated.");
+    freed_.push_back(*allocation);
+    allocations_.erase(allocation);
+}
+
+void CodeCaves::releaseFreed()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    for (const auto& cave : releasable_)
+        pools_[cave.second.first].freeLists[cave.second.second].push_back(cave.first);
+    releasable_.clear();
+    releasable_.swap(freed_);
+}
@@ -244,6 +244,14 @@ void Core::sendCustomPacket(const size_t opCode, const std::vector<uint8_t>& dat
     sendPacket(Socket::ClientOpCode::CUSTOM, newdata);
 }
 
+void Core::sendMetric(const std::string& name, int64_t value) const
+{
+    std::vector<uint8_t> data;
+    serialiseIntegralTypeContinuousContainer(data, name);
+    serialiseIntegralType(data, value);
+    sendPacket(Socket::ClientOpCode::METRIC, data);
+}
+
 const std::string& Core::getCoreName() const
 {
     return coreName_;
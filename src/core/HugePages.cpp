@@ -0,0 +1,290 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+#include <exception>
+#include <stdexcept>
+
+#include <cstring>
+#include <cerrno>
+
+#ifndef _WIN32
+namespace posix
+{
+    #include <unistd.h>
+    #include <dirent.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <linux/perf_event.h>
+}
+#endif
+
+#include "HugePages.h"
+#include "SharedPages.h"
+#include "Core.h"
+#include "Logger.h"
+#include "Memory.h"
+#include "Module.h"
+
+namespace
+{
+#ifndef _WIN32
+    int getProtection(const Memory::PageInfo& page)
+    {
+        return (page.isReadable ? PROT_READ : 0) | (page.isWritable ? PROT_WRITE : 0) | (page.isExecutable ? PROT_EXEC : 0);
+    }
+
+    int openITlbMissCounter(int threadId)
+    {
+        posix::perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size = sizeof(attributes);
+        attributes.type = posix::PERF_TYPE_HW_CACHE;
+        attributes.config = posix::PERF_COUNT_HW_CACHE_ITLB | (posix::PERF_COUNT_HW_CACHE_OP_READ << 8) | (posix::PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv = 1;
+        return posix::syscall(SYS_perf_event_open, &attributes, threadId, -1, -1, PERF_FLAG_FD_CLOEXEC);
+    }
+#endif
+}
+
+HugePages& HugePages::getSingleton()
+{
+    static HugePages singleton;
+    return singleton;
+}
+
+HugePages::HugePages()
+{
+    isEnabled_ = false;
+    isCountersAvailable_ = false;
+    lastMissRate_ = -1.0;
+}
+
+HugePages::~HugePages()
+{
+    closeCounters_();
+}
+
+void HugePages::setEnabled(bool isEnabled)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (isEnabled == isEnabled_)
+        return;
+    isEnabled_ = isEnabled;
+    closeCounters_();
+    if (isEnabled_)
+    {
+        // Start counting straight away, so there's a rate from before anything is remapped to compare to
+        isCountersAvailable_ = true;
+        openCounters_();
+        lastSampleTime_ = std::chrono::steady_clock::now();
+    }
+}
+
+void HugePages::remap(const std::string& moduleName, uint8_t* start, size_t size)
+{
+#ifdef _WIN32
+    (void)moduleName;
+    (void)start;
+    (void)size;
+#else
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!isEnabled_)
+            return;
+    }
+    Module module;
+    try
+    {
+        module.open(moduleName);
+    }
+    catch (const std::exception& e)
+    {
+        return;
+    }
+    bool isWholeModule;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        isWholeModule = remappedModules_.count(module.getBase()) == 0;
+    }
+
+    // Only whole huge pages inside the module's code can be swapped, as anything else could be mapped around it
+    std::vector<uint8_t*> hugePages;
+    for (const auto& segment : module.getOriginalSegments())
+    {
+        if (!segment.isExecutable || segment.isWritable)
+            continue;
+        size_t first = ((size_t)segment.start + hugePageSize - 1) & ~(hugePageSize - 1);
+        size_t last = ((size_t)segment.start + segment.size) & ~(hugePageSize - 1);
+        for (uint8_t* hugePage = (uint8_t*)first; hugePage < (uint8_t*)last; hugePage += hugePageSize)
+            if (isWholeModule || (hugePage < start + size && start < hugePage + hugePageSize))
+                hugePages.push_back(hugePage);
+    }
+    for (auto hugePage : hugePages)
+        SharedPages::getSingleton().unshare(hugePage, hugePageSize);
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    bool isFirstRemap = remappedHugePages_.empty();
+    size_t remappedSize = 0;
+    for (auto hugePage : hugePages)
+    {
+        std::vector<Memory::PageInfo> pages = Memory::queryPage(hugePage, hugePageSize);
+        bool isSameProtection = true;
+        for (const auto& page : pages)
+            if (getProtection(page) != getProtection(pages.front()))
+                isSameProtection = false;
+        if (!isSameProtection || pages.front().isWritable)
+            continue;
+        if (remapHugePage_(hugePage, getProtection(pages.front())))
+        {
+            remappedHugePages_.insert(hugePage);
+            remappedSize += hugePageSize;
+        }
+    }
+    remappedModules_.insert(module.getBase());
+    if (remappedSize == 0)
+        return;
+
+    if (isWholeModule)
+        Logger::getSingleton().write(Logger::Severity::DEBUG_MESSAGE, "Remapped " + itos(remappedSize / 1024) + " KB of the code of module `" + moduleName + "' onto huge pages.");
+    if (isFirstRemap && lastMissRate_ >= 0.0)
+        Core::getSingleton().sendMetric("HugePages.iTlbMissesPerSecondBeforeRemap", (int64_t)lastMissRate_);
+    Core::getSingleton().sendMetric("HugePages.remappedSize", remappedHugePages_.size() * hugePageSize);
+#endif
+}
+
+bool HugePages::isRemapped(const uint8_t* address) const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return remappedHugePages_.count((uint8_t*)((size_t)address & ~(hugePageSize - 1))) > 0;
+}
+
+size_t HugePages::getRemappedSize() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return remappedHugePages_.size() * hugePageSize;
+}
+
+void HugePages::sampleCounters()
+{
+#ifndef _WIN32
+    std::lock_guard<std::mutex> lock(mutex_);
+    auto now = std::chrono::steady_clock::now();
+    if (!isEnabled_ || !isCountersAvailable_ || now - lastSampleTime_ < std::chrono::seconds(5))
+        return;
+
+    uint64_t misses = 0;
+    for (auto counter = counters_.begin(); counter != counters_.end(); )
+    {
+        uint64_t count;
+        if (posix::read(counter->second.first, &count, sizeof(count)) == sizeof(count))
+        {
+            misses += count - counter->second.second;
+            counter->second.second = count;
+        }
+
+        // The counters of threads that have exited won't count any more
+        if (posix::access(("/proc/self/task/" + itos(counter->first)).c_str(), F_OK) != 0)
+        {
+            posix::close(counter->second.first);
+            counter = counters_.erase(counter);
+        }
+        else
+            ++counter;
+    }
+    openCounters_();
+
+    lastMissRate_ = misses / std::chrono::duration<double>(now - lastSampleTime_).count();
+    lastSampleTime_ = now;
+    Core::getSingleton().sendMetric("HugePages.iTlbMissesPerSecond", (int64_t)lastMissRate_);
+#endif
+}
+
+// Private members
+
+bool HugePages::remapHugePage_(uint8_t* hugePage, int protection)
+{
+#ifdef _WIN32
+    (void)hugePage;
+    (void)protection;
+    return false;
+#else
+    // Map twice as much as needed and trim it down to an aligned huge page
+    uint8_t* reservation = (uint8_t*)posix::mmap(nullptr, hugePageSize * 2, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (reservation == MAP_FAILED)
+        return false;
+    uint8_t* copy = (uint8_t*)(((size_t)reservation + hugePageSize - 1) & ~(hugePageSize - 1));
+    if (copy != reservation)
+        posix::munmap(reservation, copy - reservation);
+    posix::munmap(copy + hugePageSize, reservation + hugePageSize * 2 - (copy + hugePageSize));
+
+    // Fill the copy before swapping it in, as the code on it could be running
+    if (posix::madvise(copy, hugePageSize, MADV_HUGEPAGE) != 0)
+    {
+        posix::munmap(copy, hugePageSize);
+        return false;
+    }
+    std::memcpy(copy, hugePage, hugePageSize);
+    if (posix::mprotect(copy, hugePageSize, protection) != 0 ||
+        posix::mremap(copy, hugePageSize, hugePageSize, MREMAP_MAYMOVE | MREMAP_FIXED, hugePage) == MAP_FAILED)
+    {
+        posix::munmap(copy, hugePageSize);
+        return false;
+    }
+    return true;
+#endif
+}
+
+void HugePages::openCounters_()
+{
+#ifndef _WIN32
+    posix::DIR* tasks = posix::opendir("/proc/self/task");
+    if (tasks == nullptr)
+        return;
+    posix::dirent* task;
+    while (counters_.size() < maxCounters_ && (task = posix::readdir(tasks)) != nullptr)
+    {
+        if (task->d_name[0] < '0' || task->d_name[0] > '9')
+            continue;
+        int threadId = std::stoi(task->d_name);
+        if (counters_.count(threadId) > 0)
+            continue;
+        int counter = openITlbMissCounter(threadId);
+        if (counter != -1)
+            counters_[threadId] = std::make_pair(counter, 0);
+        else if (errno != ESRCH) // Not just a thread that has exited since
+        {
+            Logger::getSingleton().write(Logger::Severity::NOTICE, "iTLB misses can't be counted: " + strError(errno));
+            isCountersAvailable_ = false;
+            break;
+        }
+    }
+    posix::closedir(tasks);
+    if (!isCountersAvailable_)
+        closeCounters_();
+#endif
+}
+
+void HugePages::closeCounters_()
+{
+#ifndef _WIN32
+    for (const auto& counter : counters_)
+        posix::close(counter.second.first);
+#endif
+    counters_.clear();
+}
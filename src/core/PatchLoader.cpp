@@ -15,6 +15,7 @@
     along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <algorithm>
 #include <stdexcept>
 
 #include <cassert>
@@ -23,6 +24,10 @@
 #include "Socket.h"
 #include "Core.h"
 #include "Memory.h"
+#include "X86.h"
+#include "Logger.h"
+#include "SharedPages.h"
+#include "HugePages.h"
 
 using namespace PatchData;
 
@@ -40,6 +45,11 @@ PatchLoader::PatchLoader()
     Core::getSingleton().addReceiveHandler(Socket::ServerOpCode::PATCH_PACK_REMOVE, patchPackRemoveReceiveHandler_);
     Core::getSingleton().addReceiveHandler(Socket::ServerOpCode::PATCH_LIB_LOAD, patchLibraryLoadReceiveHandler_);
     Core::getSingleton().addReceiveHandler(Socket::ServerOpCode::PATCH_LIB_UNLOAD, patchLibraryUnloadReceiveHandler_);
+    Core::getSingleton().addReceiveHandler(Socket::ServerOpCode::RESOLUTION_CACHE, resolutionCacheReceiveHandler_);
+    Core::getSingleton().addReceiveHandler(Socket::ServerOpCode::RESOLUTION, resolutionReceiveHandler_);
+    Core::getSingleton().addReceiveHandler(Socket::ServerOpCode::BAKE_MANIFEST, bakeManifestReceiveHandler_);
+    Core::getSingleton().addReceiveHandler(Socket::ServerOpCode::SHARED_PAGES, sharedPagesReceiveHandler_);
+    Core::getSingleton().addReceiveHandler(Socket::ServerOpCode::HUGE_PAGES, hugePagesReceiveHandler_);
 }
 
 PatchLoader::~PatchLoader()
@@ -69,6 +79,14 @@ bool PatchLoader::isPatchPackEnabled(const std::string& name) const
     return getIteratorToPatchPack_(name)->first.info.isCurrentlyEnabled;
 }
 
+void PatchLoader::setHookEnabledForThisThread(const std::string& name, bool isEnabled)
+{
+    getIteratorToHook_(name); // Check that the hook exists
+    if (!patcherLibrary_.getIsModuleOpen())
+        throw std::logic_error("The patcher library isn't loaded.");
+    *(bool*)patcherLibrary_.getSymbol(getHookSafename(name) + "_isThreadEnabled") = isEnabled;
+}
+
 const std::vector<Hook> PatchLoader::getHooks() const
 {
     std::vector<Hook> result;
@@ -106,7 +124,16 @@ void PatchLoader::patchHookReceiveHandler_(const std::vector<uint8_t>& data)
     Hook hook;
     hook.deserialise(deserialiseIntegralTypeContinuousContainer<std::vector<uint8_t>>(iterator));
 
-    getSingleton().registerHook_(hook);
+    // The manager sends hooks again whenever they are rebuilt
+    PatchLoader& patchLoader = getSingleton();
+    if (patchLoader.isHookRegistered(hook.name))
+    {
+        auto existingHook = patchLoader.getIteratorToHook_(hook.name);
+        if (existingHook->first.serialise() == hook.serialise())
+            return;
+        patchLoader.unregisterHook_(existingHook);
+    }
+    patchLoader.registerHook_(hook);
 }
 
 void PatchLoader::patchHookRemoveReceiveHandler_(const std::vector<uint8_t>& data)
@@ -138,6 +165,8 @@ void PatchLoader::patchPackReceiveHandler_(const std::vector<uint8_t>& data)
             patchLoader.enablePatchPack_(*existingPatchPack);
         else if (!patchPack.info.isCurrentlyEnabled && existingPatchPack->first.info.isCurrentlyEnabled)
             patchLoader.disablePatchPack_(*existingPatchPack);
+
+        patchLoader.setPatchPackExtraSettings_(*existingPatchPack, patchPack.info.extraSettings);
     }
 }
 
@@ -152,6 +181,95 @@ void PatchLoader::patchPackRemoveReceiveHandler_(const std::vector<uint8_t>& dat
     patchLoader.removePatchPack_(patchLoader.getIteratorToPatchPack_(name));
 }
 
+void PatchLoader::resolutionCacheReceiveHandler_(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+    std::string cacheFilename = deserialiseIntegralTypeContinuousContainer<std::string>(iterator);
+    try
+    {
+        Patcher::getSingleton().openResolutionCache(cacheFilename);
+    } catch (const std::exception& e)
+    {
+        Logger::getSingleton().write(Logger::Severity::WARNING, "Could not open the resolution cache, so every search will be a full scan: " + std::string(e.what()));
+    }
+}
+
+void PatchLoader::resolutionReceiveHandler_(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+    std::string moduleFingerprint = deserialiseIntegralTypeContinuousContainer<std::string>(iterator);
+    uint64_t searchHash = deserialiseIntegralType<uint64_t>(iterator);
+    std::vector<size_t> rvas = deserialiseIntegralTypeContinuousContainer<std::vector<size_t>>(iterator);
+    Patcher::getSingleton().addSharedResolution(moduleFingerprint, searchHash, rvas);
+}
+
+void PatchLoader::bakeManifestReceiveHandler_(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+    std::string manifestFilename = deserialiseIntegralTypeContinuousContainer<std::string>(iterator);
+    std::vector<BakeManifest> bakeManifests;
+    try
+    {
+        std::vector<uint8_t> manifestData = readFile(manifestFilename);
+        auto manifestIterator = manifestData.cbegin();
+        deserialiseDeserialisableTypeContainer(manifestIterator, bakeManifests);
+    } catch (const std::exception& e)
+    {
+        Logger::getSingleton().write(Logger::Severity::WARNING, "Could not read the bake manifest, so baked patch packs will be patched as usual: " + std::string(e.what()));
+        return;
+    }
+
+    // Processes not started from a baked copy just get the patch pack patched in as usual
+    PatchLoader& patchLoader = getSingleton();
+    for (const auto& bakeManifest : bakeManifests)
+    {
+        Module module;
+        try
+        {
+            module.open(bakeManifest.moduleName);
+            if (module.getFingerprint() != bakeManifest.moduleFingerprint)
+                continue;
+        } catch (const std::exception& e)
+        {
+            continue;
+        }
+        size_t bakedPatchesCount = 0;
+        size_t originalPatchesCount = 0;
+        for (const auto& bakedPatch : bakeManifest.bakedPatches)
+        {
+            const uint8_t* address = module.getBase() + bakedPatch.rva;
+            bool isReadable = false;
+            for (const auto& segment : module.getOriginalSegments())
+                if (segment.isReadable && address >= segment.start && address + bakedPatch.patchedBytes.size() <= segment.start + segment.size)
+                    isReadable = true;
+            if (!isReadable)
+                break;
+            if (std::equal(bakedPatch.patchedBytes.cbegin(), bakedPatch.patchedBytes.cend(), address))
+                ++bakedPatchesCount;
+            else if (std::equal(bakedPatch.originalBytes.cbegin(), bakedPatch.originalBytes.cend(), address))
+                ++originalPatchesCount;
+        }
+        if (bakedPatchesCount == bakeManifest.bakedPatches.size())
+        {
+            patchLoader.bakedPatchPacks_[bakeManifest.patchPackName] = bakeManifest.patchesHash;
+            Logger::getSingleton().write(Logger::Severity::NOTICE, "Patch pack `" + bakeManifest.patchPackName + "' is baked in to `" + bakeManifest.moduleName + "'.");
+        }
+        else if (originalPatchesCount != bakeManifest.bakedPatches.size())
+            Logger::getSingleton().write(Logger::Severity::WARNING, "`" + bakeManifest.moduleName + "' doesn't match the bake manifest of patch pack `" + bakeManifest.patchPackName + "'.");
+    }
+}
+
+void PatchLoader::sharedPagesReceiveHandler_(const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+    SharedPages::getSingleton().setPath(deserialiseIntegralTypeContinuousContainer<std::string>(iterator));
+}
+
+void PatchLoader::hugePagesReceiveHandler_(const std::vector<uint8_t>& /*data*/)
+{
+    HugePages::getSingleton().setEnabled(true);
+}
+
 void PatchLoader::patchLibraryLoadReceiveHandler_(const std::vector<uint8_t>& data)
 {
     TRACE("Loading patcher library.");
@@ -165,21 +283,13 @@ void PatchLoader::patchLibraryLoadReceiveHandler_(const std::vector<uint8_t>& da
     // Load the library
     patchLoader.patcherLibrary_.load(libraryFilename);
 
-    // Add any saved patches if possible
-    for (const auto& savedState : patchLoader.savedPatcherLibraryState_)
-    {
-        try
-        {
-            hookPatchFunctions_t& hookPatchFunctions = *(hookPatchFunctions_t*)patchLoader.patcherLibrary_.getSymbol(getHookSafename(savedState.first->first.name) + "_hookPatchFunctions");
-            hookPatchFunctionsMutex_t& hookPatchFunctionsMutex = *(hookPatchFunctionsMutex_t*)patchLoader.patcherLibrary_.getSymbol(getHookSafename(savedState.first->first.name) + "_hookPatchFunctionsMutex");
-            std::lock_guard<hookPatchFunctionsMutex_t> hookPatchFunctionsLock(hookPatchFunctionsMutex);
-            hookPatchFunctions = savedState.second;
-        } catch (...)
-        {
-            // Swallow the exception
-        }
-        patchLoader.applyHook_(*savedState.first);
-    }
+    // The library only contains the hooks and patch packs that are in use, so reapply whatever is in it.
+    // The hook patch functions are looked up again since the old pointers went away with the old library.
+    for (auto& hook : patchLoader.hooks_)
+        patchLoader.applyHook_(hook);
+    for (auto& patchPack : patchLoader.patchPacks_)
+        if (patchPack.first.info.isCurrentlyEnabled)
+            patchLoader.addHookPatchFunctions_(patchPack);
 }
 
 void PatchLoader::patchLibraryUnloadReceiveHandler_(const std::vector<uint8_t>& /*data*/)
@@ -189,19 +299,13 @@ void PatchLoader::patchLibraryUnloadReceiveHandler_(const std::vector<uint8_t>&
     if (!patchLoader.patcherLibrary_.getIsModuleOpen())
         return;
 
-    // Save all the patches the hooks in the library calls
-    patchLoader.savedPatcherLibraryState_.clear();
-    for (auto hook = patchLoader.hooks_.begin(); hook != patchLoader.hooks_.end(); ++hook)
-    {
-        patchLoader.unapplyHook_(*hook);
-        hookPatchFunctions_t& hookPatchFunctions = *(hookPatchFunctions_t*)patchLoader.patcherLibrary_.getSymbol(getHookSafename(hook->first.name) + "_hookPatchFunctions");
-        hookPatchFunctionsMutex_t& hookPatchFunctionsMutex = *(hookPatchFunctionsMutex_t*)patchLoader.patcherLibrary_.getSymbol(getHookSafename(hook->first.name) + "_hookPatchFunctionsMutex");
-        std::lock_guard<hookPatchFunctionsMutex_t> hookPatchFunctionsLock(hookPatchFunctionsMutex);
-        patchLoader.savedPatcherLibraryState_[hook] = hookPatchFunctions;
-    }
+    // Nothing may call into the library once it is gone
+    for (auto& hook : patchLoader.hooks_)
+        patchLoader.unapplyHook_(hook);
 
     // Unload the library
     patchLoader.patcherLibrary_.unload();
+    patchLoader.directHookPatches_.clear();
 }
 
 std::vector<std::pair<Hook, Patcher::PatchGroupId>>::const_iterator PatchLoader::getIteratorToHookNoThrow_(const std::string& name) const noexcept
@@ -256,6 +360,7 @@ std::vector<std::pair<PatchPack, Patcher::PatchGroupId>>::iterator PatchLoader::
 
 void PatchLoader::registerHook_(const Hook& hook)
 {
+    hookSearchResults_.erase(hook.name);
     hooks_.push_back(std::make_pair(hook, -1));
     applyHook_(hooks_.back());
 }
@@ -263,6 +368,7 @@ void PatchLoader::registerHook_(const Hook& hook)
 std::vector<std::pair<Hook, Patcher::PatchGroupId>>::iterator PatchLoader::unregisterHook_(std::vector<std::pair<Hook, Patcher::PatchGroupId>>::iterator hook)
 {
     unapplyHook_(*hook);
+    hookSearchResults_.erase(hook->first.name);
     return hooks_.erase(hook);
 }
 
@@ -276,11 +382,21 @@ void PatchLoader::unregisterAllHooks_()
 void PatchLoader::applyHook_(std::pair<Hook, Patcher::PatchGroupId>& hook)
 {
     Patch patch;
-    std::vector<uint8_t>* replaceBytes;
-    std::set<size_t>* ignoredReplaceBytesRvas;
+    std::vector<uint8_t>* replaceBytes = nullptr;
+    std::set<size_t>* ignoredReplaceBytesRvas = nullptr;
 
     // Initialise the patch with the search info
-    if (hook.first.getType() == Hook::Type::NAME)
+    if (hook.first.getType() == Hook::Type::IMPORT)
+        (ImportSearch&)patch.setType<ImportPatch>() = hook.first.getTypeData<ImportHook>();
+    else if (hook.first.getType() == Hook::Type::FUNCTION)
+    {
+        auto& replaceNamePatch = patch.setType<ReplaceNamePatch>();
+        (NameSearch&)replaceNamePatch = hook.first.getTypeData<FunctionHook>();
+        replaceNamePatch.replaceBytes.resize(std::max(hook.first.getTypeData<FunctionHook>().prologueSize, X86::jumpSize), (uint8_t)0x90); // Nops after the jump
+        replaceBytes = &replaceNamePatch.replaceBytes;
+        ignoredReplaceBytesRvas = &replaceNamePatch.ignoredReplaceBytesRvas;
+    }
+    else if (hook.first.getType() == Hook::Type::NAME)
     {
         auto& replaceNamePatch = patch.setType<ReplaceNamePatch>();
         (NameSearch&)replaceNamePatch = hook.first.getTypeData<NameHook>();
@@ -288,31 +404,96 @@ void PatchLoader::applyHook_(std::pair<Hook, Patcher::PatchGroupId>& hook)
         replaceBytes = &replaceNamePatch.replaceBytes;
         ignoredReplaceBytesRvas = &replaceNamePatch.ignoredReplaceBytesRvas;
     }
+    else if (hook.first.getType() == Hook::Type::INSTRUCTION)
+    {
+        auto& replaceInstructionsPatch = patch.setType<ReplaceInstructionsPatch>();
+        (InstructionSearch&)replaceInstructionsPatch = hook.first.getTypeData<InstructionHook>();
+        replaceInstructionsPatch.replaceBytes.resize(replaceInstructionsPatch.getMinSize(), (uint8_t)-1);
+        replaceBytes = &replaceInstructionsPatch.replaceBytes;
+        ignoredReplaceBytesRvas = &replaceInstructionsPatch.ignoredReplaceBytesRvas;
+    }
+    else if (hook.first.getType() == Hook::Type::CALL)
+    {
+        auto& replaceCallPatch = patch.setType<ReplaceCallPatch>();
+        (CallSearch&)replaceCallPatch = hook.first.getTypeData<CallHook>();
+        replaceCallPatch.replaceBytes.resize(X86::jumpSize, (uint8_t)-1);
+        replaceBytes = &replaceCallPatch.replaceBytes;
+        ignoredReplaceBytesRvas = &replaceCallPatch.ignoredReplaceBytesRvas;
+    }
     else
     {
         assert(hook.first.getType() == Hook::Type::SEARCH);
         auto& replaceSearchPatch = patch.setType<ReplaceSearchPatch>();
         (Search&)replaceSearchPatch = hook.first.getTypeData<SearchHook>();
-        replaceSearchPatch.replaceBytes.resize(replaceSearchPatch.searchBytes.size(), (uint8_t)-1);
+        replaceSearchPatch.replaceBytes.resize(replaceSearchPatch.getMinSize(), (uint8_t)-1);
         replaceBytes = &replaceSearchPatch.replaceBytes;
         ignoredReplaceBytesRvas = &replaceSearchPatch.ignoredReplaceBytesRvas;
     }
 
-    // Get the address of the hook function wrapper
-    uint8_t* hookFunctionWrapper = patcherLibrary_.getSymbol(getHookSafename(hook.first.name) + "_wrapper");
+    // Get the address of the hook function wrapper. The manager only builds the hooks enabled patch packs use,
+    // so a missing wrapper just means the hook isn't needed right now.
+    hook.second = (Patcher::PatchGroupId)-1;
+    if (!patcherLibrary_.getIsModuleOpen() || !isHookUsed_(hook.first.name))
+        return;
+    uint8_t* hookFunctionWrapper;
+    try
+    {
+        hookFunctionWrapper = patcherLibrary_.getSymbol(getHookSafename(hook.first.name) + "_wrapper");
+    } catch (...)
+    {
+        return;
+    }
+
+    // Import hooks point the slots straight at the detour. They're cheap to find, and the
+    // modules may have changed since, so they're always searched for again.
+    if (hook.first.getType() == Hook::Type::IMPORT)
+    {
+        auto& importPatch = patch.getTypeData<ImportPatch>();
+        importPatch.targetModuleName = patcherLibrary_.getPath() + "/" + patcherLibrary_.getFile();
+        importPatch.targetSymbol = getHookSafename(hook.first.name) + "_wrapper";
+        hook.second = Patcher::getSingleton().addToQueue({{patch, {}}});
+        return;
+    }
 
-    // Finish the patch by adding in the replace bytes
-    (*replaceBytes)[hook.first.hookRva] = (uint8_t)0xe8; // Relative call
-    for (size_t b = 0; b < replaceBytes->size(); ++b)
-        if (b != hook.first.hookRva)
-            ignoredReplaceBytesRvas->insert(b);
+    // Finish the patch by adding in the replace bytes. Function and jump hooks jump straight to the
+    // detour or wrapper and get the instructions they overwrite relocated to their trampoline.
+    std::map<size_t, uint8_t*> trampolines;
+    if (hook.first.getType() == Hook::Type::FUNCTION || hook.first.isJumpHook)
+    {
+        try
+        {
+            trampolines[0] = patcherLibrary_.getSymbol(getHookSafename(hook.first.name) + "_trampoline");
+        } catch (...)
+        {
+            return;
+        }
+        (*replaceBytes)[hook.first.hookRva] = (uint8_t)0xe9; // Relative jump
+    }
+    else
+        (*replaceBytes)[hook.first.hookRva] = (uint8_t)0xe8; // Relative call
+    if (hook.first.getType() != Hook::Type::FUNCTION)
+        for (size_t b = 0; b < replaceBytes->size(); ++b)
+            if (b != hook.first.hookRva)
+                ignoredReplaceBytesRvas->insert(b);
 
-    // Add the patch to the patcher queue with a relative address replace for the hook function wrapper
-    hook.second = Patcher::getSingleton().addToQueue({{patch, {{hook.first.hookRva + 1, hookFunctionWrapper}}}});
+    // Add the patch to the patcher queue with a relative address replace for the hook function wrapper,
+    // reusing where it was found last time if it was installed before
+    std::vector<std::set<uint8_t*>> knownSearchResults;
+    auto savedSearchResults = hookSearchResults_.find(hook.first.name);
+    if (savedSearchResults != hookSearchResults_.end())
+        knownSearchResults = savedSearchResults->second;
+    hook.second = Patcher::getSingleton().addToQueue({{patch, {{hook.first.hookRva + 1, hookFunctionWrapper}}}}, -1, nullptr, nullptr, knownSearchResults, trampolines);
 }
 
 void PatchLoader::unapplyHook_(std::pair<Hook, Patcher::PatchGroupId>& hook)
 {
+    if (hook.second == (Patcher::PatchGroupId)-1)
+        return;
+
+    // Keep where the hook was found so installing it again doesn't need another search
+    auto searchResults = Patcher::getSingleton().getPatchGroupSearchResults(hook.second);
+    if (!searchResults.empty())
+        hookSearchResults_[hook.first.name] = searchResults;
     Patcher::getSingleton().undoPatchGroup(hook.second);
     hook.second = (Patcher::PatchGroupId)-1;
 }
@@ -330,6 +511,15 @@ void PatchLoader::addPatchPack_(const PatchPack& patchPack)
 std::vector<std::pair<PatchPack, Patcher::PatchGroupId>>::iterator PatchLoader::removePatchPack_(std::vector<std::pair<PatchPack, Patcher::PatchGroupId>>::iterator patchPack)
 {
     disablePatchPack_(*patchPack);
+
+    // Disabled toggleable patch packs keep their patch group and hooks, so they have to be let go of now
+    if (patchPack->first.isToggleable)
+    {
+        if (patchPack->second != (Patcher::PatchGroupId)-1)
+            Patcher::getSingleton().undoPatchGroup(patchPack->second);
+        patchPack->second = (Patcher::PatchGroupId)-1;
+        unapplyUnusedHooks_(patchPack->first);
+    }
     return patchPacks_.erase(patchPack);
 }
 
@@ -345,51 +535,191 @@ void PatchLoader::enablePatchPack_(std::pair<PatchPack, Patcher::PatchGroupId>&
     if (patchPack.first.info.isCurrentlyEnabled)
         return;
 
-    size_t hookPatchNum = 0;
-    std::vector<std::pair<Patch, std::map<size_t, uint8_t*>>> patchGroup;
+    addHookPatchFunctions_(patchPack);
+
+    // A toggleable patch pack's patches are still in place from when it was last enabled, and a baked one's always are
+    if (!isPatchPackBaked_(patchPack.first) &&
+        (patchPack.second == (Patcher::PatchGroupId)-1 || !Patcher::getSingleton().setPatchGroupEnabled(patchPack.second, true)))
+    {
+        std::vector<std::pair<Patch, std::map<size_t, uint8_t*>>> patchGroup;
+        for (const auto& patch : patchPack.first.patches)
+            switch (patch.getType())
+            {
+                case Patch::Type::HOOK :
+                    break;
+
+                case Patch::Type::REPLACE_NAME :
+                    patchGroup.push_back(std::make_pair<const Patch&, std::map<size_t, uint8_t*>>(patch, {}));
+                    break;
+
+                case Patch::Type::REPLACE_SEARCH :
+                    patchGroup.push_back(std::make_pair<const Patch&, std::map<size_t, uint8_t*>>(patch, {}));
+                    break;
+
+                case Patch::Type::IMPORT :
+                    patchGroup.push_back(std::make_pair<const Patch&, std::map<size_t, uint8_t*>>(patch, {}));
+                    break;
+
+                case Patch::Type::VTABLE_SLOT :
+                    patchGroup.push_back(std::make_pair<const Patch&, std::map<size_t, uint8_t*>>(patch, {}));
+                    break;
+
+                case Patch::Type::CAVE :
+                    patchGroup.push_back(std::make_pair<const Patch&, std::map<size_t, uint8_t*>>(patch, {}));
+                    break;
+
+                case Patch::Type::REPLACE_INSTRUCTIONS :
+                    patchGroup.push_back(std::make_pair<const Patch&, std::map<size_t, uint8_t*>>(patch, {}));
+                    break;
+
+                case Patch::Type::REPLACE_CALL :
+                    patchGroup.push_back(std::make_pair<const Patch&, std::map<size_t, uint8_t*>>(patch, {}));
+                    break;
+
+                case Patch::Type::BLANK :
+                    assert(false); // Should have been rejected in the manager stage
+            }
+        if (!patchGroup.empty())
+            patchPack.second = Patcher::getSingleton().addToQueue(patchGroup);
+        else
+            patchPack.second = (Patcher::PatchGroupId)-1;
+    }
+    patchPack.first.info.isCurrentlyEnabled = true;
+
+    // Install any hooks that now have something to call
     for (const auto& patch : patchPack.first.patches)
-        switch (patch.getType())
+        if (patch.getType() == Patch::Type::HOOK && isHookRegistered(patch.getTypeData<HookPatch>().hookName))
         {
-            case Patch::Type::HOOK :
-                try
-                {
-                    hookPatchFunction_t hookPatchFunction = (hookPatchFunction_t)patcherLibrary_.getSymbol(getPatchPackSafename(patchPack.first.info.name) + "_hookPatch" + itos(hookPatchNum));
-                    hookPatchFunctions_t& hookPatchFunctions = *(hookPatchFunctions_t*)patcherLibrary_.getSymbol(getHookSafename(patch.getTypeData<HookPatch>().hookName) + "_hookPatchFunctions");
-                    hookPatchFunctionsMutex_t& hookPatchFunctionsMutex = *(hookPatchFunctionsMutex_t*)patcherLibrary_.getSymbol(getHookSafename(patch.getTypeData<HookPatch>().hookName) + "_hookPatchFunctionsMutex");
-                    std::lock_guard<hookPatchFunctionsMutex_t> hookPatchFunctionsLock(hookPatchFunctionsMutex);
-                    hookPatchFunctions[hookPatchFunction] = patchPack.first.info.extraSettings;
-                } catch (...)
-                {
-                    assert(false); // No exceptions should be thrown if the manager did it's job right
-                }
-                ++hookPatchNum;
-                break;
+            auto hook = getIteratorToHook_(patch.getTypeData<HookPatch>().hookName);
+            if (hook->second == (Patcher::PatchGroupId)-1)
+                applyHook_(*hook);
+        }
+}
 
-            case Patch::Type::REPLACE_NAME :
-                patchGroup.push_back(std::make_pair<const Patch&, std::map<size_t, uint8_t*>>(patch, {}));
-                break;
+void PatchLoader::updateDirectHookPatch_(const std::string& hookName, const hookPatchFunctions_t& hookPatchFunctions)
+{
+    // Hooks read the pointer without locking, so it always points at a copy that is never changed or freed
+    directHookPatch_t& directHookPatch = *(directHookPatch_t*)patcherLibrary_.getSymbol(getHookSafename(hookName) + "_directHookPatch");
+    if (hookPatchFunctions.size() != 1)
+    {
+        directHookPatch.store(nullptr, std::memory_order_release);
+        return;
+    }
+    directHookPatches_.push_back(*hookPatchFunctions.cbegin());
+    directHookPatch.store(&directHookPatches_.back(), std::memory_order_release);
+}
 
-            case Patch::Type::REPLACE_SEARCH :
-                patchGroup.push_back(std::make_pair<const Patch&, std::map<size_t, uint8_t*>>(patch, {}));
-                break;
+void PatchLoader::setPatchPackExtraSettings_(std::pair<PatchPack, Patcher::PatchGroupId>& patchPack, const ExtraSettings& extraSettings)
+{
+    patchPack.first.info.extraSettings = extraSettings;
+    if (!patchPack.first.info.isCurrentlyEnabled)
+        return;
 
-            case Patch::Type::BLANK :
-                assert(false); // Should have been rejected in the manager stage
+    // Update the settings the hooks pass to the patch functions
+    size_t hookPatchNum = 0;
+    for (const auto& patch : patchPack.first.patches)
+        if (patch.getType() == Patch::Type::HOOK)
+        {
+            try
+            {
+                hookPatchFunction_t hookPatchFunction = (hookPatchFunction_t)patcherLibrary_.getSymbol(getPatchPackSafename(patchPack.first.info.name) + "_hookPatch" + itos(hookPatchNum));
+                hookPatchFunctions_t& hookPatchFunctions = *(hookPatchFunctions_t*)patcherLibrary_.getSymbol(getHookSafename(patch.getTypeData<HookPatch>().hookName) + "_hookPatchFunctions");
+                hookPatchFunctionsMutex_t& hookPatchFunctionsMutex = *(hookPatchFunctionsMutex_t*)patcherLibrary_.getSymbol(getHookSafename(patch.getTypeData<HookPatch>().hookName) + "_hookPatchFunctionsMutex");
+                std::lock_guard<hookPatchFunctionsMutex_t> hookPatchFunctionsLock(hookPatchFunctionsMutex);
+                auto hookPatchFunctionSettings = hookPatchFunctions.find(hookPatchFunction);
+                if (hookPatchFunctionSettings != hookPatchFunctions.end())
+                    hookPatchFunctionSettings->second = extraSettings;
+                updateDirectHookPatch_(patch.getTypeData<HookPatch>().hookName, hookPatchFunctions);
+            } catch (...)
+            {
+                assert(false); // No exceptions should be thrown if the manager did it's job right
+            }
+            ++hookPatchNum;
         }
-    if (!patchGroup.empty())
-        patchPack.second = Patcher::getSingleton().addToQueue(patchGroup);
-    else
-        patchPack.second = (Patcher::PatchGroupId)-1;
-    patchPack.first.info.isCurrentlyEnabled = true;
 }
 
 void PatchLoader::disablePatchPack_(std::pair<PatchPack, Patcher::PatchGroupId>& patchPack)
 {
     if (!patchPack.first.info.isCurrentlyEnabled)
         return;
+    if (isPatchPackBaked_(patchPack.first))
+    {
+        Logger::getSingleton().write(Logger::Severity::WARNING, "Patch pack `" + patchPack.first.info.name + "' is baked in to its module, so it can't be disabled.");
+        return;
+    }
 
+    // Toggleable patch packs keep their patched group and hooks around, unless the group hasn't been patched yet
+    removeHookPatchFunctions_(patchPack);
+    patchPack.first.info.isCurrentlyEnabled = false;
+    if (patchPack.first.isToggleable &&
+        (patchPack.second == (Patcher::PatchGroupId)-1 || Patcher::getSingleton().setPatchGroupEnabled(patchPack.second, false)))
+        return;
     if (patchPack.second != (Patcher::PatchGroupId)-1)
         Patcher::getSingleton().undoPatchGroup(patchPack.second);
+    patchPack.second = (Patcher::PatchGroupId)-1;
+    unapplyUnusedHooks_(patchPack.first);
+}
+
+void PatchLoader::unapplyUnusedHooks_(const PatchPack& patchPack)
+{
+    // Uninstall any hooks that have nothing left to call
+    for (const auto& patch : patchPack.patches)
+        if (patch.getType() == Patch::Type::HOOK && isHookRegistered(patch.getTypeData<HookPatch>().hookName))
+        {
+            auto hook = getIteratorToHook_(patch.getTypeData<HookPatch>().hookName);
+            if (!isHookUsed_(hook->first.name))
+                unapplyHook_(*hook);
+        }
+}
+
+bool PatchLoader::isPatchPackBaked_(const PatchPack& patchPack) const
+{
+    // A patch pack edited since it was baked is patched as usual, since what's baked is no longer what it does
+    auto bakedPatchPack = bakedPatchPacks_.find(patchPack.info.name);
+    return bakedPatchPack != bakedPatchPacks_.end() && bakedPatchPack->second == BakeManifest::getPatchesHash(patchPack);
+}
+
+bool PatchLoader::isHookUsed_(const std::string& name) const
+{
+    for (const auto& patchPack : patchPacks_)
+        if (patchPack.first.info.isCurrentlyEnabled)
+            for (const auto& patch : patchPack.first.patches)
+                if (patch.getType() == Patch::Type::HOOK && patch.getTypeData<HookPatch>().hookName == name)
+                    return true;
+    return false;
+}
+
+void PatchLoader::addHookPatchFunctions_(std::pair<PatchPack, Patcher::PatchGroupId>& patchPack)
+{
+    if (!patcherLibrary_.getIsModuleOpen())
+        return;
+
+    size_t hookPatchNum = 0;
+    for (const auto& patch : patchPack.first.patches)
+        if (patch.getType() == Patch::Type::HOOK)
+        {
+            try
+            {
+                hookPatchFunction_t hookPatchFunction = (hookPatchFunction_t)patcherLibrary_.getSymbol(getPatchPackSafename(patchPack.first.info.name) + "_hookPatch" + itos(hookPatchNum));
+                hookPatchFunctions_t& hookPatchFunctions = *(hookPatchFunctions_t*)patcherLibrary_.getSymbol(getHookSafename(patch.getTypeData<HookPatch>().hookName) + "_hookPatchFunctions");
+                hookPatchFunctionsMutex_t& hookPatchFunctionsMutex = *(hookPatchFunctionsMutex_t*)patcherLibrary_.getSymbol(getHookSafename(patch.getTypeData<HookPatch>().hookName) + "_hookPatchFunctionsMutex");
+                std::lock_guard<hookPatchFunctionsMutex_t> hookPatchFunctionsLock(hookPatchFunctionsMutex);
+                hookPatchFunctions[hookPatchFunction] = patchPack.first.info.extraSettings;
+                *(hookPatchFunctionsCount_t*)patcherLibrary_.getSymbol(getHookSafename(patch.getTypeData<HookPatch>().hookName) + "_hookPatchFunctionsCount") = hookPatchFunctions.size();
+                updateDirectHookPatch_(patch.getTypeData<HookPatch>().hookName, hookPatchFunctions);
+            } catch (...)
+            {
+                // Swallow the exception. The patch pack isn't in the library until the manager relinks it.
+            }
+            ++hookPatchNum;
+        }
+}
+
+void PatchLoader::removeHookPatchFunctions_(std::pair<PatchPack, Patcher::PatchGroupId>& patchPack)
+{
+    if (!patcherLibrary_.getIsModuleOpen())
+        return;
+
     size_t hookPatchNum = 0;
     for (const auto& patch : patchPack.first.patches)
         if (patch.getType() == Patch::Type::HOOK)
@@ -403,14 +733,14 @@ void PatchLoader::disablePatchPack_(std::pair<PatchPack, Patcher::PatchGroupId>&
                 auto hookPatchFunction_inMap = hookPatchFunctions.find(hookPatchFunction);
                 if (hookPatchFunction_inMap != hookPatchFunctions.end())
                     hookPatchFunctions.erase(hookPatchFunction_inMap);
+                *(hookPatchFunctionsCount_t*)patcherLibrary_.getSymbol(getHookSafename(patch.getTypeData<HookPatch>().hookName) + "_hookPatchFunctionsCount") = hookPatchFunctions.size();
+                updateDirectHookPatch_(patch.getTypeData<HookPatch>().hookName, hookPatchFunctions);
             } catch (...)
             {
                 // Swallow the exception
             }
             ++hookPatchNum;
         }
-    patchPack.first.info.isCurrentlyEnabled = false;
-    patchPack.second = (Patcher::PatchGroupId)-1;
 }
 
 std::string PatchLoader::getHookSafename(const std::string& name)
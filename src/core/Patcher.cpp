@@ -24,9 +24,111 @@
 #include "Patcher.h"
 #include "Core.h"
 #include "Memory.h"
+#include "X86.h"
+#include "CodeCaves.h"
+#include "SharedPages.h"
+#include "HugePages.h"
+#include "Module.h"
 
 using namespace PatchData;
 
+namespace
+{
+    void getReplaceBytes(const Patch& patch, std::vector<uint8_t>& replaceBytes, std::set<size_t>& ignoredReplaceBytesRvas)
+    {
+        if (patch.getType() == Patch::Type::REPLACE_NAME)
+        {
+            replaceBytes = patch.getTypeData<ReplaceNamePatch>().replaceBytes;
+            ignoredReplaceBytesRvas = patch.getTypeData<ReplaceNamePatch>().ignoredReplaceBytesRvas;
+        }
+        else if (patch.getType() == Patch::Type::REPLACE_SEARCH)
+        {
+            replaceBytes = patch.getTypeData<ReplaceSearchPatch>().replaceBytes;
+            ignoredReplaceBytesRvas = patch.getTypeData<ReplaceSearchPatch>().ignoredReplaceBytesRvas;
+        }
+        else if (patch.getType() == Patch::Type::REPLACE_INSTRUCTIONS)
+        {
+            replaceBytes = patch.getTypeData<ReplaceInstructionsPatch>().replaceBytes;
+            ignoredReplaceBytesRvas = patch.getTypeData<ReplaceInstructionsPatch>().ignoredReplaceBytesRvas;
+        }
+        else if (patch.getType() == Patch::Type::REPLACE_CALL)
+        {
+            replaceBytes = patch.getTypeData<ReplaceCallPatch>().replaceBytes;
+            ignoredReplaceBytesRvas = patch.getTypeData<ReplaceCallPatch>().ignoredReplaceBytesRvas;
+        }
+        else if (patch.getType() == Patch::Type::CAVE)
+        {
+            // The jump's address is filled in as a relative address replace
+            size_t caveRva = patch.getTypeData<CavePatch>().caveRva;
+            replaceBytes.assign(caveRva + X86::jumpSize, 0);
+            replaceBytes[caveRva] = 0xe9;
+            ignoredReplaceBytesRvas.clear();
+            for (size_t b = 0; b < caveRva; ++b)
+                ignoredReplaceBytesRvas.insert(b);
+        }
+        else
+            assert(false);
+    }
+
+    const Search* getSearch(const Patch& patch)
+    {
+        switch (patch.getType())
+        {
+            case Patch::Type::REPLACE_NAME :
+                return &patch.getTypeData<ReplaceNamePatch>();
+
+            case Patch::Type::REPLACE_SEARCH :
+                return &patch.getTypeData<ReplaceSearchPatch>();
+
+            case Patch::Type::REPLACE_INSTRUCTIONS :
+                return &patch.getTypeData<ReplaceInstructionsPatch>();
+
+            case Patch::Type::CAVE :
+                return &patch.getTypeData<CavePatch>();
+
+            default:
+                return nullptr;
+        }
+    }
+
+    // Of a patch that overwrites code
+    const std::string& getModuleName(const Patch& patch)
+    {
+        if (patch.getType() == Patch::Type::REPLACE_CALL)
+            return patch.getTypeData<ReplaceCallPatch>().moduleName;
+        return getSearch(patch)->moduleName;
+    }
+
+    // Checks results found before, in case they came from a different build or the code changed since
+    std::set<uint8_t*> getVerifiedResults(const Search& search, const Module& module, const std::set<uint8_t*>& results)
+    {
+        for (const auto& result : results)
+        {
+            bool isReadable = false;
+            for (const auto& segment : module.getOriginalSegments())
+                if (segment.isReadable && result >= segment.start && result + search.getMinSize() <= segment.start + segment.size)
+                    isReadable = true;
+            if (!isReadable || !search.isMatchAt(result))
+                return {};
+        }
+        return results;
+    }
+
+    std::set<uint8_t*> getVerifiedResults(const Search& search, const Module& module, const std::vector<size_t>& rvas)
+    {
+        std::set<uint8_t*> results;
+        for (const auto& rva : rvas)
+            results.insert(module.getBase() + rva);
+        return getVerifiedResults(search, module, results);
+    }
+
+    // Pointer patches replace a single pointer, instead of overwriting code
+    bool isPointerPatch(const Patch& patch)
+    {
+        return patch.getType() == Patch::Type::IMPORT || patch.getType() == Patch::Type::VTABLE_SLOT;
+    }
+}
+
 Patcher& Patcher::getSingleton()
 {
     static Patcher singleton;
@@ -84,11 +186,22 @@ void Patcher::stopPatcherThreadAndWait()
 Patcher::PatchGroupId Patcher::addToQueue(const std::vector<std::pair<PatchData::Patch, std::map<size_t, uint8_t*>>>& patchGroup,
                                           std::time_t secondsToTry,
                                           Patcher::patchGroupCallback_t patchGroupFailureCallback,
-                                          Patcher::patchGroupCallback_t patchGroupSuccessCallback)
+                                          Patcher::patchGroupCallback_t patchGroupSuccessCallback,
+                                          const std::vector<std::set<uint8_t*>>& knownSearchResults,
+                                          const std::map<size_t, uint8_t*>& trampolines)
 {
     // Check for an empty `patchGroup'
     if (patchGroup.empty())
         throw std::logic_error("`patchGroup' cannot be empty.");
+    if (!knownSearchResults.empty() && knownSearchResults.size() != patchGroup.size())
+        throw std::logic_error("`knownSearchResults' must either be empty or have one set of results for every patch.");
+    if (!trampolines.empty() && trampolines.crbegin()->first >= patchGroup.size())
+        throw std::logic_error("`trampolines' can only have indexes of patches in the patch group.");
+    for (const auto& trampoline : trampolines)
+        if (isPointerPatch(patchGroup[trampoline.first].first))
+            throw std::logic_error("Import and vtable slot patches don't overwrite any code, so cannot have a trampoline.");
+        else if (patchGroup[trampoline.first].first.getType() == Patch::Type::CAVE)
+            throw std::logic_error("Cave patches already move the instructions they overwrite into their cave.");
 
     // Check if the patches given are either a replace name or replace search patch
     // And that no RVA of the relative address replaces are outside the range of the
@@ -111,8 +224,29 @@ Patcher::PatchGroupId Patcher::addToQueue(const std::vector<std::pair<PatchData:
                     throw std::logic_error("Relative address replaces RVAs + 4 must be less than the patch's replace bytes.");
                 break;
 
+            case Patch::Type::REPLACE_INSTRUCTIONS :
+                if (!patch.second.empty() && patch.second.crbegin()->first + 4 > patch.first.getTypeData<ReplaceInstructionsPatch>().replaceBytes.size())
+                    throw std::logic_error("Relative address replaces RVAs + 4 must be less than the patch's replace bytes.");
+                break;
+
+            case Patch::Type::REPLACE_CALL :
+                if (!patch.second.empty() && patch.second.crbegin()->first + 4 > patch.first.getTypeData<ReplaceCallPatch>().replaceBytes.size())
+                    throw std::logic_error("Relative address replaces RVAs + 4 must be less than the patch's replace bytes.");
+                break;
+
+            case Patch::Type::IMPORT :
+            case Patch::Type::VTABLE_SLOT :
+                if (!patch.second.empty())
+                    throw std::logic_error("Import and vtable slot patches cannot have relative address replaces.");
+                break;
+
+            case Patch::Type::CAVE :
+                if (!patch.second.empty())
+                    throw std::logic_error("Cave patches cannot have relative address replaces.");
+                break;
+
             default:
-                throw std::logic_error("Patches passed must only be of the replace name or replace search types.");
+                throw std::logic_error("Patches passed must only be of the replace name, replace search, replace instructions, replace call, import, vtable slot or cave types.");
         }
         size_t previousRelativeAddressReplaceRva = -4;
         for (const auto& relativeAddressReplace : patch.second)
@@ -124,11 +258,15 @@ Patcher::PatchGroupId Patcher::addToQueue(const std::vector<std::pair<PatchData:
 
     // Prepare the patch group structure
     PatchGroup patchGroup_;
-    for (const auto& patch : patchGroup)
+    for (size_t p = 0; p < patchGroup.size(); ++p)
     {
         PatchGroup::Patch patch_;
-        patch_.patch = patch.first;
-        patch_.relativeAddressReplaces = patch.second;
+        patch_.patch = patchGroup[p].first;
+        patch_.relativeAddressReplaces = patchGroup[p].second;
+        if (!knownSearchResults.empty())
+            patch_.knownSearchResults = knownSearchResults[p];
+        auto trampoline = trampolines.find(p);
+        patch_.trampoline = trampoline != trampolines.end() ? trampoline->second : nullptr;
         patchGroup_.patches.push_back(patch_);
     }
     patchGroup_.secondsToTry = secondsToTry;
@@ -137,6 +275,7 @@ Patcher::PatchGroupId Patcher::addToQueue(const std::vector<std::pair<PatchData:
     patchGroup_.patchGroupSuccessCallback = patchGroupSuccessCallback;
     patchGroup_.isTimedOut = false;
     patchGroup_.isPatchesSuccessful = false;
+    patchGroup_.isEnabled = true;
     PatchGroupId patchGroupId = getNextAvailablePatchGroupId_();
 
     // Add it!
@@ -159,7 +298,21 @@ void Patcher::undoPatchGroup(Patcher::PatchGroupId id)
         // Yes, so we restore the original bytes in this function
         for (const auto& patch : patchGroup->second.patches)
             for (const auto& resultAndOriginalBytes : patch.resultsAndOriginalBytes)
-                Memory::safeCopy(resultAndOriginalBytes.second, resultAndOriginalBytes.first);
+                if (isPointerPatch(patch.patch))
+                {
+                    uint8_t* originalPointer;
+                    std::memcpy(&originalPointer, &resultAndOriginalBytes.second[0], sizeof(originalPointer));
+                    Memory::safeStorePointer((uint8_t**)resultAndOriginalBytes.first, originalPointer);
+                }
+                else
+                {
+                    SharedPages::getSingleton().unshare(resultAndOriginalBytes.first, resultAndOriginalBytes.second.size());
+                    Memory::safeCopy(resultAndOriginalBytes.second, resultAndOriginalBytes.first);
+                    HugePages::getSingleton().remap(getModuleName(patch.patch), resultAndOriginalBytes.first, resultAndOriginalBytes.second.size());
+                    SharedPages::getSingleton().share(getModuleName(patch.patch), resultAndOriginalBytes.first, resultAndOriginalBytes.second.size());
+                    if (patch.patch.getType() == Patch::Type::CAVE)
+                        CodeCaves::getSingleton().free(patch.trampoline);
+                }
     else if (!patchGroup->second.isTimedOut)
         // No (and not timed out), so we just remove it from the queue
         for (auto patchGroupInQueue = patchGroupQueue_.begin(); patchGroupInQueue != patchGroupQueue_.end(); ++patchGroupInQueue)
@@ -174,8 +327,111 @@ void Patcher::undoPatchGroup(Patcher::PatchGroupId id)
     patchGroups_.erase(patchGroup);
 }
 
+bool Patcher::setPatchGroupEnabled(Patcher::PatchGroupId id, bool isEnabled)
+{
+    std::lock_guard<std::recursive_mutex> patchGroupsLock(patchGroupsMutex_);
+    auto patchGroup = patchGroups_.find(id);
+    if (patchGroup == patchGroups_.end())
+        throw std::logic_error("No such patch group exists.");
+    if (!patchGroup->second.isPatchesSuccessful)
+        return false;
+    if (patchGroup->second.isEnabled == isEnabled)
+        return true;
+
+    // Any trampolines and caves stay where they are, so only the patch sites themselves change
+    for (const auto& patch : patchGroup->second.patches)
+        for (const auto& resultAndOriginalBytes : patch.resultsAndOriginalBytes)
+        {
+            const std::vector<uint8_t>& bytes = isEnabled ? patch.resultsAndPatchedBytes.at(resultAndOriginalBytes.first) : resultAndOriginalBytes.second;
+            if (isPointerPatch(patch.patch))
+            {
+                uint8_t* pointer;
+                std::memcpy(&pointer, &bytes[0], sizeof(pointer));
+                Memory::safeStorePointer((uint8_t**)resultAndOriginalBytes.first, pointer);
+            }
+            else
+            {
+                SharedPages::getSingleton().unshare(resultAndOriginalBytes.first, bytes.size());
+                Memory::safeCopy(bytes, resultAndOriginalBytes.first);
+                HugePages::getSingleton().remap(getModuleName(patch.patch), resultAndOriginalBytes.first, bytes.size());
+                SharedPages::getSingleton().share(getModuleName(patch.patch), resultAndOriginalBytes.first, bytes.size());
+            }
+        }
+    patchGroup->second.isEnabled = isEnabled;
+    return true;
+}
+
+std::vector<std::set<uint8_t*>> Patcher::getPatchGroupSearchResults(Patcher::PatchGroupId id)
+{
+    std::lock_guard<std::recursive_mutex> patchGroupsLock(patchGroupsMutex_);
+    auto patchGroup = patchGroups_.find(id);
+    if (patchGroup == patchGroups_.end())
+        throw std::logic_error("No such patch group exists.");
+
+    std::vector<std::set<uint8_t*>> result;
+    if (!patchGroup->second.isPatchesSuccessful)
+        return result;
+    result.reserve(patchGroup->second.patches.size());
+    for (const auto& patch : patchGroup->second.patches)
+    {
+        std::set<uint8_t*> searchResults;
+        for (const auto& resultAndOriginalBytes : patch.resultsAndOriginalBytes)
+            searchResults.insert(resultAndOriginalBytes.first);
+        result.push_back(searchResults);
+    }
+    return result;
+}
+
+void Patcher::openResolutionCache(const std::string& pathfile)
+{
+    std::lock_guard<std::recursive_mutex> patchGroupsLock(patchGroupsMutex_);
+    resolutionCache_.open(pathfile);
+}
+
+void Patcher::addSharedResolution(const std::string& moduleFingerprint, uint64_t searchHash, const std::vector<size_t>& rvas)
+{
+    std::lock_guard<std::recursive_mutex> patchGroupsLock(patchGroupsMutex_);
+    sharedResolutions_[std::make_pair(calculateFnv1aHash((const uint8_t*)moduleFingerprint.data(), moduleFingerprint.size()), searchHash)] = rvas;
+}
+
 // Private members
 
+std::set<uint8_t*> Patcher::doCachedSearch_(const Search& search)
+{
+    Module module;
+    module.open(search.moduleName);
+    std::string fingerprint = module.getFingerprint();
+    uint64_t moduleFingerprint = calculateFnv1aHash((const uint8_t*)fingerprint.data(), fingerprint.size());
+    uint64_t searchHash = search.getHash();
+
+    // Results other cores found are only used if every one of them still matches
+    std::vector<size_t> rvas;
+    std::set<uint8_t*> results;
+    auto sharedResolution = sharedResolutions_.find(std::make_pair(moduleFingerprint, searchHash));
+    if (sharedResolution != sharedResolutions_.end())
+        results = getVerifiedResults(search, module, sharedResolution->second);
+    if (results.empty() && resolutionCache_.find(moduleFingerprint, searchHash, rvas))
+        results = getVerifiedResults(search, module, rvas);
+    if (!results.empty())
+        return results;
+
+    // Nobody has found it yet, so search for it and tell the others
+    results = search.doSearch();
+    rvas.clear();
+    for (const auto& result : results)
+        rvas.push_back(result - module.getBase());
+    if (rvas.empty())
+        return results;
+    resolutionCache_.store(moduleFingerprint, searchHash, rvas);
+    sharedResolutions_[std::make_pair(moduleFingerprint, searchHash)] = rvas;
+    std::vector<uint8_t> data;
+    serialiseIntegralTypeContinuousContainer(data, fingerprint);
+    serialiseIntegralType(data, searchHash);
+    serialiseIntegralTypeContinuousContainer(data, rvas);
+    Core::getSingleton().sendPacket(Socket::ClientOpCode::RESOLUTION, data);
+    return results;
+}
+
 void Patcher::patcher_(Patcher* self)
 {
     self->isRunning_ = true;
@@ -183,6 +439,7 @@ void Patcher::patcher_(Patcher* self)
     {
         {
             std::lock_guard<std::recursive_mutex> patchGroupsLock(self->patchGroupsMutex_);
+            CodeCaves::getSingleton().releaseFreed();
             for (size_t amountInQueue = self->patchGroupQueue_.size(); amountInQueue > 0; --amountInQueue)
             {
                 // Pop a patch group off the queue
@@ -206,14 +463,29 @@ void Patcher::patcher_(Patcher* self)
                     for (auto& patch : patchGroup->second.patches)
                     {
                         std::set<uint8_t*> searchResults;
-                        if (patch.patch.getType() == Patch::Type::REPLACE_NAME)
-                            searchResults = patch.patch.getTypeData<ReplaceNamePatch>().doSearch();
-                        else if (patch.patch.getType() == Patch::Type::REPLACE_SEARCH)
-                            searchResults = patch.patch.getTypeData<ReplaceSearchPatch>().doSearch();
+                        if (!patch.knownSearchResults.empty() && getSearch(patch.patch) != nullptr)
+                        {
+                            // Known results are checked like cached ones, and searched for again if they went stale
+                            const Search& search = *getSearch(patch.patch);
+                            Module module;
+                            module.open(search.moduleName);
+                            searchResults = getVerifiedResults(search, module, patch.knownSearchResults);
+                            if (searchResults.empty())
+                                searchResults = self->doCachedSearch_(search);
+                        }
+                        else if (getSearch(patch.patch) != nullptr)
+                            searchResults = self->doCachedSearch_(*getSearch(patch.patch));
+                        else if (patch.patch.getType() == Patch::Type::IMPORT)
+                            searchResults = patch.patch.getTypeData<ImportPatch>().doSearch();
+                        else if (patch.patch.getType() == Patch::Type::VTABLE_SLOT)
+                            searchResults = patch.patch.getTypeData<VtableSlotPatch>().doSearch();
+                        else if (patch.patch.getType() == Patch::Type::REPLACE_CALL)
+                            searchResults = patch.patch.getTypeData<ReplaceCallPatch>().doSearch();
                         else
                             assert(false); // Any other patch type should have been blocked at the adding process!
 
-                        if (searchResults.empty())
+                        if (searchResults.empty() ||
+                            ((patch.trampoline != nullptr || patch.patch.getType() == Patch::Type::CAVE) && searchResults.size() != 1))
                         {
                             isSuccessfulPatchGroup = false;
                             break;
@@ -221,29 +493,92 @@ void Patcher::patcher_(Patcher* self)
 
                         for (const auto& searchResult : searchResults)
                             patch.resultsAndOriginalBytes[searchResult] = {};
+                        if (patch.patch.getType() == Patch::Type::IMPORT)
+                            patch.pointerTarget = patch.patch.getTypeData<ImportPatch>().getTarget();
+                        else if (patch.patch.getType() == Patch::Type::VTABLE_SLOT)
+                            patch.pointerTarget = patch.patch.getTypeData<VtableSlotPatch>().getTarget();
+
+                        // Work out which whole instructions a trampoline patch overwrites, from its first to its last replaced byte,
+                        // and relocate them now so anything that can't be moved fails the group before it's partly patched
+                        if (patch.patch.getType() == Patch::Type::CAVE)
+                        {
+                            // Cave patches work the same, except the cave bytes run first and the instructions are only
+                            // moved if asked to
+                            const auto& cavePatch = patch.patch.getTypeData<CavePatch>();
+                            uint8_t* movedInstructions = *searchResults.cbegin() + cavePatch.caveRva;
+                            patch.trampolineRva = cavePatch.caveRva;
+                            patch.trampolineSize = X86::getCoveringSize(movedInstructions, X86::jumpSize);
+                            patch.trampoline = CodeCaves::getSingleton().allocate(cavePatch.caveBytes.size() + X86::jumpSize +
+                                (cavePatch.isOriginalCodeKept ? X86::getMaxRelocatedSize(patch.trampolineSize) : 0), cavePatch.moduleName);
+                            patch.trampolineBytes = cavePatch.caveBytes;
+                            if (cavePatch.isOriginalCodeKept)
+                            {
+                                auto relocatedInstructions = X86::relocate(movedInstructions, patch.trampolineSize, patch.trampoline + patch.trampolineBytes.size());
+                                patch.trampolineBytes.insert(patch.trampolineBytes.end(), relocatedInstructions.cbegin(), relocatedInstructions.cend());
+                            }
+                            auto jump = X86::makeJump(patch.trampoline + patch.trampolineBytes.size(), movedInstructions + patch.trampolineSize);
+                            patch.trampolineBytes.insert(patch.trampolineBytes.end(), jump.cbegin(), jump.cend());
+                            patch.relativeAddressReplaces = {{cavePatch.caveRva + 1, patch.trampoline}};
+                        }
+                        else if (patch.trampoline != nullptr)
+                        {
+                            std::vector<uint8_t> replaceBytes;
+                            std::set<size_t> ignoredReplaceBytesRvas;
+                            getReplaceBytes(patch.patch, replaceBytes, ignoredReplaceBytesRvas);
+                            for (const auto& relativeAddressReplace : patch.relativeAddressReplaces)
+                                for (size_t b = 0; b < 4; ++b)
+                                    ignoredReplaceBytesRvas.erase(relativeAddressReplace.first + b);
+
+                            size_t replacedEndRva = replaceBytes.size();
+                            while (replacedEndRva > 0 && ignoredReplaceBytesRvas.count(replacedEndRva - 1) > 0)
+                                --replacedEndRva;
+                            patch.trampolineRva = 0;
+                            while (patch.trampolineRva < replacedEndRva && ignoredReplaceBytesRvas.count(patch.trampolineRva) > 0)
+                                ++patch.trampolineRva;
+
+                            uint8_t* movedInstructions = *searchResults.cbegin() + patch.trampolineRva;
+                            patch.trampolineSize = X86::getCoveringSize(movedInstructions, replacedEndRva - patch.trampolineRva);
+                            patch.trampolineBytes = X86::relocate(movedInstructions, patch.trampolineSize, patch.trampoline);
+                            auto jump = X86::makeJump(patch.trampoline + patch.trampolineBytes.size(), movedInstructions + patch.trampolineSize);
+                            patch.trampolineBytes.insert(patch.trampolineBytes.end(), jump.cbegin(), jump.cend());
+                        }
                     }
 
                     if (isSuccessfulPatchGroup)
                         // If all patches in the group can be patched, start saving the original bytes and patching!
                         for (auto& patch : patchGroup->second.patches)
                         {
-                            std::vector<uint8_t> replaceBytes;
-                            std::set<size_t> ignoredReplaceBytesRvas;
-                            if (patch.patch.getType() == Patch::Type::REPLACE_NAME)
+                            // Pointer patches just point every slot at the target
+                            if (isPointerPatch(patch.patch))
                             {
-                                replaceBytes = patch.patch.getTypeData<ReplaceNamePatch>().replaceBytes;
-                                ignoredReplaceBytesRvas = patch.patch.getTypeData<ReplaceNamePatch>().ignoredReplaceBytesRvas;
+                                for (auto& resultAndOriginalBytes : patch.resultsAndOriginalBytes)
+                                {
+                                    resultAndOriginalBytes.second.assign(resultAndOriginalBytes.first, resultAndOriginalBytes.first + sizeof(uint8_t*));
+                                    Memory::safeStorePointer((uint8_t**)resultAndOriginalBytes.first, patch.pointerTarget);
+                                    patch.resultsAndPatchedBytes[resultAndOriginalBytes.first].assign(resultAndOriginalBytes.first, resultAndOriginalBytes.first + sizeof(uint8_t*));
+                                }
+                                continue;
                             }
-                            else if (patch.patch.getType() == Patch::Type::REPLACE_SEARCH)
+
+                            std::vector<uint8_t> replaceBytes;
+                            std::set<size_t> ignoredReplaceBytesRvas;
+                            getReplaceBytes(patch.patch, replaceBytes, ignoredReplaceBytesRvas);
+
+                            // Nop out the rest of the last instruction a trampoline patch overwrites
+                            if (patch.trampoline != nullptr)
                             {
-                                replaceBytes = patch.patch.getTypeData<ReplaceSearchPatch>().replaceBytes;
-                                ignoredReplaceBytesRvas = patch.patch.getTypeData<ReplaceSearchPatch>().ignoredReplaceBytesRvas;
+                                size_t trampolineEndRva = patch.trampolineRva + patch.trampolineSize;
+                                if (replaceBytes.size() < trampolineEndRva)
+                                    replaceBytes.resize(trampolineEndRva, 0x90);
+                                for (size_t b = patch.trampolineRva; b < trampolineEndRva; ++b)
+                                    if (ignoredReplaceBytesRvas.erase(b) > 0)
+                                        replaceBytes[b] = 0x90;
                             }
-                            else
-                                assert(false);
 
                             for (auto& resultAndOriginalBytes : patch.resultsAndOriginalBytes)
                             {
+                                SharedPages::getSingleton().unshare(resultAndOriginalBytes.first, replaceBytes.size());
+
                                 // Check if the memory location is readable and writable (And make it so if not)
                                 bool isProtectionChanged = false;
                                 auto segments = Memory::queryPage(resultAndOriginalBytes.first, replaceBytes.size());
@@ -261,6 +596,10 @@ void Patcher::patcher_(Patcher* self)
                                 resultAndOriginalBytes.second.resize(replaceBytes.size());
                                 std::memcpy(&resultAndOriginalBytes.second[0], resultAndOriginalBytes.first, replaceBytes.size());
 
+                                // Move the overwritten instructions to the trampoline, followed by a jump back to after them
+                                if (patch.trampoline != nullptr)
+                                    Memory::safeCopy(patch.trampolineBytes, patch.trampoline);
+
                                 // Write the new bytes
                                 for (size_t b = 0; b < replaceBytes.size(); ++b)
                                 {
@@ -276,6 +615,7 @@ void Patcher::patcher_(Patcher* self)
                                         continue;
                                     resultAndOriginalBytes.first[b] = replaceBytes[b];
                                 }
+                                patch.resultsAndPatchedBytes[resultAndOriginalBytes.first].assign(resultAndOriginalBytes.first, resultAndOriginalBytes.first + replaceBytes.size());
 
                                 // Restore the page(s) protection if it was changed
                                 if (isProtectionChanged)
@@ -286,26 +626,45 @@ void Patcher::patcher_(Patcher* self)
                     else
                         // Otherwise, remove any results
                         for (auto& patch : patchGroup->second.patches)
+                        {
                             patch.resultsAndOriginalBytes.clear();
+                            patch.resultsAndPatchedBytes.clear();
+                        }
                 }
                 catch (...)
                 {
                     isSuccessfulPatchGroup = false;
                 }
 
-                // If the patch group wasn't successful, push it back on to the queue
+                // If the patch group wasn't successful, give back any caves and push it back on to the queue
                 if (!isSuccessfulPatchGroup)
+                {
+                    for (auto& patch : patchGroup->second.patches)
+                        if (patch.patch.getType() == Patch::Type::CAVE && patch.trampoline != nullptr)
+                        {
+                            CodeCaves::getSingleton().free(patch.trampoline);
+                            patch.trampoline = nullptr;
+                        }
                     self->patchGroupQueue_.push_back(patchGroup);
+                }
                 else
                 {
-                    // Otherwise, mark it as successful
+                    // Otherwise, mark it as successful, put its code back on huge pages and let other processes patched the same way share the rest
                     patchGroup->second.isPatchesSuccessful = true;
+                    for (const auto& patch : patchGroup->second.patches)
+                        if (!isPointerPatch(patch.patch))
+                            for (const auto& resultAndPatchedBytes : patch.resultsAndPatchedBytes)
+                            {
+                                HugePages::getSingleton().remap(getModuleName(patch.patch), resultAndPatchedBytes.first, resultAndPatchedBytes.second.size());
+                                SharedPages::getSingleton().share(getModuleName(patch.patch), resultAndPatchedBytes.first, resultAndPatchedBytes.second.size());
+                            }
                     if (patchGroup->second.patchGroupSuccessCallback != nullptr)
                         patchGroup->second.patchGroupSuccessCallback(patchGroup->first);
                     TRACE("Patch #" << patchGroup->first  << " success!");
                 }
             }
         }
+        HugePages::getSingleton().sampleCounters();
 
     #if !defined(_GLIBCXX_HAS_GTHREADS) && defined(_WIN32)
         win32::Sleep(100);
@@ -0,0 +1,219 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+#include <exception>
+#include <stdexcept>
+
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+
+#ifndef _WIN32
+namespace posix
+{
+    #include <unistd.h>
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+}
+#endif
+
+#include "SharedPages.h"
+#include "HugePages.h"
+#include "Core.h"
+#include "Memory.h"
+#include "Module.h"
+
+namespace
+{
+#ifndef _WIN32
+    int getProtection(const Memory::PageInfo& page)
+    {
+        return (page.isReadable ? PROT_READ : 0) | (page.isWritable ? PROT_WRITE : 0) | (page.isExecutable ? PROT_EXEC : 0);
+    }
+#endif
+}
+
+SharedPages& SharedPages::getSingleton()
+{
+    static SharedPages singleton;
+    return singleton;
+}
+
+void SharedPages::setPath(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    path_ = path;
+}
+
+void SharedPages::share(const std::string& moduleName, uint8_t* start, size_t size)
+{
+#ifdef _WIN32
+    (void)moduleName;
+    (void)start;
+    (void)size;
+#else
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (path_.empty() || size == 0)
+        return;
+    Module module;
+    std::string fingerprint;
+    try
+    {
+        module.open(moduleName);
+        fingerprint = module.getFingerprint();
+    }
+    catch (const std::exception& e)
+    {
+        return;
+    }
+
+    const size_t pageSize = Memory::getPageAlignment();
+    uint8_t* end = start + size;
+    Memory::alignPage((size_t&)start, (size_t&)end);
+    bool isShared = false;
+    for (uint8_t* page = start; page < end; page += pageSize)
+    {
+        if (sharedPages_.count(page) > 0 || HugePages::getSingleton().isRemapped(page))
+            continue;
+
+        // Only the module's code, as its data gets written to all the time
+        bool isCode = false;
+        for (const auto& segment : module.getOriginalSegments())
+            if (segment.isExecutable && !segment.isWritable && page >= segment.start && page + pageSize <= segment.start + segment.size)
+                isCode = true;
+        if (!isCode)
+            continue;
+        Memory::PageInfo pageInfo = Memory::queryPage(page, pageSize).front();
+        if (!pageInfo.isReadable || pageInfo.isWritable)
+            continue;
+
+        if (sharePage_(fingerprint, page - module.getBase(), page, getProtection(pageInfo)))
+        {
+            sharedPages_.insert(page);
+            isShared = true;
+        }
+    }
+    if (isShared)
+        reportSharedSize_();
+#endif
+}
+
+void SharedPages::unshare(uint8_t* start, size_t size)
+{
+#ifdef _WIN32
+    (void)start;
+    (void)size;
+#else
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (sharedPages_.empty() || size == 0)
+        return;
+
+    const size_t pageSize = Memory::getPageAlignment();
+    uint8_t* end = start + size;
+    Memory::alignPage((size_t&)start, (size_t&)end);
+    bool isUnshared = false;
+    for (auto page = sharedPages_.lower_bound(start); page != sharedPages_.end() && *page < end; )
+    {
+        // Fill a private copy before swapping it in, as the code on the page could be running
+        Memory::PageInfo pageInfo = Memory::queryPage(*page, pageSize).front();
+        uint8_t* copy = (uint8_t*)posix::mmap(nullptr, pageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (copy == MAP_FAILED)
+            throw std::runtime_error(strError(errno));
+        std::memcpy(copy, *page, pageSize);
+        if (posix::mprotect(copy, pageSize, getProtection(pageInfo)) != 0 ||
+            posix::mremap(copy, pageSize, pageSize, MREMAP_MAYMOVE | MREMAP_FIXED, *page) == MAP_FAILED)
+        {
+            int error = errno;
+            posix::munmap(copy, pageSize);
+            throw std::runtime_error(strError(error));
+        }
+        page = sharedPages_.erase(page);
+        isUnshared = true;
+    }
+    if (isUnshared)
+        reportSharedSize_();
+#endif
+}
+
+size_t SharedPages::getSharedSize() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return sharedPages_.size() * Memory::getPageAlignment();
+}
+
+// Private members
+
+bool SharedPages::sharePage_(const std::string& fingerprint, size_t rva, uint8_t* page, int protection)
+{
+#ifdef _WIN32
+    (void)fingerprint;
+    (void)rva;
+    (void)page;
+    (void)protection;
+    return false;
+#else
+    const size_t pageSize = Memory::getPageAlignment();
+    std::string pathfile = path_ + "/" + itos(calculateFnv1aHash((const uint8_t*)fingerprint.data(), fingerprint.size())) + "-" +
+        itos(rva) + "-" + itos(calculateFnv1aHash(page, pageSize));
+    int file = posix::open(pathfile.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    if (file == -1 && errno == ENOENT)
+    {
+        // Write it under another name first, so nobody ever maps half of it. Nobody can write to it once it's written.
+        std::string temporaryPathfile = pathfile + "." + itos(posix::getpid());
+        int temporaryFile = posix::open(temporaryPathfile.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC | O_NOFOLLOW, S_IRUSR | S_IRGRP | S_IROTH);
+        if (temporaryFile == -1)
+            return false;
+        bool isWritten = (size_t)posix::write(temporaryFile, page, pageSize) == pageSize;
+        if (posix::close(temporaryFile) != 0 || !isWritten || std::rename(temporaryPathfile.c_str(), pathfile.c_str()) != 0)
+        {
+            std::remove(temporaryPathfile.c_str());
+            return false;
+        }
+        file = posix::open(pathfile.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+    }
+    if (file == -1)
+        return false;
+
+    // The file stays mapped, so anyone who could write to it later could change the code or truncate it out from under
+    // every process sharing it. Only files nobody else can write to are used. The bytes are checked after mapping.
+    struct posix::stat fileInfo;
+    if (posix::fstat(file, &fileInfo) != 0 || !S_ISREG(fileInfo.st_mode) || fileInfo.st_uid != posix::geteuid() ||
+        (fileInfo.st_mode & (S_IWGRP | S_IWOTH)) != 0 || (size_t)fileInfo.st_size != pageSize)
+    {
+        posix::close(file);
+        return false;
+    }
+    uint8_t* mapping = (uint8_t*)posix::mmap(nullptr, pageSize, PROT_READ, MAP_SHARED, file, 0);
+    posix::close(file);
+    if (mapping == MAP_FAILED)
+        return false;
+    if (std::memcmp(mapping, page, pageSize) != 0 || posix::mprotect(mapping, pageSize, protection) != 0 ||
+        posix::mremap(mapping, pageSize, pageSize, MREMAP_MAYMOVE | MREMAP_FIXED, page) == MAP_FAILED)
+    {
+        posix::munmap(mapping, pageSize);
+        return false;
+    }
+    return true;
+#endif
+}
+
+void SharedPages::reportSharedSize_() const
+{
+    Core::getSingleton().sendMetric("SharedPages.sharedSize", sharedPages_.size() * Memory::getPageAlignment());
+}
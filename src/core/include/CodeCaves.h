@@ -0,0 +1,69 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef CODECAVES_H
+#define CODECAVES_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <mutex>
+#include <utility>
+
+#include <stdint.h>
+
+#include "Misc.h"
+
+// Pools of executable memory for small stubs, like the code of cave patches. Every module gets
+// its own pool, allocated near it, that grows a page at a time.
+class CORE_EXPORT CodeCaves final
+{
+    public:
+        uint8_t* allocate(size_t size, const std::string& moduleName); // Write to it with Memory::safeCopy()
+        void free(uint8_t* cave); // Only reused after two calls to releaseFreed(), as threads may still be running in it
+        void releaseFreed(); // Called once every patcher pass
+
+        static CodeCaves& getSingleton();
+
+    private:
+        CodeCaves() = default;
+        CodeCaves(const CodeCaves&) = delete;
+        CodeCaves& operator=(const CodeCaves&) = delete;
+        ~CodeCaves() = default; // Pages are never freed, as patched code might still jump into them
+
+        static const size_t caveAlignment_ = 16;
+
+        class Pool_ final
+        {
+            public:
+                Pool_(): next(nullptr), end(nullptr) {}
+
+                std::vector<std::pair<uint8_t*, size_t>> pages;
+                uint8_t* next; // Bump allocation from the end of the newest page
+                uint8_t* end;
+                std::map<size_t, std::vector<uint8_t*>> freeLists; // By size
+        };
+
+        std::mutex mutex_;
+        std::map<std::string, Pool_> pools_; // By module name
+        std::map<uint8_t*, std::pair<std::string, size_t>> allocations_; // Module name; Size
+        std::vector<std::pair<uint8_t*, std::pair<std::string, size_t>>> freed_; // Freed since the last release
+        std::vector<std::pair<uint8_t*, std::pair<std::string, size_t>>> releasable_; // Freed before the last release
+};
+
+#endif
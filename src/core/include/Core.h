@@ -36,6 +36,7 @@ class CORE_EXPORT Core final
 
         void sendPacket(const Socket::ClientOpCode opCode, const std::vector<uint8_t>& data) const;
         void sendCustomPacket(const size_t opCode, const std::vector<uint8_t>& data) const;
+        void sendMetric(const std::string& name, int64_t value) const; // The manager keeps the last value of each per core
 
         const std::string& getCoreName() const;
 
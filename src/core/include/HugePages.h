@@ -0,0 +1,72 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef HUGEPAGES_H
+#define HUGEPAGES_H
+
+#include <string>
+#include <set>
+#include <map>
+#include <chrono>
+#include <mutex>
+
+#include <stdint.h>
+
+#include "Misc.h"
+
+// Moves the code of patched modules onto 2 MB pages at the same addresses, as a large target's code
+// spread over 4 KB pages misses the iTLB a lot, and patching it undoes any huge pages it was given.
+// Writing to a huge page splits it back up, so whatever was written to has to be remapped again.
+class CORE_EXPORT HugePages final
+{
+    public:
+        void setEnabled(bool isEnabled);
+        // The first time a module is remapped all of its code is, after that only the code around the bytes
+        void remap(const std::string& moduleName, uint8_t* start, size_t size);
+        bool isRemapped(const uint8_t* address) const;
+        size_t getRemappedSize() const;
+        void sampleCounters(); // Reports the iTLB miss rate of up to `maxCounters_' threads if the performance counters can be read, at most every few seconds
+
+        static const size_t hugePageSize = 2 * 1024 * 1024;
+
+        static HugePages& getSingleton();
+
+    private:
+        HugePages();
+        HugePages(const HugePages&) = delete;
+        HugePages& operator=(const HugePages&) = delete;
+        ~HugePages();
+
+        static const size_t maxCounters_ = 16; // Each is a file descriptor of the target's
+
+        bool remapHugePage_(uint8_t* hugePage, int protection);
+        void openCounters_(); // For any threads that don't have one yet, while there's room
+        void closeCounters_();
+
+        mutable std::mutex mutex_;
+        bool isEnabled_;
+        std::set<uint8_t*> remappedModules_; // By base
+        std::set<uint8_t*> remappedHugePages_;
+
+        bool isCountersAvailable_;
+        std::map<int, std::pair<int, uint64_t>> counters_; // Counter and its last count by thread id
+        std::chrono::steady_clock::time_point lastSampleTime_;
+        double lastMissRate_; // Misses per second
+};
+
+#endif
@@ -21,7 +21,11 @@
 
 #include <string>
 #include <vector>
+#include <map>
+#include <set>
+#include <list>
 #include <utility>
+#include <atomic>
 
 #include "Misc.h"
 #include "Hook.h"
@@ -38,6 +42,9 @@ class CORE_EXPORT PatchLoader final
         bool isPatchPackLoaded(const std::string& name) const noexcept;
         bool isPatchPackEnabled(const std::string& name) const;
 
+        // Only has an effect on hooks the manager set to be thread filtered
+        void setHookEnabledForThisThread(const std::string& name, bool isEnabled);
+
         const std::vector<PatchData::Hook> getHooks() const;
         const PatchData::Hook& getHook(const std::string& name) const;
         const std::vector<PatchData::PatchPack> getPatchPacks() const;
@@ -57,6 +64,11 @@ class CORE_EXPORT PatchLoader final
         static void patchPackRemoveReceiveHandler_(const std::vector<uint8_t>& data);
         static void patchLibraryLoadReceiveHandler_(const std::vector<uint8_t>& data);
         static void patchLibraryUnloadReceiveHandler_(const std::vector<uint8_t>& data);
+        static void resolutionCacheReceiveHandler_(const std::vector<uint8_t>& data);
+        static void resolutionReceiveHandler_(const std::vector<uint8_t>& data);
+        static void bakeManifestReceiveHandler_(const std::vector<uint8_t>& data);
+        static void sharedPagesReceiveHandler_(const std::vector<uint8_t>& data);
+        static void hugePagesReceiveHandler_(const std::vector<uint8_t>& data);
 
         std::vector<std::pair<PatchData::Hook, Patcher::PatchGroupId>>::const_iterator getIteratorToHookNoThrow_(const std::string& name) const noexcept;
         std::vector<std::pair<PatchData::Hook, Patcher::PatchGroupId>>::const_iterator getIteratorToHook_(const std::string& name) const;
@@ -71,6 +83,9 @@ class CORE_EXPORT PatchLoader final
 
         void applyHook_(std::pair<PatchData::Hook, Patcher::PatchGroupId>& hook);
         void unapplyHook_(std::pair<PatchData::Hook, Patcher::PatchGroupId>& hook);
+        bool isHookUsed_(const std::string& name) const;
+        bool isPatchPackBaked_(const PatchData::PatchPack& patchPack) const;
+        void unapplyUnusedHooks_(const PatchData::PatchPack& patchPack);
 
         void addPatchPack_(const PatchData::PatchPack& patchPack);
         std::vector<std::pair<PatchData::PatchPack, Patcher::PatchGroupId>>::iterator removePatchPack_(std::vector<std::pair<PatchData::PatchPack, Patcher::PatchGroupId>>::iterator patchPack);
@@ -78,6 +93,10 @@ class CORE_EXPORT PatchLoader final
 
         void enablePatchPack_(std::pair<PatchData::PatchPack, Patcher::PatchGroupId>& patchPack);
         void disablePatchPack_(std::pair<PatchData::PatchPack, Patcher::PatchGroupId>& patchPack);
+        void addHookPatchFunctions_(std::pair<PatchData::PatchPack, Patcher::PatchGroupId>& patchPack);
+        void removeHookPatchFunctions_(std::pair<PatchData::PatchPack, Patcher::PatchGroupId>& patchPack);
+        void updateDirectHookPatch_(const std::string& hookName, const std::map<hookPatchFunction_t, ExtraSettings>& hookPatchFunctions);
+        void setPatchPackExtraSettings_(std::pair<PatchData::PatchPack, Patcher::PatchGroupId>& patchPack, const ExtraSettings& extraSettings);
 
         static std::string getHookSafename(const std::string& name);
         static std::string getPatchPackSafename(const std::string& name);
@@ -85,10 +104,14 @@ class CORE_EXPORT PatchLoader final
         Module patcherLibrary_;
         using hookPatchFunctions_t = std::map<hookPatchFunction_t, ExtraSettings>;
         using hookPatchFunctionsMutex_t = std::recursive_mutex;
-        std::map<std::vector<std::pair<PatchData::Hook, Patcher::PatchGroupId>>::iterator, hookPatchFunctions_t> savedPatcherLibraryState_;
+        using hookPatchFunctionsCount_t = std::atomic<uint32_t>;
+        using directHookPatch_t = std::atomic<const hookPatchFunctions_t::value_type*>;
 
         std::vector<std::pair<PatchData::Hook, Patcher::PatchGroupId>> hooks_;
+        std::map<std::string, std::vector<std::set<uint8_t*>>> hookSearchResults_; // Where uninstalled hooks were found
         std::vector<std::pair<PatchData::PatchPack, Patcher::PatchGroupId>> patchPacks_;
+        std::map<std::string, uint64_t> bakedPatchPacks_; // Already patched in the files of the modules they patch. By name, to the hash of their patches when baked.
+        std::list<std::pair<const hookPatchFunction_t, ExtraSettings>> directHookPatches_; // Kept until the library is unloaded, since hooks may still be calling through them
 };
 
 /* TODO list:
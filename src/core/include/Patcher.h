@@ -24,11 +24,13 @@
 #include <vector>
 #include <map>
 #include <list>
+#include <set>
 #include <utility>
 
 #include <ctime>
 
 #include "Patch.h"
+#include "ResolutionCache.h"
 #include <mutex>
 
 #ifdef _WIN32
@@ -52,8 +54,16 @@ class CORE_EXPORT Patcher final
         PatchGroupId addToQueue(const std::vector<std::pair<PatchData::Patch, std::map<size_t, uint8_t*>>>& patchGroup,
                                 std::time_t secondsToTry = -1,
                                 patchGroupCallback_t patchGroupFailureCallback = nullptr,
-                                patchGroupCallback_t patchGroupSuccessCallback = nullptr);
+                                patchGroupCallback_t patchGroupSuccessCallback = nullptr,
+                                const std::vector<std::set<uint8_t*>>& knownSearchResults = {}, // One set per patch, used instead of searching if they still match
+                                const std::map<size_t, uint8_t*>& trampolines = {}); // Patch index to where the instructions it overwrites get relocated, followed by a jump back
         void undoPatchGroup(PatchGroupId id);
+        // Swaps a patched group's original bytes back in, or its patched bytes back out, without searching again.
+        // Returns false if the group isn't patched yet.
+        bool setPatchGroupEnabled(PatchGroupId id, bool isEnabled);
+        std::vector<std::set<uint8_t*>> getPatchGroupSearchResults(PatchGroupId id); // Empty if not patched yet
+        void openResolutionCache(const std::string& pathfile); // Where searches are looked up before scanning for them
+        void addSharedResolution(const std::string& moduleFingerprint, uint64_t searchHash, const std::vector<size_t>& rvas); // Found by another core
 
         static Patcher& getSingleton();
 
@@ -74,6 +84,7 @@ class CORE_EXPORT Patcher final
         bool isRunning_;
 
         PatchGroupId getNextAvailablePatchGroupId_() const;
+        std::set<uint8_t*> doCachedSearch_(const PatchData::Search& search);
 
         class PatchGroup
         {
@@ -83,7 +94,14 @@ class CORE_EXPORT Patcher final
                     public:
                         PatchData::Patch patch;
                         std::map<size_t, uint8_t*> relativeAddressReplaces;
+                        std::set<uint8_t*> knownSearchResults;
+                        uint8_t* trampoline;
+                        size_t trampolineRva; // Start and size of the overwritten instructions
+                        size_t trampolineSize;
+                        std::vector<uint8_t> trampolineBytes;
+                        uint8_t* pointerTarget; // For import and vtable slot patches
                         std::map<uint8_t*, std::vector<uint8_t>> resultsAndOriginalBytes;
+                        std::map<uint8_t*, std::vector<uint8_t>> resultsAndPatchedBytes;
                 };
                 std::vector<Patch> patches;
 
@@ -93,10 +111,13 @@ class CORE_EXPORT Patcher final
                 patchGroupCallback_t patchGroupSuccessCallback;
                 bool isTimedOut;
                 bool isPatchesSuccessful;
+                bool isEnabled;
         };
         std::map<PatchGroupId, PatchGroup> patchGroups_;
         std::list<std::map<PatchGroupId, PatchGroup>::iterator> patchGroupQueue_;
         std::recursive_mutex patchGroupsMutex_; // FIXME: Should be just a regular mutex
+        ResolutionCache resolutionCache_; // Guarded by `patchGroupsMutex_'
+        std::map<std::pair<uint64_t, uint64_t>, std::vector<size_t>> sharedResolutions_; // By module fingerprint and search hash hashes. Guarded by `patchGroupsMutex_'.
 };
 
 #endif
@@ -0,0 +1,59 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef SHAREDPAGES_H
+#define SHAREDPAGES_H
+
+#include <string>
+#include <set>
+#include <mutex>
+
+#include <stdint.h>
+
+#include "Misc.h"
+
+// Swaps the copy-on-write copies of patched code pages for read-only mappings of files with the same
+// bytes, named by module fingerprint, RVA and hash, so every process patched the same way shares one
+// copy of each page. Whoever patches a page first writes its file, read-only. Everyone checks it before
+// mapping, and only maps files that they own and nobody else can write to. The manager removes the
+// files once its last core is gone.
+class CORE_EXPORT SharedPages final
+{
+    public:
+        void setPath(const std::string& path); // Where the page files are kept. Blank stops any more pages being shared.
+        void share(const std::string& moduleName, uint8_t* start, size_t size); // Only pages in the module's executable segments, and not on huge pages, are shared
+        void unshare(uint8_t* start, size_t size); // Has to be done before writing to the pages
+        size_t getSharedSize() const; // How much private memory sharing has given back
+
+        static SharedPages& getSingleton();
+
+    private:
+        SharedPages() = default;
+        SharedPages(const SharedPages&) = delete;
+        SharedPages& operator=(const SharedPages&) = delete;
+        ~SharedPages() = default;
+
+        bool sharePage_(const std::string& fingerprint, size_t rva, uint8_t* page, int protection);
+        void reportSharedSize_() const;
+
+        mutable std::mutex mutex_;
+        std::string path_;
+        std::set<uint8_t*> sharedPages_;
+};
+
+#endif
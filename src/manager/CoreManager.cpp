@@ -49,6 +49,7 @@ namespace posix
     //#include <sys/select.h> // Can't seem to put select.h in a namespace because of standard headers including it
     #include <netinet/in.h>
     #include <signal.h>
+    #include <dirent.h>
 
     using ::strdup; // POSIX function that lives in string.h
 }
@@ -140,6 +141,8 @@ CoreManager::CoreManager()
 #endif
     initQuitSockets_();
     addReceiveHandler(Socket::ClientOpCode::LOG, logReceiveHandler_);
+    addReceiveHandler(Socket::ClientOpCode::RESOLUTION, resolutionReceiveHandler_);
+    addReceiveHandler(Socket::ClientOpCode::METRIC, metricReceiveHandler_);
 }
 
 CoreManager::~CoreManager()
@@ -214,6 +217,15 @@ std::vector<CoreManager::CoreId> CoreManager::getConnectedCores() const
     return result;
 }
 
+std::map<std::string, int64_t> CoreManager::getCoreMetrics(const CoreId coreId) const
+{
+    std::lock_guard<std::mutex> coreMetricsLock(coreMetricsMutex_);
+    auto coreMetrics = coreMetrics_.find(coreId);
+    if (coreMetrics == coreMetrics_.end())
+        return {};
+    return coreMetrics->second;
+}
+
 void CoreManager::addReceiveHandler(const Socket::ClientOpCode opCode, receiveHandler_t receiveHandler)
 {
     std::lock_guard<std::recursive_mutex> receiveHandlersLock(receiveHandlersMutex_);
@@ -483,6 +495,10 @@ CoreManager::CoreId CoreManager::finishConnectCore_(ProcessId pid, Socket::Socke
     std::lock_guard<std::recursive_mutex> coresLock(coresMutex_);
     CoreId coreId = getNextAvailableCoreId_();
     cores_[coreId] = std::make_pair(pid, coreConnection);
+    {
+        std::lock_guard<std::mutex> coreMetricsLock(coreMetricsMutex_);
+        coreMetrics_.erase(coreId); // Left over from an earlier core with the same id
+    }
 
     // Start the listener thread if it isn't running, or notify of new core if it is
     if (cores_.size() == 1)
@@ -497,10 +513,48 @@ CoreManager::CoreId CoreManager::finishConnectCore_(ProcessId pid, Socket::Socke
         send(listenerThreadClientSocket_, (char*)&notify, sizeof(CoreId), 0);
     }
 
-    // Give information to the core
-    PluginManager::getSingleton().updateCoreAboutAll(coreId);
-    PatchManager::getSingleton().updateCoreAboutAllHooks(coreId);
-    PatchManager::getSingleton().updateCoreAboutAllPatchPacks(coreId);
+    // Give information to the core, starting with where it can find what other cores already searched for
+    std::string resolutionCacheFile = SettingsManager::getSingleton().get("CoreManager.resolutionCacheFile");
+    if (!resolutionCacheFile.empty())
+    {
+        std::vector<uint8_t> data;
+        serialiseIntegralTypeContinuousContainer(data, resolutionCacheFile);
+        sendPacketTo(coreId, Socket::ServerOpCode::RESOLUTION_CACHE, data);
+    }
+    {
+        std::lock_guard<std::mutex> resolutionsLock(resolutionsMutex_);
+        for (const auto& resolution : resolutions_)
+        {
+            std::vector<uint8_t> data;
+            serialiseIntegralTypeContinuousContainer(data, resolution.first.first);
+            serialiseIntegralType(data, resolution.first.second);
+            serialiseIntegralTypeContinuousContainer(data, resolution.second);
+            sendPacketTo(coreId, Socket::ServerOpCode::RESOLUTION, data);
+        }
+    }
+    std::string bakeManifestFile = SettingsManager::getSingleton().get("CoreManager.bakeManifestFile");
+    if (!bakeManifestFile.empty())
+    {
+        std::vector<uint8_t> data;
+        serialiseIntegralTypeContinuousContainer(data, bakeManifestFile);
+        sendPacketTo(coreId, Socket::ServerOpCode::BAKE_MANIFEST, data);
+    }
+    std::string sharedPagesPath = SettingsManager::getSingleton().get("CoreManager.sharedPagesPath");
+    if (!sharedPagesPath.empty())
+    {
+        std::vector<uint8_t> data;
+        serialiseIntegralTypeContinuousContainer(data, sharedPagesPath);
+        sendPacketTo(coreId, Socket::ServerOpCode::SHARED_PAGES, data);
+    }
+    if (std::stoi("0" + SettingsManager::getSingleton().get("CoreManager.isHugePagesEnabled")) != 0)
+        sendPacketTo(coreId, Socket::ServerOpCode::HUGE_PAGES, {});
+    {
+        // One compile and one PATCH_LIB_LOAD for everything the new core needs
+        PatchManager::Batch batch;
+        PluginManager::getSingleton().updateCoreAboutAll(coreId);
+        PatchManager::getSingleton().updateCoreAboutAllHooks(coreId);
+        PatchManager::getSingleton().updateCoreAboutAllPatchPacks(coreId);
+    }
 
 #ifdef _WIN32
     TRACE("Resuming main thread...");
@@ -526,6 +580,63 @@ void CoreManager::logReceiveHandler_(CoreId coreId, const std::vector<uint8_t>&
     Logger::getSingleton().write(severity, message);
 }
 
+void CoreManager::resolutionReceiveHandler_(CoreId coreId, const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+    std::string moduleFingerprint = deserialiseIntegralTypeContinuousContainer<std::string>(iterator);
+    uint64_t searchHash = deserialiseIntegralType<uint64_t>(iterator);
+    std::vector<size_t> rvas = deserialiseIntegralTypeContinuousContainer<std::vector<size_t>>(iterator);
+
+    // Pass it on to the other cores, which check it against their own modules before using it
+    CoreManager& coreManager = getSingleton();
+    {
+        std::lock_guard<std::mutex> resolutionsLock(coreManager.resolutionsMutex_);
+        auto& resolution = coreManager.resolutions_[std::make_pair(moduleFingerprint, searchHash)];
+        if (resolution == rvas)
+            return;
+        resolution = rvas;
+    }
+    std::lock_guard<std::recursive_mutex> coresLock(coreManager.coresMutex_);
+    for (const auto& core : coreManager.cores_)
+        if (core.first != coreId)
+            coreManager.sendPacketTo(core.first, Socket::ServerOpCode::RESOLUTION, data);
+}
+
+void CoreManager::metricReceiveHandler_(CoreId coreId, const std::vector<uint8_t>& data)
+{
+    auto iterator = data.cbegin();
+    std::string name = deserialiseIntegralTypeContinuousContainer<std::string>(iterator);
+    int64_t value = deserialiseIntegralType<int64_t>(iterator);
+
+    CoreManager& coreManager = getSingleton();
+    std::lock_guard<std::mutex> coreMetricsLock(coreManager.coreMetricsMutex_);
+    coreManager.coreMetrics_[coreId][name] = value;
+}
+
+void CoreManager::removeSharedPageFiles_()
+{
+#ifndef _WIN32
+    // Processes still running keep the pages they mapped, so the files are only needed to share with new ones
+    std::string sharedPagesPath = SettingsManager::getSingleton().get("CoreManager.sharedPagesPath");
+    if (sharedPagesPath.empty())
+        return;
+    posix::DIR* sharedPagesDirectory = posix::opendir(sharedPagesPath.c_str());
+    if (sharedPagesDirectory == nullptr)
+        return;
+    posix::dirent* sharedPagesFile;
+    while ((sharedPagesFile = posix::readdir(sharedPagesDirectory)) != nullptr)
+    {
+        // Only names like the cores give them, "[fingerprint hash]-[rva]-[page hash]" and a ".[pid]" while being written
+        std::string sharedPagesFilename = sharedPagesFile->d_name;
+        if (sharedPagesFilename.empty() || std::count(sharedPagesFilename.begin(), sharedPagesFilename.end(), '-') != 2 ||
+            sharedPagesFilename.find_first_not_of("0123456789-.") != std::string::npos)
+            continue;
+        posix::unlink((sharedPagesPath + "/" + sharedPagesFilename).c_str());
+    }
+    posix::closedir(sharedPagesDirectory);
+#endif
+}
+
 void CoreManager::coreListener_(CoreManager* self)
 {
     while (true)
@@ -533,7 +644,10 @@ void CoreManager::coreListener_(CoreManager* self)
         {
             std::lock_guard<std::recursive_mutex> coresLock(self->coresMutex_);
             if (self->cores_.empty())
+            {
+                removeSharedPageFiles_();
                 break;
+            }
         }
         fd_set listenOn;
         FD_ZERO(&listenOn);
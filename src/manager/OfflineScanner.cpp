@@ -0,0 +1,219 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <set>
+#include <functional>
+#include <exception>
+#include <stdexcept>
+
+#include "OfflineScanner.h"
+#include "PatchManager.h"
+#include "ElfImage.h"
+#include "ResolutionCache.h"
+
+using namespace PatchData;
+
+namespace
+{
+    // Looks through the special searches, and the ones they and anchor searches have themselves
+    bool hasSpecialSearchOf(const Search& search, const std::function<bool(const SpecialSearch&)>& isMatch)
+    {
+        for (const auto& specialSearch : search.specialSearches)
+        {
+            if (isMatch(specialSearch))
+                return true;
+            const Search* nestedSearch = nullptr;
+            switch (specialSearch.getType())
+            {
+                case SpecialSearch::Type::UNNAMED_RELATIVE_FUNCTION_CALL :
+                    nestedSearch = &specialSearch.getTypeData<UnnamedRelativeFunctionCallSpecialSearch>();
+                    break;
+
+                case SpecialSearch::Type::UNNAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL :
+                    nestedSearch = &specialSearch.getTypeData<UnnamedAbsoluteIndirectFunctionCallSpecialSearch>();
+                    break;
+
+                case SpecialSearch::Type::DATA_POINTER :
+                    nestedSearch = &specialSearch.getTypeData<DataPointerSpecialSearch>();
+                    break;
+
+                default:
+                    break;
+            }
+            if (nestedSearch != nullptr && hasSpecialSearchOf(*nestedSearch, isMatch))
+                return true;
+        }
+        for (const auto& anchorSearch : search.anchorSearches)
+            if (hasSpecialSearchOf(*anchorSearch, isMatch))
+                return true;
+        return false;
+    }
+
+    bool hasSpecialSearchOf(const Search& search, const std::set<SpecialSearch::Type>& types)
+    {
+        return hasSpecialSearchOf(search, [&types](const SpecialSearch& specialSearch) { return types.count(specialSearch.getType()) > 0; });
+    }
+}
+
+void OfflineScanner::addModule(const std::string& moduleName, const std::string& pathfile)
+{
+    modulePathfiles_[moduleName] = pathfile;
+}
+
+void OfflineScanner::addHook(const Hook& hook)
+{
+    const std::string description = "Hook \"" + hook.name + "\"";
+    switch (hook.getType())
+    {
+        case Hook::Type::NAME :
+            searches_.push_back(std::make_pair(description, std::make_shared<NameSearch>(hook.getTypeData<NameHook>())));
+            break;
+
+        case Hook::Type::SEARCH :
+            searches_.push_back(std::make_pair(description, std::make_shared<Search>(hook.getTypeData<SearchHook>())));
+            break;
+
+        case Hook::Type::FUNCTION :
+            searches_.push_back(std::make_pair(description, std::make_shared<NameSearch>(hook.getTypeData<FunctionHook>())));
+            break;
+
+        case Hook::Type::INSTRUCTION :
+            searches_.push_back(std::make_pair(description, std::make_shared<InstructionSearch>(hook.getTypeData<InstructionHook>())));
+            break;
+
+        default: // Imports are just looked up, and calls are only found in the running process
+            break;
+    }
+}
+
+void OfflineScanner::addPatchPack(const PatchPack& patchPack)
+{
+    for (size_t p = 0; p < patchPack.patches.size(); ++p)
+    {
+        const Patch& patch = patchPack.patches[p];
+        const std::string description = "Patch " + itos(p) + " of patch pack \"" + patchPack.info.name + "\"";
+        switch (patch.getType())
+        {
+            case Patch::Type::REPLACE_NAME :
+                searches_.push_back(std::make_pair(description, std::make_shared<NameSearch>(patch.getTypeData<ReplaceNamePatch>())));
+                break;
+
+            case Patch::Type::REPLACE_SEARCH :
+                searches_.push_back(std::make_pair(description, std::make_shared<Search>(patch.getTypeData<ReplaceSearchPatch>())));
+                break;
+
+            case Patch::Type::CAVE :
+                searches_.push_back(std::make_pair(description, std::make_shared<Search>(patch.getTypeData<CavePatch>())));
+                break;
+
+            case Patch::Type::REPLACE_INSTRUCTIONS :
+                searches_.push_back(std::make_pair(description, std::make_shared<InstructionSearch>(patch.getTypeData<ReplaceInstructionsPatch>())));
+                break;
+
+            default: // Hook patches are searched for with their hook, imports and vtables are just looked up, and calls are only found in the running process
+                break;
+        }
+    }
+}
+
+void OfflineScanner::addFromPatchManager()
+{
+    const PatchManager& patchManager = PatchManager::getSingleton();
+    for (const auto& hook : patchManager.getHooks())
+        addHook(hook);
+    for (const auto& patchPack : patchManager.getPatchPacks())
+        addPatchPack(patchPack);
+}
+
+std::vector<std::string> OfflineScanner::writePlan(const std::string& planPathfile) const
+{
+    ResolutionCache plan;
+    plan.open(planPathfile);
+    std::vector<std::string> problems;
+    std::map<std::string, std::unique_ptr<ElfImage>> images; // By module name
+    for (const auto& search : searches_)
+    {
+        auto modulePathfile = modulePathfiles_.find(search.second->moduleName);
+        if (modulePathfile == modulePathfiles_.end())
+        {
+            problems.push_back(search.first + ": No file was given for module \"" + search.second->moduleName + "\".");
+            continue;
+        }
+
+        // Named special searches need the modules they name loaded, so only a core can check them. So do strings addressed from a module's GOT.
+        if (hasSpecialSearchOf(*search.second, {SpecialSearch::Type::NAMED_RELATIVE_FUNCTION_CALL, SpecialSearch::Type::NAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL}))
+        {
+            problems.push_back(search.first + ": Searches with named special searches can only be resolved by the cores.");
+            continue;
+        }
+        if (hasSpecialSearchOf(*search.second, [](const SpecialSearch& specialSearch)
+            {
+                return specialSearch.getType() == SpecialSearch::Type::STRING_REFERENCE &&
+                    specialSearch.getTypeData<StringReferenceSpecialSearch>().isGotRelative;
+            }))
+        {
+            problems.push_back(search.first + ": Searches with GOT-relative string reference special searches can only be resolved by the cores.");
+            continue;
+        }
+
+        auto& image = images[search.second->moduleName];
+        try
+        {
+            if (image == nullptr)
+            {
+                image.reset(new ElfImage());
+                image->open(modulePathfile->second);
+            }
+            else if (!image->getIsOpen())
+                continue; // Its problem was already given
+        }
+        catch (const std::exception& e)
+        {
+            problems.push_back("\"" + modulePathfile->second + "\": " + e.what());
+            continue;
+        }
+        if (!image->getIsRelocated() &&
+            hasSpecialSearchOf(*search.second, {SpecialSearch::Type::UNNAMED_ABSOLUTE_INDIRECT_FUNCTION_CALL, SpecialSearch::Type::DATA_POINTER,
+                                               SpecialSearch::Type::STRING_REFERENCE}))
+        {
+            problems.push_back(search.first + ": \"" + modulePathfile->second + "\" couldn't be put where it was linked to follow its pointers.");
+            continue;
+        }
+
+        std::set<size_t> results;
+        try
+        {
+            results = search.second->doImageSearch(*image);
+        }
+        catch (const std::exception& e)
+        {
+            problems.push_back(search.first + ": " + e.what());
+            continue;
+        }
+        if (results.empty())
+            problems.push_back(search.first + ": Not found in \"" + modulePathfile->second + "\".");
+        else if (results.size() > ResolutionCache::maxRvas)
+            problems.push_back(search.first + ": Found " + itos(results.size()) + " times in \"" + modulePathfile->second + "\", which is too many to store.");
+        else
+        {
+            std::string fingerprint = image->getFingerprint();
+            plan.store(calculateFnv1aHash((const uint8_t*)fingerprint.data(), fingerprint.size()), search.second->getHash(),
+                std::vector<size_t>(results.cbegin(), results.cend()));
+        }
+    }
+    return problems;
+}
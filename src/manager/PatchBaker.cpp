@@ -0,0 +1,129 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <stdexcept>
+
+#include <cerrno>
+
+#ifndef _WIN32
+namespace posix
+{
+    #include <sys/stat.h>
+}
+#endif
+
+#include "PatchBaker.h"
+#include "ElfImage.h"
+
+using namespace PatchData;
+
+namespace PatchBaker
+{
+
+void bake(const PatchPack& patchPack, const std::string& moduleName, const std::string& pathfile,
+    const std::string& bakedPathfile, const std::string& manifestPathfile)
+{
+    ElfImage image;
+    image.open(pathfile);
+    std::vector<uint8_t> data = readFile(pathfile);
+
+    // Find every patch before changing anything, the same as the cores do
+    BakeManifest bakeManifest;
+    bakeManifest.patchPackName = patchPack.info.name;
+    bakeManifest.patchesHash = BakeManifest::getPatchesHash(patchPack);
+    bakeManifest.moduleName = moduleName;
+    for (const auto& patch : patchPack.patches)
+    {
+        const Search* search;
+        const std::vector<uint8_t>* replaceBytes;
+        const std::set<size_t>* ignoredReplaceBytesRvas;
+        if (patch.getType() == Patch::Type::REPLACE_NAME)
+        {
+            search = &patch.getTypeData<ReplaceNamePatch>();
+            replaceBytes = &patch.getTypeData<ReplaceNamePatch>().replaceBytes;
+            ignoredReplaceBytesRvas = &patch.getTypeData<ReplaceNamePatch>().ignoredReplaceBytesRvas;
+        }
+        else if (patch.getType() == Patch::Type::REPLACE_SEARCH)
+        {
+            search = &patch.getTypeData<ReplaceSearchPatch>();
+            replaceBytes = &patch.getTypeData<ReplaceSearchPatch>().replaceBytes;
+            ignoredReplaceBytesRvas = &patch.getTypeData<ReplaceSearchPatch>().ignoredReplaceBytesRvas;
+        }
+        else if (patch.getType() == Patch::Type::REPLACE_INSTRUCTIONS)
+        {
+            search = &patch.getTypeData<ReplaceInstructionsPatch>();
+            replaceBytes = &patch.getTypeData<ReplaceInstructionsPatch>().replaceBytes;
+            ignoredReplaceBytesRvas = &patch.getTypeData<ReplaceInstructionsPatch>().ignoredReplaceBytesRvas;
+        }
+        else
+            throw std::logic_error("Only replace name, replace search and replace instructions patches can be baked.");
+        if (search->moduleName != moduleName)
+            throw std::logic_error("Every patch has to be in `" + moduleName + "' to be baked in to it.");
+
+        std::set<size_t> results = search->doImageSearch(image);
+        if (results.empty())
+            throw std::runtime_error("A patch of patch pack `" + patchPack.info.name + "' wasn't found in `" + pathfile + "'.");
+        for (const auto& result : results)
+        {
+            BakedPatch bakedPatch;
+            bakedPatch.rva = result;
+            size_t offset = image.getFileOffset(result, replaceBytes->size());
+            bakedPatch.originalBytes.assign(data.cbegin() + offset, data.cbegin() + offset + replaceBytes->size());
+            bakedPatch.patchedBytes = bakedPatch.originalBytes;
+            for (size_t b = 0; b < replaceBytes->size(); ++b)
+                if (ignoredReplaceBytesRvas->count(b) == 0)
+                    bakedPatch.patchedBytes[b] = (*replaceBytes)[b];
+            bakeManifest.bakedPatches.push_back(bakedPatch);
+        }
+    }
+    for (const auto& bakedPatch : bakeManifest.bakedPatches)
+        std::copy(bakedPatch.patchedBytes.cbegin(), bakedPatch.patchedBytes.cend(),
+            data.begin() + image.getFileOffset(bakedPatch.rva, bakedPatch.patchedBytes.size()));
+    writeFile(bakedPathfile, data);
+#ifndef _WIN32
+    struct posix::stat fileInfo;
+    if (posix::stat(pathfile.c_str(), &fileInfo) == -1 || posix::chmod(bakedPathfile.c_str(), fileInfo.st_mode & 07777) == -1)
+        throw std::runtime_error(strError(errno));
+#endif
+    ElfImage bakedImage;
+    bakedImage.open(bakedPathfile);
+    bakeManifest.moduleFingerprint = bakedImage.getFingerprint();
+
+    // Replace the manifest from any earlier bake of the same patch pack in to the same module
+    std::vector<BakeManifest> bakeManifests;
+    uint64_t inode, deviceId;
+    if (getInodeAndDeviceId(manifestPathfile, inode, deviceId))
+    {
+        std::vector<uint8_t> manifestData = readFile(manifestPathfile);
+        auto iterator = manifestData.cbegin();
+        deserialiseDeserialisableTypeContainer(iterator, bakeManifests);
+    }
+    bakeManifests.erase(std::remove_if(bakeManifests.begin(), bakeManifests.end(),
+        [&bakeManifest](const BakeManifest& oldBakeManifest) -> bool
+        {
+            return oldBakeManifest.patchPackName == bakeManifest.patchPackName && oldBakeManifest.moduleName == bakeManifest.moduleName;
+        }), bakeManifests.end());
+    bakeManifests.push_back(bakeManifest);
+    std::vector<uint8_t> manifestData;
+    serialiseSerialisableTypeContainer(manifestData, bakeManifests);
+    writeFile(manifestPathfile, manifestData);
+}
+
+}
@@ -18,10 +18,13 @@
 #include <string>
 #include <vector>
 #include <set>
+#include <map>
+#include <algorithm>
 
 #include <cstdio>
 #include <cstring>
 #include <cerrno>
+#include <cassert>
 
 #ifdef _WIN32
 namespace win32
@@ -58,6 +61,7 @@ namespace posix
 #include "PluginManager.h"
 #include "SettingsManager.h"
 #include "Misc.h"
+#include "X86.h"
 
 namespace PatchCompiler
 {
@@ -71,11 +75,23 @@ namespace
     std::string getPatchPackSafename(const std::string& name);
     std::string getExternCAsmName(const std::string& name);
 
-    std::string generateHookSource(const Hook& hook);
-    std::string generatePatchPackSource(const PatchPack& patchPack);
+    std::string compileSpecialisedHook(const Hook& hook, uint8_t usedRegisters, bool& isSkipped, bool force);
+    std::string generateHookSource(const Hook& hook, uint8_t usedRegisters);
+    std::string generateTrampolineSource(const Hook& hook, size_t size);
+    std::string generateFunctionHookSource(const Hook& hook, bool isFiltered);
+    std::string generatePatchPackSource(const PatchPack& patchPack, const std::vector<Hook>& hooks);
+    const FunctionSignature* getFunctionSignature(const Hook& hook);
+    std::string getCallingConventionAttribute(FunctionSignature::CallingConvention callingConvention);
+    std::string generateFunctionHookTypes(const Hook& hook);
+    std::string generateFunctionHookPatchParameters(const Hook& hook);
     std::string getLicense();
     std::string generatePrettyLicense();
 
+    std::vector<std::string> getObjectFilenames(const std::vector<std::string>& hookNames, const std::vector<std::string>& patchPackNames);
+    std::string getPatchesFilename();
+    uint32_t getObjectFilenamesCrc32(std::vector<std::string> objectFilenames);
+    bool isObjectFilesLinkNeeded(const std::vector<std::string>& objectFilenames);
+    std::string linkObjectFiles(const std::vector<std::string>& objectFilenames, bool force);
     std::string callGCC(const std::string& args);
     std::string getObjectDirectory();
     std::string getCXXFLAGS();
@@ -86,42 +102,31 @@ namespace
 
 std::string compileHook(const Hook& hook, bool& isSkipped, bool force)
 {
-    isSkipped = false;
-    std::string source = generateHookSource(hook);
-    uint32_t crc32 = calculateCrc32Checksum(std::vector<uint8_t>(source.begin(), source.end()));
-    std::string objectFilename = getObjectDirectory() + getHookSafename(hook.name) + ".o";
-    if (!force && crc32 == std::stoul("0" + SettingsManager::getSingleton().get("hooks." + hook.name + ".crc32")))
-    {
-        // Check if the compiled object exists before we skip
-        std::FILE* objectFile = std::fopen(objectFilename.c_str(), "rb");
-        if (objectFile != nullptr)
-        {
-            std::fclose(objectFile);
-            isSkipped = true;
-            return "";
-        }
-    }
-
-    // Write the generated source to a file
-    std::string sourceFilename = getObjectDirectory() + getHookSafename(hook.name) + ".cpp";
-    std::FILE* sourceFile = std::fopen(sourceFilename.c_str(), "wb");
-    std::fwrite(source.c_str(), 1, source.size(), sourceFile);
-    std::fclose(sourceFile);
-
-    // Compile the source
-    std::string output = callGCC("\"" + sourceFilename + "\" -c -o \"" + objectFilename + "\" " + getCXXFLAGS() + " " + getCustomCXXFLAGS());
+    // Without knowing the hook patches, every register has to be saved
+    return compileSpecialisedHook(hook, UsedRegisters::ALL, isSkipped, force);
+}
 
-    // Touch a file so `linkObjects()' knows to relink
-    std::fclose(std::fopen((getObjectDirectory() + "modified").c_str(), "wb"));
+std::string compileHook(const Hook& hook, const std::vector<PatchPack>& patchPacks, bool& isSkipped, bool force)
+{
+    // Only save the registers the hook and the hook patches that use it need
+    uint8_t usedRegisters = hook.usedRegisters;
+    for (const auto& patchPack : patchPacks)
+        for (const auto& patch : patchPack.patches)
+            if (patch.getType() == Patch::Type::HOOK && patch.getTypeData<HookPatch>().hookName == hook.name)
+                usedRegisters |= patch.getTypeData<HookPatch>().usedRegisters;
 
-    SettingsManager::getSingleton().set("hooks." + hook.name + ".crc32", itos(crc32));
-    return output;
+    return compileSpecialisedHook(hook, usedRegisters, isSkipped, force);
 }
 
 std::string compilePatchPack(const PatchPack& patchPack, bool& isSkipped, bool force)
+{
+    return compilePatchPack(patchPack, {}, isSkipped, force);
+}
+
+std::string compilePatchPack(const PatchPack& patchPack, const std::vector<Hook>& hooks, bool& isSkipped, bool force)
 {
     isSkipped = false;
-    std::string source = generatePatchPackSource(patchPack);
+    std::string source = generatePatchPackSource(patchPack, hooks);
     uint32_t crc32 = calculateCrc32Checksum(std::vector<uint8_t>(source.begin(), source.end()));
     std::string objectFilename = getObjectDirectory() + getPatchPackSafename(patchPack.info.name) + ".o";
     if (!force && crc32 == std::stoul("0" + SettingsManager::getSingleton().get("patchPacks." + patchPack.info.name + ".crc32")))
@@ -154,30 +159,6 @@ std::string compilePatchPack(const PatchPack& patchPack, bool& isSkipped, bool f
 
 std::string linkObjects(bool force)
 {
-    std::string patchesFilename = SettingsManager::getSingleton().get("CoreManager.libraryPath") + "/lib" + SettingsManager::getSingleton().get("CoreManager.patchesLibrary");
-#ifdef _WIN32
-    patchesFilename += ".dll";
-#else
-    patchesFilename += ".so";
-#endif
-    if (!force)
-    {
-        // Check if we really need to relink
-        std::FILE* patchesFile = std::fopen(patchesFilename.c_str(), "rb");
-        if (patchesFile != nullptr) // If `patchesFilename' exists...
-        {
-            std::fclose(patchesFile);
-            std::FILE* modifiedFile = std::fopen((getObjectDirectory() + "modified").c_str(), "rb");
-            if (modifiedFile != nullptr) // If "modified" exists...
-            {
-                std::fclose(modifiedFile);
-                std::remove((getObjectDirectory() + "modified").c_str());
-            }
-            else
-                return "";
-        }
-    }
-
     // Enumerate the object files in the object directory
     std::vector<std::string> objectFilenames;
 #ifdef _WIN32
@@ -208,19 +189,57 @@ std::string linkObjects(bool force)
     posix::closedir(objectDirectory);
 #endif
 
-    // Ready the object file arguments
-    std::string objectFilenamesArgument;
-    for (const auto& objectFilename : objectFilenames)
-        objectFilenamesArgument += "\"" + objectFilename + "\" ";
+    return linkObjectFiles(objectFilenames, force);
+}
 
-    // Call the linker!
-    return callGCC(objectFilenamesArgument + " -o \"" + patchesFilename + "\" -shared " + getLDFLAGS() + " " + getCustomLDFLAGS());
+std::string linkObjects(const std::vector<std::string>& hookNames, const std::vector<std::string>& patchPackNames, bool force)
+{
+    return linkObjectFiles(getObjectFilenames(hookNames, patchPackNames), force);
+}
+
+bool isLinkNeeded(const std::vector<std::string>& hookNames, const std::vector<std::string>& patchPackNames)
+{
+    return isObjectFilesLinkNeeded(getObjectFilenames(hookNames, patchPackNames));
 }
 
 // Private functions
 namespace
 {
 
+std::string compileSpecialisedHook(const Hook& hook, uint8_t usedRegisters, bool& isSkipped, bool force)
+{
+    isSkipped = false;
+    std::string source = generateHookSource(hook, usedRegisters);
+    uint32_t crc32 = calculateCrc32Checksum(std::vector<uint8_t>(source.begin(), source.end()));
+    std::string objectFilename = getObjectDirectory() + getHookSafename(hook.name) + ".o";
+    if (!force && crc32 == std::stoul("0" + SettingsManager::getSingleton().get("hooks." + hook.name + ".crc32")))
+    {
+        // Check if the compiled object exists before we skip
+        std::FILE* objectFile = std::fopen(objectFilename.c_str(), "rb");
+        if (objectFile != nullptr)
+        {
+            std::fclose(objectFile);
+            isSkipped = true;
+            return "";
+        }
+    }
+
+    // Write the generated source to a file
+    std::string sourceFilename = getObjectDirectory() + getHookSafename(hook.name) + ".cpp";
+    std::FILE* sourceFile = std::fopen(sourceFilename.c_str(), "wb");
+    std::fwrite(source.c_str(), 1, source.size(), sourceFile);
+    std::fclose(sourceFile);
+
+    // Compile the source
+    std::string output = callGCC("\"" + sourceFilename + "\" -c -o \"" + objectFilename + "\" " + getCXXFLAGS() + " " + getCustomCXXFLAGS());
+
+    // Touch a file so `linkObjects()' knows to relink
+    std::fclose(std::fopen((getObjectDirectory() + "modified").c_str(), "wb"));
+
+    SettingsManager::getSingleton().set("hooks." + hook.name + ".crc32", itos(crc32));
+    return output;
+}
+
 std::string getHookSafename(const std::string& name)
 {
     return "hook_" + btos(name);
@@ -240,16 +259,26 @@ std::string getExternCAsmName(const std::string& name)
 #endif
 }
 
-std::string generateHookSource(const Hook& hook)
+std::string generateHookSource(const Hook& hook, uint8_t usedRegisters)
 {
     std::string output;
     output.reserve(4096);
 
+    // Fast path filters. The C++ prologue and epilogue functions may be needed on every call, so
+    // the hook is only bypassed when nothing is subscribed if it doesn't have any.
+    bool isBypassedWhenUnused = hook.prologueFunction.empty() && hook.epilogueFunction.empty();
+    bool isThreadFiltered = std::stoi("0" + SettingsManager::getSingleton().get("hooks." + hook.name + ".isThreadFiltered")) != 0;
+    uint32_t sampleInterval = std::stoul("0" + SettingsManager::getSingleton().get("hooks." + hook.name + ".sampleInterval"));
+    bool isFiltered = isThreadFiltered || sampleInterval > 1;
+
     // Output the license
     output += generatePrettyLicense() + "\n";
 
     // Output the includes
     output += "#include <map>\n";
+    output += "#include <atomic>\n";
+    if (hook.getType() == Hook::Type::IMPORT)
+        output += "#include <dlfcn.h>\n";
     for (const auto& headerInclude : hook.headerIncludes)
         output += "#include <" + headerInclude + ">\n";
     output += "#include \"HookFunctions.h\"\n";
@@ -257,12 +286,54 @@ std::string generateHookSource(const Hook& hook)
 
     // Output the hook hook patch function vector and mutex
     output += "__attribute__ ((visibility (\"default\"))) std::map<hookPatchFunction_t, ExtraSettings> " + getHookSafename(hook.name) + "_hookPatchFunctions;\n"
-              "__attribute__ ((visibility (\"default\"))) std::recursive_mutex "+ getHookSafename(hook.name) + "_hookPatchFunctionsMutex;\n\n"; // FIXME: Should be just a normal mutex
+              "__attribute__ ((visibility (\"default\"))) std::recursive_mutex "+ getHookSafename(hook.name) + "_hookPatchFunctionsMutex;\n" // FIXME: Should be just a normal mutex
+              "__attribute__ ((visibility (\"default\"))) std::atomic<uint32_t> " + getHookSafename(hook.name) + "_hookPatchFunctionsCount(0);\n"
+              "__attribute__ ((visibility (\"default\"))) std::atomic<const std::map<hookPatchFunction_t, ExtraSettings>::value_type*> " + getHookSafename(hook.name) + "_directHookPatch(nullptr); // Set by the core while only one hook patch is subscribed\n"
+              "__attribute__ ((visibility (\"default\"))) __thread bool " + getHookSafename(hook.name) + "_isThreadEnabled = false;\n\n";
+
+    // Output the filter function. Returns true if the hook function shouldn't be called.
+    if (isFiltered)
+    {
+        output += "extern \"C\" bool " + getHookSafename(hook.name) + "_isFiltered()\n"
+                  "{\n";
+        if (isThreadFiltered)
+            output += "    if (!" + getHookSafename(hook.name) + "_isThreadEnabled)\n"
+                      "        return true;\n";
+        if (sampleInterval > 1)
+            output += "    static std::atomic<uint32_t> sampleCounter(0);\n"
+                      "    if (sampleCounter++ % " + itos(sampleInterval) + " != 0)\n"
+                      "        return true;\n";
+        output += "    return false;\n"
+                  "}\n\n";
+    }
+
+    // Function and import hooks get a typed detour instead of the register saving wrapper
+    if (getFunctionSignature(hook) != nullptr)
+        return output + generateFunctionHookSource(hook, isFiltered);
+
+    // Work out which registers get saved. eax, ecx and edx are always saved since the hook function
+    // may clobber them, and esp is worked out from where the return address is.
+    static const std::vector<std::pair<uint8_t, std::string>> pushableRegisters = {
+        {UsedRegisters::EAX, "eax"}, {UsedRegisters::ECX, "ecx"}, {UsedRegisters::EDX, "edx"}, {UsedRegisters::EBX, "ebx"},
+        {UsedRegisters::EBP, "ebp"}, {UsedRegisters::ESI, "esi"}, {UsedRegisters::EDI, "edi"}};
+    std::vector<std::string> savedRegisters; // In push order
+    for (const auto& pushableRegister : pushableRegisters)
+        if (pushableRegister.first & (usedRegisters | UsedRegisters::EAX | UsedRegisters::ECX | UsedRegisters::EDX))
+            savedRegisters.push_back(pushableRegister.second);
+    const size_t savedRegistersSize = savedRegisters.size() * 4;
 
     // Output the hook function
-    output += "extern \"C\" void " + getHookSafename(hook.name) + "(uint32_t& edi, uint32_t& esi, uint32_t& ebp, const uint32_t& espInsideFrame, uint32_t& ebx, uint32_t& edx, uint32_t& ecx, uint32_t& eax, uint32_t& returnAddress, uint8_t* extraStackSpace)\n"
-              "{\n"
-              "    const uint32_t esp = espInsideFrame + " + itos(hook.extraStackSpace + 4) + "; // Get esp before the hook call\n"
+    output += "extern \"C\" void " + getHookSafename(hook.name) + "(uint32_t* savedRegisters, uint32_t& returnAddress, uint8_t* extraStackSpace)\n"
+              "{\n";
+    for (const auto& pushableRegister : pushableRegisters)
+    {
+        auto savedRegister = std::find(savedRegisters.begin(), savedRegisters.end(), pushableRegister.second);
+        if (savedRegister != savedRegisters.end())
+            output += "    uint32_t& " + pushableRegister.second + " = savedRegisters[" + itos(savedRegisters.end() - savedRegister - 1) + "];\n";
+        else
+            output += "    uint32_t " + pushableRegister.second + " = 0; // Unused\n";
+    }
+    output += "    const uint32_t esp = (uint32_t)&returnAddress + " + itos(hook.extraStackSpace + (hook.isJumpHook ? 8 : 4)) + "; // Get esp before the hook call (or jump, and the saved flags)\n"
               "    returnAddress += " + itos(hook.returnRva) + "; // Add the return rva to the return address\n"
               "    std::vector<void*> extraParameters;\n"
               "    // Prologue function start\n"
@@ -277,6 +348,11 @@ std::string generateHookSource(const Hook& hook)
               "    registers.ebp = ebp;\n"
               "    registers.esi = esi;\n"
               "    registers.edi = edi;\n"
+              "    // While only one hook patch is subscribed, call it without locking or going through the map\n"
+              "    const auto* directHookPatch = " + getHookSafename(hook.name) + "_directHookPatch.load(std::memory_order_acquire);\n"
+              "    if (directHookPatch != nullptr)\n"
+              "        directHookPatch->first(registers, returnAddress, directHookPatch->second, extraParameters);\n"
+              "    else\n"
               "    {\n"
               "        std::lock_guard<std::recursive_mutex> hookPatchFunctionsLock(" + getHookSafename(hook.name) + "_hookPatchFunctionsMutex);\n"
               "        for (const auto& hookPatchFunction : " + getHookSafename(hook.name) + "_hookPatchFunctions)\n"
@@ -286,51 +362,91 @@ std::string generateHookSource(const Hook& hook)
               "    " + hook.epilogueFunction + "\n"
               "    // Epilogue function end\n"
               "}\n\n";
+    if (hook.isJumpHook)
+        output += generateTrampolineSource(hook, X86::getMaxTrampolineSize(X86::jumpSize));
 
     // Output the hook wrapper
     output += "extern \"C\" __attribute__ ((visibility (\"default\"))) void " + getHookSafename(hook.name) + "_wrapper();\n"
               "// /src/manager/" __FILE__ ":" + itos(__LINE__ + 1) + " explains the following assembly.\n";
-    // Raw assembly for the wrapper. Note: 32 is the amount of bytes that "pusha" pushes on to the stack.
+    // Raw assembly for the wrapper. Note: `savedRegistersSize' is the amount of bytes the saved registers take up on the stack.
     // Declaration and prototype
     output += "asm (\".globl " + getExternCAsmName(getHookSafename(hook.name) + "_wrapper") + "\\n\"\n" //     .globl [hookSafename]_wrapper
               "\"" + getExternCAsmName(getHookSafename(hook.name) + "_wrapper") + ":\\n\\t\"\n";        // [hookSafename]_wrapper:
-    // Run the prologue instructions bytes
-    output += "    \"addl $4, %esp\\n\\t\"\n";                                                          //     addl $4, %esp                                // Pretend we aren't in a call frame.
-    for (const auto& prologueInstructionsByte : hook.prologueInstructionsBytes)
-        output += "    \".byte " + itos(prologueInstructionsByte) + "\\n\\t\"\n";                       //     .byte [prologueInstructionsByte]             // Emits a prologue instructions byte.
-    output += "    \"subl $4, %esp\\n\\t\"\n"                                                           //     subl $4, %esp                                // Un-pretend.
-    // Allocate the extra stack space and save all registers to the stack
-              "    \"subl $" + itos(hook.extraStackSpace) + ", %esp\\n\\t\"\n"                          //     subl $[extraStackSpace], %esp                // Allocate the extra stack space.
-              "    \"pusha\\n\\t\"\n"                                                                   //     pusha                                        // Save all registers to the stack.
-              "    \"movl " + itos(32 + hook.extraStackSpace) + "(%esp), %eax\\n\\t\"\n"                //     movl [32 + extraStackSpace](%esp), %eax      // Copy the return address out
-              "    \"movl %eax, 32(%esp)\\n\\t\"\n"                                                     //     movl %eax, 32(%esp)                          // of the extra stack space.
+    // Run the prologue instructions bytes. Jump hooks don't have any since they relocate what they overwrite instead.
+    if (!hook.isJumpHook)
+    {
+        output += "    \"addl $4, %esp\\n\\t\"\n";                                                      //     addl $4, %esp                                // Pretend we aren't in a call frame.
+        for (const auto& prologueInstructionsByte : hook.prologueInstructionsBytes)
+            output += "    \".byte " + itos(prologueInstructionsByte) + "\\n\\t\"\n";                   //     .byte [prologueInstructionsByte]             // Emits a prologue instructions byte.
+        output += "    \"subl $4, %esp\\n\\t\"\n";                                                      //     subl $4, %esp                                // Un-pretend.
+    }
+    else
+        // Jump hooks can be placed between a compare and its branch, so the flags have to survive the filters and the hook function
+        output += "    \"pushfl\\n\\t\"\n";                                                          //     pushfl                                       // Save the flags.
+    // Skip the hook function if nothing would be called or the filters say so
+    if (isBypassedWhenUnused)
+        output += "    \"cmpl $0, " + getExternCAsmName(getHookSafename(hook.name) + "_hookPatchFunctionsCount") + "\\n\\t\"\n" //     cmpl $0, [hookSafename]_hookPatchFunctionsCount
+                  "    \"je .L" + getHookSafename(hook.name) + "_bypass\\n\\t\"\n";                    //     je .L[hookSafename]_bypass                   // Nothing is subscribed.
+    if (isFiltered)
+        output += "    \"push %eax\\n\\t\"\n"                                                       //     push %eax                                    // Save the registers the
+                  "    \"push %ecx\\n\\t\"\n"                                                       //     push %ecx                                    // filter function may clobber.
+                  "    \"push %edx\\n\\t\"\n"                                                       //     push %edx
+                  "    \"call " + getExternCAsmName(getHookSafename(hook.name) + "_isFiltered") + "\\n\\t\"\n" //     call [hookSafename]_isFiltered
+                  "    \"testb %al, %al\\n\\t\"\n"                                                  //     testb %al, %al
+                  "    \"pop %edx\\n\\t\"\n"                                                        //     pop %edx                                     // Popping doesn't change
+                  "    \"pop %ecx\\n\\t\"\n"                                                        //     pop %ecx                                     // the flags.
+                  "    \"pop %eax\\n\\t\"\n"                                                        //     pop %eax
+                  "    \"jnz .L" + getHookSafename(hook.name) + "_bypass\\n\\t\"\n";                   //     jnz .L[hookSafename]_bypass                  // Filtered out.
+    // Jump hooks weren't called, so push where to continue in place of a return address. The hook function can still change it.
+    if (hook.isJumpHook)
+        output += "    \"pushl $" + getExternCAsmName(getHookSafename(hook.name) + "_trampoline") + "\\n\\t\"\n"; //   pushl $[hookSafename]_trampoline
+    // Allocate the extra stack space and save the registers to the stack
+    output += "    \"subl $" + itos(hook.extraStackSpace) + ", %esp\\n\\t\"\n";                         //     subl $[extraStackSpace], %esp                // Allocate the extra stack space.
+    for (const auto& savedRegister : savedRegisters)
+        output += "    \"push %" + savedRegister + "\\n\\t\"\n";                                        //     push %[savedRegister]                        // Save the registers that are used.
+    output += "    \"movl " + itos(savedRegistersSize + hook.extraStackSpace) + "(%esp), %eax\\n\\t\"\n" //  movl [savedRegistersSize + extraStackSpace](%esp), %eax // Copy the return address out
+              "    \"movl %eax, " + itos(savedRegistersSize) + "(%esp)\\n\\t\"\n"                       //     movl %eax, [savedRegistersSize](%esp)        // of the extra stack space.
     // Push the addresses of the extra stack space, the return address and the
-    // registers on to the stack for use by the hook function
-              "    \"leal " + itos(32 + hook.extraStackSpace) + "(%esp), %eax\\n\\t\"\n"                //     leal [32 + extraStackSpace](%esp), %eax      // Get start address of the extra stack space.
+    // saved registers on to the stack for use by the hook function
+              "    \"leal " + itos(savedRegistersSize + hook.extraStackSpace) + "(%esp), %eax\\n\\t\"\n" //    leal [savedRegistersSize + extraStackSpace](%esp), %eax // Get start address of the extra stack space.
               "    \"push %eax\\n\\t\"\n"                                                               //     push %eax                                    // Push the start address on to the stack.
               "    \"subl $" + itos(hook.extraStackSpace) + ", %eax\\n\\t\"\n"                          //     subl $[extraStackSpace], %eax                // Move to the address of the return address.
               "    \"push %eax\\n\\t\"\n"                                                               //     push %eax                                    // Push the address on to the stack.
-              "    \"subl $4, %eax\\n\\t\"\n"                                                           //     subl $4, %eax                                // Move to the address of eax.
-              "    \"push %eax\\n\\t\"\n"                                                               //     push %eax                                    // etc.
-              "    \"subl $4, %eax\\n\\t\"\n"                                                           //     subl $4, %eax                                // ecx
-              "    \"push %eax\\n\\t\"\n"                                                               //     push %eax
-              "    \"subl $4, %eax\\n\\t\"\n"                                                           //     subl $4, %eax                                // edx
-              "    \"push %eax\\n\\t\"\n"                                                               //     push %eax
-              "    \"subl $4, %eax\\n\\t\"\n"                                                           //     subl $4, %eax                                // ebx
-              "    \"push %eax\\n\\t\"\n"                                                               //     push %eax
-              "    \"subl $4, %eax\\n\\t\"\n"                                                           //     subl $4, %eax                                // esp
-              "    \"push %eax\\n\\t\"\n"                                                               //     push %eax
-              "    \"subl $4, %eax\\n\\t\"\n"                                                           //     subl $4, %eax                                // ebp
-              "    \"push %eax\\n\\t\"\n"                                                               //     push %eax
-              "    \"subl $4, %eax\\n\\t\"\n"                                                           //     subl $4, %eax                                // esi
-              "    \"push %eax\\n\\t\"\n"                                                               //     push %eax
-              "    \"subl $4, %eax\\n\\t\"\n"                                                           //     subl $4, %eax                                // edi
-              "    \"push %eax\\n\\t\"\n"                                                               //     push %eax
+              "    \"leal 8(%esp), %eax\\n\\t\"\n"                                                      //     leal 8(%esp), %eax                           // Get the address of the saved registers.
+              "    \"push %eax\\n\\t\"\n"                                                               //     push %eax                                    // Push the address on to the stack.
     // Call the hook function
               "    \"call " + getExternCAsmName(getHookSafename(hook.name)) + "\\n\\t\"\n"              //     call [hookSafename]
     // Cleanup
-              "    \"addl $40, %esp\\n\\t\"\n"                                                          //     addl $40, %esp                               // Clean up the stack used for the call.
-              "    \"popa\\n\\t\"\n";                                                                   //     popa                                         // Restore the (possibly modified) registers.
+              "    \"addl $12, %esp\\n\\t\"\n";                                                         //     addl $12, %esp                               // Clean up the stack used for the call.
+    if (hook.isJumpHook)
+        output += "    \"movl " + itos(savedRegistersSize) + "(%esp), %eax\\n\\t\"\n"                   //     movl [savedRegistersSize](%esp), %eax        // Swap the (possibly changed) return
+                  "    \"movl " + itos(savedRegistersSize + 4) + "(%esp), %ecx\\n\\t\"\n"               //     movl [savedRegistersSize + 4](%esp), %ecx    // address with the saved flags, so
+                  "    \"movl %ecx, " + itos(savedRegistersSize) + "(%esp)\\n\\t\"\n"                   //     movl %ecx, [savedRegistersSize](%esp)        // the flags can be popped first.
+                  "    \"movl %eax, " + itos(savedRegistersSize + 4) + "(%esp)\\n\\t\"\n";              //     movl %eax, [savedRegistersSize + 4](%esp)    // eax and ecx are always saved.
+    for (auto savedRegister = savedRegisters.crbegin(); savedRegister != savedRegisters.crend(); ++savedRegister)
+        output += "    \"pop %" + *savedRegister + "\\n\\t\"\n";                                        //     pop %[savedRegister]                         // Restore the (possibly modified) registers.
+    if (hook.isJumpHook)
+    {
+        output += "    \"popfl\\n\\t\"\n"                                                              //     popfl                                        // Restore the flags.
+                  "    \"ret\\n\\t\"\n";                                                                //     ret                                          // Continue at the trampoline, unless changed.
+        if (isBypassedWhenUnused || isFiltered)
+            output += "\".L" + getHookSafename(hook.name) + "_bypass:\\n\\t\"\n"                    // .L[hookSafename]_bypass:
+                      "    \"popfl\\n\\t\"\n"                                                      //     popfl                                        // Restore the flags.
+                      "    \"jmp " + getExternCAsmName(getHookSafename(hook.name) + "_trampoline") + "\\n\\t\"\n"; // jmp [hookSafename]_trampoline             // Straight on to the relocated instructions.
+        output += ");\n\n";
+        return output;
+    }
+    if (isBypassedWhenUnused || isFiltered)
+    {
+        output += "    \"jmp .L" + getHookSafename(hook.name) + "_epilogue\\n\\t\"\n"                  //     jmp .L[hookSafename]_epilogue
+                  "\".L" + getHookSafename(hook.name) + "_bypass:\\n\\t\"\n"                        // .L[hookSafename]_bypass:
+                  "    \"addl $" + itos(hook.returnRva) + ", (%esp)\\n\\t\"\n";                     //     addl $[returnRva], (%esp)                    // What the hook function would have done.
+        if (hook.extraStackSpace != 0)
+            output += "    \"subl $" + itos(hook.extraStackSpace) + ", %esp\\n\\t\"\n"              //     subl $[extraStackSpace], %esp                // Leave the stack as the hook function would have,
+                      "    \"pushl " + itos(hook.extraStackSpace) + "(%esp)\\n\\t\"\n"              //     pushl [extraStackSpace](%esp)                // with the return address copied
+                      "    \"popl (%esp)\\n\\t\"\n";                                                //     popl (%esp)                                  // out of the extra stack space.
+        output += "\".L" + getHookSafename(hook.name) + "_epilogue:\\n\\t\"\n";                    // .L[hookSafename]_epilogue:
+    }
     // Run the epilogue instructions bytes
     output += "    \"addl $4, %esp\\n\\t\"\n";                                                          //     addl $4, %esp                                // Pretend we aren't in a call frame.
     for (const auto& epilogueInstructionsByte : hook.epilogueInstructionsBytes)
@@ -343,20 +459,110 @@ std::string generateHookSource(const Hook& hook)
     return output;
 }
 
-std::string generatePatchPackSource(const PatchPack& patchPack)
+std::string generateTrampolineSource(const Hook& hook, size_t size)
+{
+    // The trampoline gets filled in with the relocated instructions the hook overwrites and a jump back when the hook is installed
+    return "extern \"C\" uint8_t " + getHookSafename(hook.name) + "_trampoline[];\n"
+           "asm (\".pushsection .text\\n\"\n"
+           "     \".globl " + getExternCAsmName(getHookSafename(hook.name) + "_trampoline") + "\\n\"\n"
+           "     \"" + getExternCAsmName(getHookSafename(hook.name) + "_trampoline") + ":\\n\"\n"
+           "     \".fill " + itos(size) + ", 1, 0xcc\\n\"\n"
+           "     \".popsection\\n\"\n"
+           ");\n\n";
+}
+
+std::string generateFunctionHookSource(const Hook& hook, bool isFiltered)
 {
+    const FunctionSignature& functionHook = *getFunctionSignature(hook);
+    const bool isVoid = functionHook.returnType == "void";
+    std::string arguments;
+    for (const auto& parameter : functionHook.parameters)
+        arguments += (arguments.empty() ? "" : ", ") + parameter.first;
+
     std::string output;
     output.reserve(4096);
 
+    output += generateFunctionHookTypes(hook) + "\n";
+
+    // Function hooks call the original through the trampoline, and import hooks through what the import resolves to.
+    // The slots can't be used for that, since lazily bound ones still point to the PLT stub that would overwrite them.
+    std::string original;
+    if (hook.getType() == Hook::Type::FUNCTION)
+    {
+        output += generateTrampolineSource(hook, X86::getMaxTrampolineSize(std::max(hook.getTypeData<FunctionHook>().prologueSize, X86::jumpSize)));
+        original = getHookSafename(hook.name) + "_trampoline";
+    }
+    else
+    {
+        output += "uint8_t* const " + getHookSafename(hook.name) + "_original = (uint8_t*)dlsym(RTLD_DEFAULT, \"" + hook.getTypeData<ImportHook>().importName + "\");\n\n";
+        original = getHookSafename(hook.name) + "_original";
+    }
+
+    // Output the detour. It has the same signature as the function, so it is jumped to or called through the slot instead.
+    output += "extern \"C\" __attribute__ ((visibility (\"default\"))) " + functionHook.returnType + " " + getCallingConventionAttribute(functionHook.callingConvention) + " " + getHookSafename(hook.name) + "_wrapper(";
+    for (size_t p = 0; p < functionHook.parameters.size(); ++p)
+        output += (p == 0 ? "" : ", ") + functionHook.parameters[p].second + " " + functionHook.parameters[p].first;
+    output += ")\n"
+              "{\n"
+              "    const " + getHookSafename(hook.name) + "_original_t original = (" + getHookSafename(hook.name) + "_original_t)" + original + ";\n"
+              "    if (" + getHookSafename(hook.name) + "_hookPatchFunctionsCount == 0" + (isFiltered ? " || " + getHookSafename(hook.name) + "_isFiltered()" : "") + ")\n"
+              "        return original(" + arguments + ");\n";
+    if (!isVoid)
+        output += "    " + functionHook.returnType + " result = " + functionHook.returnType + "();\n";
+    output += "    bool isOriginalCalled = true;\n"
+              "    const auto* directHookPatch = " + getHookSafename(hook.name) + "_directHookPatch.load(std::memory_order_acquire);\n"
+              "    if (directHookPatch != nullptr)\n"
+              "        isOriginalCalled = ((" + getHookSafename(hook.name) + "_hookPatchFunction_t)directHookPatch->first)(directHookPatch->second, original" + (isVoid ? "" : ", result") + (arguments.empty() ? "" : ", " + arguments) + ");\n"
+              "    else\n"
+              "    {\n"
+              "        std::lock_guard<std::recursive_mutex> hookPatchFunctionsLock(" + getHookSafename(hook.name) + "_hookPatchFunctionsMutex);\n"
+              "        for (const auto& hookPatchFunction : " + getHookSafename(hook.name) + "_hookPatchFunctions)\n"
+              "            if (!((" + getHookSafename(hook.name) + "_hookPatchFunction_t)hookPatchFunction.first)(hookPatchFunction.second, original" + (isVoid ? "" : ", result") + (arguments.empty() ? "" : ", " + arguments) + "))\n"
+              "            {\n"
+              "                isOriginalCalled = false;\n"
+              "                break;\n"
+              "            }\n"
+              "    }\n"
+              "    if (isOriginalCalled)\n"
+              "        " + (isVoid ? "" : "result = ") + "original(" + arguments + ");\n";
+    if (!isVoid)
+        output += "    return result;\n";
+    output += "}\n\n";
+
+    return output;
+}
+
+std::string generatePatchPackSource(const PatchPack& patchPack, const std::vector<Hook>& hooks)
+{
+    std::string output;
+    output.reserve(4096);
+
+    // Find the function and import hooks used, since their hook patches have typed parameters
+    std::map<std::string, const Hook*> functionHooks;
+    for (const auto& hook : hooks)
+        if (getFunctionSignature(hook) != nullptr)
+            for (const auto& patch : patchPack.patches)
+                if (patch.getType() == Patch::Type::HOOK && patch.getTypeData<HookPatch>().hookName == hook.name)
+                    functionHooks[hook.name] = &hook;
+
     // Output the license
     output += generatePrettyLicense() + "\n";
 
     // Output the includes
-    for (const auto& headerInclude : patchPack.headerIncludes)
+    std::set<std::string> headerIncludes(patchPack.headerIncludes.begin(), patchPack.headerIncludes.end());
+    for (const auto& functionHook : functionHooks)
+        headerIncludes.insert(functionHook.second->headerIncludes.begin(), functionHook.second->headerIncludes.end());
+    for (const auto& headerInclude : headerIncludes)
         output += "#include <" + headerInclude + ">\n";
     output += "#include \"HookFunctions.h\"\n";
     output += "\n";
 
+    // Output the function hook types
+    for (const auto& functionHook : functionHooks)
+        output += generateFunctionHookTypes(*functionHook.second);
+    if (!functionHooks.empty())
+        output += "\n";
+
     {
         // Output the shared variables
         output += "namespace\n"
@@ -377,8 +583,13 @@ std::string generatePatchPackSource(const PatchPack& patchPack)
         for (const auto& patch : patchPack.patches)
             if (patch.getType() == Patch::Type::HOOK)
             {
-                output += "extern \"C\" __attribute__ ((visibility (\"default\"))) void " + getPatchPackSafename(patchPack.info.name) + "_hookPatch" + itos(p) + "(const Registers& registers, const uint32_t returnAddress, const ExtraSettings extraSettings, std::vector<void*>& extraParameters)\n"
-                          "{\n"
+                auto functionHook = functionHooks.find(patch.getTypeData<HookPatch>().hookName);
+                if (functionHook != functionHooks.end())
+                    // Return false to skip calling the original function, after setting `result' if needed
+                    output += "extern \"C\" __attribute__ ((visibility (\"default\"))) bool " + getPatchPackSafename(patchPack.info.name) + "_hookPatch" + itos(p) + "(" + generateFunctionHookPatchParameters(*functionHook->second) + ")\n";
+                else
+                    output += "extern \"C\" __attribute__ ((visibility (\"default\"))) void " + getPatchPackSafename(patchPack.info.name) + "_hookPatch" + itos(p) + "(const Registers& registers, const uint32_t returnAddress, const ExtraSettings extraSettings, std::vector<void*>& extraParameters)\n";
+                output += "{\n"
                           "    " + patch.getTypeData<HookPatch>().functionBody + "\n"
                           "}\n\n";
                 ++p;
@@ -388,6 +599,66 @@ std::string generatePatchPackSource(const PatchPack& patchPack)
     return output;
 }
 
+const FunctionSignature* getFunctionSignature(const Hook& hook)
+{
+    switch (hook.getType())
+    {
+        case Hook::Type::FUNCTION :
+            return &hook.getTypeData<FunctionHook>();
+
+        case Hook::Type::IMPORT :
+            return &hook.getTypeData<ImportHook>();
+
+        default:
+            return nullptr;
+    }
+}
+
+std::string getCallingConventionAttribute(FunctionSignature::CallingConvention callingConvention)
+{
+    switch (callingConvention)
+    {
+        case FunctionSignature::CallingConvention::CDECL :
+            return "__attribute__ ((cdecl))";
+
+        case FunctionSignature::CallingConvention::STDCALL :
+            return "__attribute__ ((stdcall))";
+
+        case FunctionSignature::CallingConvention::THISCALL :
+            return "__attribute__ ((thiscall))";
+
+        default:
+            assert(false); // Should never get here
+    }
+    return "";
+}
+
+std::string generateFunctionHookTypes(const Hook& hook)
+{
+    const FunctionSignature& functionHook = *getFunctionSignature(hook);
+    std::string parameterTypes;
+    std::string parameterReferenceTypes;
+    for (const auto& parameter : functionHook.parameters)
+    {
+        parameterTypes += ", " + parameter.second;
+        parameterReferenceTypes += ", " + parameter.second + "&";
+    }
+
+    return "using " + getHookSafename(hook.name) + "_original_t = " + functionHook.returnType + " (" + getCallingConventionAttribute(functionHook.callingConvention) + " *)(" + (parameterTypes.empty() ? "" : parameterTypes.substr(2)) + ");\n"
+           "using " + getHookSafename(hook.name) + "_hookPatchFunction_t = bool (*)(const ExtraSettings&, " + getHookSafename(hook.name) + "_original_t" + (functionHook.returnType == "void" ? "" : ", " + functionHook.returnType + "&") + parameterReferenceTypes + ");\n";
+}
+
+std::string generateFunctionHookPatchParameters(const Hook& hook)
+{
+    const FunctionSignature& functionHook = *getFunctionSignature(hook);
+    std::string output = "const ExtraSettings& extraSettings, " + getHookSafename(hook.name) + "_original_t original";
+    if (functionHook.returnType != "void")
+        output += ", " + functionHook.returnType + "& result";
+    for (const auto& parameter : functionHook.parameters)
+        output += ", " + parameter.second + "& " + parameter.first;
+    return output;
+}
+
 std::string getLicense()
 {
     return
@@ -540,6 +811,78 @@ std::string callGCC(const std::string& args)
     return output;
 }
 
+std::vector<std::string> getObjectFilenames(const std::vector<std::string>& hookNames, const std::vector<std::string>& patchPackNames)
+{
+    std::vector<std::string> objectFilenames;
+    objectFilenames.reserve(hookNames.size() + patchPackNames.size());
+    for (const auto& hookName : hookNames)
+        objectFilenames.push_back(getObjectDirectory() + getHookSafename(hookName) + ".o");
+    for (const auto& patchPackName : patchPackNames)
+        objectFilenames.push_back(getObjectDirectory() + getPatchPackSafename(patchPackName) + ".o");
+    return objectFilenames;
+}
+
+std::string getPatchesFilename()
+{
+    std::string patchesFilename = SettingsManager::getSingleton().get("CoreManager.libraryPath") + "/lib" + SettingsManager::getSingleton().get("CoreManager.patchesLibrary");
+#ifdef _WIN32
+    patchesFilename += ".dll";
+#else
+    patchesFilename += ".so";
+#endif
+    return patchesFilename;
+}
+
+uint32_t getObjectFilenamesCrc32(std::vector<std::string> objectFilenames)
+{
+    std::sort(objectFilenames.begin(), objectFilenames.end());
+    std::vector<uint8_t> data;
+    for (const auto& objectFilename : objectFilenames)
+    {
+        data.insert(data.end(), objectFilename.begin(), objectFilename.end());
+        data.push_back(0);
+    }
+    return calculateCrc32Checksum(data);
+}
+
+bool isObjectFilesLinkNeeded(const std::vector<std::string>& objectFilenames)
+{
+    // If `getPatchesFilename()' doesn't exist...
+    std::FILE* patchesFile = std::fopen(getPatchesFilename().c_str(), "rb");
+    if (patchesFile == nullptr)
+        return true;
+    std::fclose(patchesFile);
+
+    // If "modified" exists...
+    std::FILE* modifiedFile = std::fopen((getObjectDirectory() + "modified").c_str(), "rb");
+    if (modifiedFile != nullptr)
+    {
+        std::fclose(modifiedFile);
+        return true;
+    }
+
+    // If a different set of objects was linked last time...
+    return getObjectFilenamesCrc32(objectFilenames) != std::stoul("0" + SettingsManager::getSingleton().get("PatchCompiler.linkedObjectsCrc32"));
+}
+
+std::string linkObjectFiles(const std::vector<std::string>& objectFilenames, bool force)
+{
+    if (!force && !isObjectFilesLinkNeeded(objectFilenames))
+        return "";
+
+    // Ready the object file arguments
+    std::string objectFilenamesArgument;
+    for (const auto& objectFilename : objectFilenames)
+        objectFilenamesArgument += "\"" + objectFilename + "\" ";
+
+    // Call the linker!
+    std::string output = callGCC(objectFilenamesArgument + " -o \"" + getPatchesFilename() + "\" -shared " + getLDFLAGS() + " " + getCustomLDFLAGS());
+
+    std::remove((getObjectDirectory() + "modified").c_str());
+    SettingsManager::getSingleton().set("PatchCompiler.linkedObjectsCrc32", itos(getObjectFilenamesCrc32(objectFilenames)));
+    return output;
+}
+
 std::string getObjectDirectory()
 {
     std::string result = SettingsManager::getSingleton().get("PatchCompiler.objectsPath");
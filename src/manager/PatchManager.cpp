@@ -16,6 +16,9 @@
 */
 
 #include <iterator>
+#include <set>
+#include <tuple>
+#include <exception>
 #include <stdexcept>
 
 #include "PatchManager.h"
@@ -32,8 +35,24 @@ PatchManager& PatchManager::getSingleton()
     return singleton;
 }
 
+PatchManager::PatchManager():
+    batchDepth_(0)
+{
+}
+
+PatchManager::Batch::Batch()
+{
+    PatchManager::getSingleton().beginBatch_();
+}
+
+PatchManager::Batch::~Batch() noexcept(false)
+{
+    PatchManager::getSingleton().endBatch_();
+}
+
 void PatchManager::registerHook(const Hook& hook)
 {
+    Batch batch;
     if (hook.name.empty())
         throw std::logic_error("The hook name cannot be empty.");
 
@@ -47,6 +66,26 @@ void PatchManager::registerHook(const Hook& hook)
             for (const auto& hook_ : hooks_)
                 if (hook_.hook.getType() == Hook::Type::NAME)
                     hook.getTypeData<NameHook>().checkOverlapWith(hook_.hook.getTypeData<NameHook>());
+                else if (hook_.hook.getType() == Hook::Type::FUNCTION)
+                    hook.getTypeData<NameHook>().checkOverlapWith(hook_.hook.getTypeData<FunctionHook>());
+            break;
+
+        case Hook::Type::FUNCTION :
+            for (const auto& hook_ : hooks_)
+                if (hook_.hook.getType() == Hook::Type::NAME)
+                    hook.getTypeData<FunctionHook>().checkOverlapWith(hook_.hook.getTypeData<NameHook>());
+                else if (hook_.hook.getType() == Hook::Type::FUNCTION)
+                    hook.getTypeData<FunctionHook>().checkOverlapWith(hook_.hook.getTypeData<FunctionHook>());
+            break;
+
+        case Hook::Type::IMPORT :
+            for (const auto& hook_ : hooks_)
+                if (hook_.hook.getType() == Hook::Type::IMPORT)
+                    hook.getTypeData<ImportHook>().checkOverlapWith(hook_.hook.getTypeData<ImportHook>());
+            for (const auto& patchPack : patchPacks_)
+                for (const auto& patch : patchPack.patches)
+                    if (patch.getType() == Patch::Type::IMPORT)
+                        hook.getTypeData<ImportHook>().checkOverlapWith(patch.getTypeData<ImportPatch>());
             break;
 
         default:
@@ -63,11 +102,13 @@ void PatchManager::registerHook(const Hook& hook)
 
 void PatchManager::unregisterHook(const std::string& name)
 {
+    Batch batch;
     unregisterHook_(getIteratorToHook_(name));
 }
 
 void PatchManager::unregisterAllHooks()
 {
+    Batch batch;
     auto hook = hooks_.begin();
     while (hook != hooks_.end())
         hook = unregisterHook_(hook);
@@ -80,8 +121,25 @@ bool PatchManager::isHookRegistered(const std::string& name) const noexcept
     return false;
 }
 
+void PatchManager::setHookThreadFiltered(const std::string& name, bool isThreadFiltered)
+{
+    Batch batch;
+    auto hook = getIteratorToHook_(name);
+    SettingsManager::getSingleton().set("hooks." + name + ".isThreadFiltered", itos(isThreadFiltered));
+    updateCoresAboutHook_(*hook);
+}
+
+void PatchManager::setHookSampleInterval(const std::string& name, uint32_t sampleInterval)
+{
+    Batch batch;
+    auto hook = getIteratorToHook_(name);
+    SettingsManager::getSingleton().set("hooks." + name + ".sampleInterval", itos(sampleInterval));
+    updateCoresAboutHook_(*hook);
+}
+
 void PatchManager::addPatchPack(const PatchPack& patchPack)
 {
+    Batch batch;
     if (patchPack.info.name.empty())
         throw std::logic_error("The patch pack name cannot be empty.");
     for (const auto& patchPack_ : patchPacks_)
@@ -109,6 +167,24 @@ void PatchManager::addPatchPack(const PatchPack& patchPack)
                             patch.getTypeData<ReplaceNamePatch>().checkOverlapWith(patch_.getTypeData<ReplaceNamePatch>());
                 break;
 
+            case Patch::Type::IMPORT :
+                // Redirecting the same slots twice would leave the wrong pointer behind when undone out of order
+                for (const auto& patchPack_ : patchPacks_)
+                    for (const auto& patch_ : patchPack_.patches)
+                        if (patch_.getType() == Patch::Type::IMPORT)
+                            patch.getTypeData<ImportPatch>().checkOverlapWith(patch_.getTypeData<ImportPatch>());
+                for (const auto& hook_ : hooks_)
+                    if (hook_.hook.getType() == Hook::Type::IMPORT)
+                        patch.getTypeData<ImportPatch>().checkOverlapWith(hook_.hook.getTypeData<ImportHook>());
+                break;
+
+            case Patch::Type::VTABLE_SLOT :
+                for (const auto& patchPack_ : patchPacks_)
+                    for (const auto& patch_ : patchPack_.patches)
+                        if (patch_.getType() == Patch::Type::VTABLE_SLOT)
+                            patch.getTypeData<VtableSlotPatch>().checkOverlapWith(patch_.getTypeData<VtableSlotPatch>());
+                break;
+
             default:
                 break;
         }
@@ -130,11 +206,13 @@ void PatchManager::addPatchPack(const PatchPack& patchPack)
 
 void PatchManager::removePatchPack(const std::string& name)
 {
+    Batch batch;
     removePatchPack_(getIteratorToPatchPack_(name));
 }
 
 void PatchManager::removeAllPatchPacks()
 {
+    Batch batch;
     auto patchPack = patchPacks_.begin();
     while (patchPack != patchPacks_.end())
         patchPack = removePatchPack_(patchPack);
@@ -149,22 +227,26 @@ bool PatchManager::isPatchPackLoaded(const std::string& name) const noexcept
 
 void PatchManager::enablePatchPack(const std::string& name)
 {
+    Batch batch;
     enablePatchPack_(*getIteratorToPatchPack_(name));
 }
 
 void PatchManager::enableAllPatchPacks()
 {
+    Batch batch;
     for (auto& patchPack : patchPacks_)
         enablePatchPack_(patchPack);
 }
 
 void PatchManager::disablePatchPack(const std::string& name)
 {
+    Batch batch;
     disablePatchPack_(*getIteratorToPatchPack_(name));
 }
 
 void PatchManager::disableAllPatchPacks()
 {
+    Batch batch;
     for (auto& patchPack : patchPacks_)
         disablePatchPack_(patchPack);
 }
@@ -200,108 +282,77 @@ const PatchPack& PatchManager::getPatchPack(const std::string& name) const
 
 void PatchManager::setPatchPackExtraSettingValue(const std::string& name, const std::string& extraSettingLabel, const std::string& value)
 {
+    Batch batch;
     setPatchPackExtraSettingValue_(*getIteratorToPatchPack_(name), extraSettingLabel, value);
 }
 
 void PatchManager::restorePatchPackExtraSettingDefaults(const std::string& name)
 {
+    Batch batch;
     restorePatchPackExtraSettingDefaults_(*getIteratorToPatchPack_(name));
 }
 
 void PatchManager::restoreAllPatchPackExtraSettingDefaults()
 {
+    Batch batch;
     for (auto& patchPack : patchPacks_)
         restorePatchPackExtraSettingDefaults_(patchPack);
 }
 
 std::string PatchManager::compileHooksAndPatchPacks() const
 {
-    std::string output;
-    output.reserve(1024);
-    try
-    {
-        bool isAllSkipped = true;
-        for (const auto& hook : hooks_)
-        {
-            output += "Compiling hook " + hook.hook.name + "...\n";
-            bool isSkipped;
-            output += PatchCompiler::compileHook(hook.hook, isSkipped);
-            if (isSkipped)
-                output += "Skipped.\n";
-            else
-                isAllSkipped = false;
-        }
-        for (auto& patchPack : patchPacks_)
-        {
-            output += "Compiling patch pack " + patchPack.info.name + "...\n";
-            bool isSkipped;
-            output += PatchCompiler::compilePatchPack(patchPack, isSkipped);
-            if (isSkipped)
-                output += "Skipped.\n";
-            else
-                isAllSkipped = false;
-        }
-        output += "Linking...\n";
-        if (isAllSkipped)
-            output += "Skipped.\n";
-        else
-        {
-            CoreManager::getSingleton().sendPacket(Socket::ServerOpCode::PATCH_LIB_UNLOAD, {});
-            output += PatchCompiler::linkObjects();
-            std::string patchesFilename = SettingsManager::getSingleton().get("core.patchesLibrary");
-            std::vector<uint8_t> data;
-            serialiseIntegralTypeContinuousContainer(data, patchesFilename);
-            CoreManager::getSingleton().sendPacket(Socket::ServerOpCode::PATCH_LIB_LOAD, data);
-        }
-    }
-    catch (const std::exception& e)
-    {
-        output += e.what();
-        throw std::runtime_error("Failed to compile hooks and patch packs. Output:\n" + output);
-    }
-    return output;
+    bool isRelinked;
+    return compileHooksAndPatchPacks_(isRelinked);
 }
 
 void PatchManager::updateCoreAboutHook(const CoreManager::CoreId coreId, const std::string& name) const
 {
+    Batch batch;
     updateCoreAboutHook_(coreId, *getIteratorToHook_(name));
 }
 
 void PatchManager::updateCoresAboutHook(const std::string& name) const
 {
+    Batch batch;
     updateCoresAboutHook_(*getIteratorToHook_(name));
 }
 
 void PatchManager::updateCoreAboutAllHooks(const CoreManager::CoreId coreId) const
 {
+    Batch batch;
     for (const auto& hook : hooks_)
         updateCoreAboutHook_(coreId, hook);
 }
 
 void PatchManager::updateCoresAboutAllHooks() const
 {
+    Batch batch;
     for (const auto& hook : hooks_)
         updateCoresAboutHook_(hook);
 }
 
 void PatchManager::updateCoreAboutPatchPack(const CoreManager::CoreId coreId, const std::string& name) const
 {
+    Batch batch;
     updateCoreAboutPatchPack_(coreId, *getIteratorToPatchPack_(name));
 }
 
 void PatchManager::updateCoresAboutPatchPack(const std::string& name) const
 {
+    Batch batch;
     updateCoresAboutPatchPack_(*getIteratorToPatchPack_(name));
 }
 
 void PatchManager::updateCoreAboutAllPatchPacks(const CoreManager::CoreId coreId) const
 {
+    Batch batch;
     for (const auto& patchPack : patchPacks_)
         updateCoreAboutPatchPack_(coreId, patchPack);
 }
 
 void PatchManager::updateCoresAboutAllPatchPacks() const
 {
+    Batch batch;
     for (const auto& patchPack : patchPacks_)
         updateCoresAboutPatchPack_(patchPack);
 }
@@ -420,54 +471,229 @@ void PatchManager::disablePatchPack_(PatchPack& patchPack)
 void PatchManager::setPatchPackExtraSettingValue_(PatchPack& patchPack, const std::string& extraSettingLabel, const std::string& value)
 {
     getExtraSettingByLabel(patchPack.info.extraSettings, extraSettingLabel).currentValue = value;
+    updateCoresAboutPatchPack_(patchPack);
 }
 
 void PatchManager::restorePatchPackExtraSettingDefaults_(PatchPack& patchPack)
 {
     for (auto& extraSetting : patchPack.info.extraSettings)
         extraSetting.currentValue = extraSetting.defaultValue;
+    updateCoresAboutPatchPack_(patchPack);
 }
 
-void PatchManager::updateCoreAboutHook_(const CoreManager::CoreId coreId, const PatchManager::Hook_& hook) const
+std::string PatchManager::compileHooksAndPatchPacks_(bool& isRelinked) const
 {
-    compileHooksAndPatchPacks();
+    isRelinked = false;
+    std::string output;
+    output.reserve(1024);
+    try
+    {
+        // Only the enabled patch packs and the hooks they use are built
+        std::vector<std::string> neededHookNames;
+        std::vector<std::string> neededPatchPackNames;
+        getNeededHooksAndPatchPacks_(neededHookNames, neededPatchPackNames);
 
-    std::vector<uint8_t> data;
-    data.reserve(1024);
-    serialiseIntegralTypeContinuousContainer(data, hook.hook.serialise());
+        std::vector<PatchPack> neededPatchPacks;
+        neededPatchPacks.reserve(neededPatchPackNames.size());
+        for (const auto& patchPackName : neededPatchPackNames)
+            neededPatchPacks.push_back(*getIteratorToPatchPack_(patchPackName));
 
-    CoreManager::getSingleton().sendPacketTo(coreId, Socket::ServerOpCode::PATCH_HOOK, data);
+        bool isAllSkipped = true;
+        for (const auto& hookName : neededHookNames)
+        {
+            output += "Compiling hook " + hookName + "...\n";
+            bool isSkipped;
+            output += PatchCompiler::compileHook(getIteratorToHook_(hookName)->hook, neededPatchPacks, isSkipped);
+            if (isSkipped)
+                output += "Skipped.\n";
+            else
+                isAllSkipped = false;
+        }
+        for (const auto& patchPackName : neededPatchPackNames)
+        {
+            output += "Compiling patch pack " + patchPackName + "...\n";
+            bool isSkipped;
+            output += PatchCompiler::compilePatchPack(*getIteratorToPatchPack_(patchPackName), getHooks(), isSkipped);
+            if (isSkipped)
+                output += "Skipped.\n";
+            else
+                isAllSkipped = false;
+        }
+        output += "Linking...\n";
+        if (neededHookNames.empty() && neededPatchPackNames.empty())
+        {
+            // Nothing to link, so just make sure nothing stale stays loaded
+            output += "Skipped.\n";
+            CoreManager::getSingleton().sendPacket(Socket::ServerOpCode::PATCH_LIB_UNLOAD, {});
+            // Nothing is loaded anymore, so whatever is enabled next has to be relinked and loaded again
+            SettingsManager::getSingleton().set("PatchCompiler.linkedObjectsCrc32", "");
+        }
+        else
+        {
+            // Enabling or disabling a patch pack changes what is linked without recompiling anything
+            if (isAllSkipped && !PatchCompiler::isLinkNeeded(neededHookNames, neededPatchPackNames))
+                output += "Skipped.\n";
+            else
+            {
+                isRelinked = true;
+                CoreManager::getSingleton().sendPacket(Socket::ServerOpCode::PATCH_LIB_UNLOAD, {});
+                output += PatchCompiler::linkObjects(neededHookNames, neededPatchPackNames, true);
+                std::string patchesFilename = SettingsManager::getSingleton().get("core.patchesLibrary");
+                std::vector<uint8_t> data;
+                serialiseIntegralTypeContinuousContainer(data, patchesFilename);
+                CoreManager::getSingleton().sendPacket(Socket::ServerOpCode::PATCH_LIB_LOAD, data);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        output += e.what();
+        throw std::runtime_error("Failed to compile hooks and patch packs. Output:\n" + output);
+    }
+    return output;
 }
 
-void PatchManager::updateCoresAboutHook_(const PatchManager::Hook_& hook) const
+void PatchManager::getNeededHooksAndPatchPacks_(std::vector<std::string>& hookNames, std::vector<std::string>& patchPackNames) const
 {
-    compileHooksAndPatchPacks();
+    hookNames.clear();
+    patchPackNames.clear();
+    std::set<std::string> hookNamesSeen;
+    for (const auto& patchPack : patchPacks_)
+    {
+        if (!patchPack.info.isCurrentlyEnabled)
+            continue;
+        patchPackNames.push_back(patchPack.info.name);
+        for (const auto& patch : patchPack.patches)
+            if (patch.getType() == Patch::Type::HOOK)
+            {
+                const std::string& hookName = patch.getTypeData<HookPatch>().hookName;
+                if (hookNamesSeen.insert(hookName).second)
+                    hookNames.push_back(hookName);
+            }
+    }
+}
 
-    std::vector<uint8_t> data;
-    data.reserve(1024);
-    serialiseIntegralTypeContinuousContainer(data, hook.hook.serialise());
+void PatchManager::beginBatch_() const
+{
+    ++batchDepth_;
+}
+
+void PatchManager::endBatch_() const
+{
+    if (--batchDepth_ > 0)
+        return;
 
-    CoreManager::getSingleton().sendPacket(Socket::ServerOpCode::PATCH_HOOK, data);
+    // Leave the updates queued if we are unwinding, so the next batch can send them
+    if (std::uncaught_exception())
+        return;
+    flushUpdates_();
 }
 
-void PatchManager::updateCoreAboutPatchPack_(const CoreManager::CoreId coreId, const PatchData::PatchPack& patchPack) const
+void PatchManager::queueUpdate_(PendingUpdate_::Type type, const std::string& name, bool isAllCores, CoreManager::CoreId coreId) const
 {
-    compileHooksAndPatchPacks();
+    PendingUpdate_ pendingUpdate;
+    pendingUpdate.type = type;
+    pendingUpdate.name = name;
+    pendingUpdate.isAllCores = isAllCores;
+    pendingUpdate.coreId = isAllCores ? 0 : coreId;
+    pendingUpdates_.push_back(pendingUpdate);
 
-    std::vector<uint8_t> data;
-    data.reserve(1024);
-    serialiseIntegralTypeContinuousContainer(data, patchPack.serialise());
+    if (batchDepth_ == 0)
+        flushUpdates_();
+}
+
+void PatchManager::flushUpdates_() const
+{
+    if (pendingUpdates_.empty())
+        return;
+    std::vector<PendingUpdate_> pendingUpdates;
+    pendingUpdates.swap(pendingUpdates_);
 
-    CoreManager::getSingleton().sendPacketTo(coreId, Socket::ServerOpCode::PATCH_PACK, data);
+    bool isRelinked;
+    try
+    {
+        compileHooksAndPatchPacks_(isRelinked);
+    }
+    catch (...)
+    {
+        // Keep the updates around so they are sent with the next successful compile
+        pendingUpdates_.insert(pendingUpdates_.begin(), pendingUpdates.begin(), pendingUpdates.end());
+        throw;
+    }
+
+    // If nothing was relinked, cores that are only being told about things now (such
+    // as newly connected cores) never got told to load the patches library
+    std::vector<std::string> neededHookNames;
+    std::vector<std::string> neededPatchPackNames;
+    getNeededHooksAndPatchPacks_(neededHookNames, neededPatchPackNames);
+    if (!isRelinked && !neededPatchPackNames.empty())
+    {
+        std::set<CoreManager::CoreId> coresToLoad;
+        for (const auto& pendingUpdate : pendingUpdates)
+            if (!pendingUpdate.isAllCores)
+                coresToLoad.insert(pendingUpdate.coreId);
+        if (!coresToLoad.empty())
+        {
+            std::vector<uint8_t> data;
+            serialiseIntegralTypeContinuousContainer(data, SettingsManager::getSingleton().get("core.patchesLibrary"));
+            for (const auto& coreId : coresToLoad)
+                CoreManager::getSingleton().sendPacketTo(coreId, Socket::ServerOpCode::PATCH_LIB_LOAD, data);
+        }
+    }
+
+    // Send the hooks first since the patch packs depend on them. Every hook and patch pack is only
+    // sent once per core, in the order it was first queued, with its state at the time of sending.
+    std::set<std::tuple<PendingUpdate_::Type, std::string, bool, CoreManager::CoreId>> sentUpdates;
+    for (const auto type : { PendingUpdate_::Type::HOOK, PendingUpdate_::Type::PATCH_PACK })
+        for (const auto& pendingUpdate : pendingUpdates)
+        {
+            if (pendingUpdate.type != type)
+                continue;
+            if (!sentUpdates.insert(std::make_tuple(pendingUpdate.type, pendingUpdate.name, pendingUpdate.isAllCores, pendingUpdate.coreId)).second)
+                continue;
+
+            // It might have been removed after it was queued
+            std::vector<uint8_t> data;
+            data.reserve(1024);
+            if (type == PendingUpdate_::Type::HOOK)
+            {
+                auto hook = getIteratorToHookNoThrow_(pendingUpdate.name);
+                if (hook == hooks_.end())
+                    continue;
+                serialiseIntegralTypeContinuousContainer(data, hook->hook.serialise());
+            }
+            else
+            {
+                auto patchPack = getIteratorToPatchPackNoThrow_(pendingUpdate.name);
+                if (patchPack == patchPacks_.end())
+                    continue;
+                serialiseIntegralTypeContinuousContainer(data, patchPack->serialise());
+            }
+
+            Socket::ServerOpCode opCode = type == PendingUpdate_::Type::HOOK ? Socket::ServerOpCode::PATCH_HOOK : Socket::ServerOpCode::PATCH_PACK;
+            if (pendingUpdate.isAllCores)
+                CoreManager::getSingleton().sendPacket(opCode, data);
+            else
+                CoreManager::getSingleton().sendPacketTo(pendingUpdate.coreId, opCode, data);
+        }
 }
 
-void PatchManager::updateCoresAboutPatchPack_(const PatchData::PatchPack& patchPack) const
+void PatchManager::updateCoreAboutHook_(const CoreManager::CoreId coreId, const PatchManager::Hook_& hook) const
 {
-    compileHooksAndPatchPacks();
+    queueUpdate_(PendingUpdate_::Type::HOOK, hook.hook.name, false, coreId);
+}
 
-    std::vector<uint8_t> data;
-    data.reserve(1024);
-    serialiseIntegralTypeContinuousContainer(data, patchPack.serialise());
+void PatchManager::updateCoresAboutHook_(const PatchManager::Hook_& hook) const
+{
+    queueUpdate_(PendingUpdate_::Type::HOOK, hook.hook.name, true);
+}
 
-    CoreManager::getSingleton().sendPacket(Socket::ServerOpCode::PATCH_PACK, data);
+void PatchManager::updateCoreAboutPatchPack_(const CoreManager::CoreId coreId, const PatchData::PatchPack& patchPack) const
+{
+    queueUpdate_(PendingUpdate_::Type::PATCH_PACK, patchPack.info.name, false, coreId);
+}
+
+void PatchManager::updateCoresAboutPatchPack_(const PatchData::PatchPack& patchPack) const
+{
+    queueUpdate_(PendingUpdate_::Type::PATCH_PACK, patchPack.info.name, true);
 }
@@ -59,6 +59,10 @@ SettingsManager::SettingsManager()
     setDefault("CoreManager.libraryPath", ".");
     setDefault("CoreManager.coreLibrary", "core");
     setDefault("CoreManager.patchesLibrary", "patches");
+    setDefault("CoreManager.resolutionCacheFile", "resolution.cache"); // Blank to always search
+    setDefault("CoreManager.bakeManifestFile", ""); // Written by PatchBaker::bake(). Blank if nothing was baked.
+    setDefault("CoreManager.sharedPagesPath", ""); // Where cores share patched code pages from. Blank to keep them private to each process.
+    setDefault("CoreManager.isHugePagesEnabled", "0"); // Moves patched modules' code onto 2 MB pages, for large targets that miss the iTLB a lot
 }
 
 SettingsManager::~SettingsManager()
@@ -61,6 +61,7 @@ class MANAGER_EXPORT CoreManager final
         void endCoreConnection(const CoreId coreId);
         void endCore(const CoreId coreId);
         std::vector<CoreId> getConnectedCores() const;
+        std::map<std::string, int64_t> getCoreMetrics(const CoreId coreId) const; // The last value the core sent of each
 
         void addReceiveHandler(const Socket::ClientOpCode opCode, receiveHandler_t receiveHandler);
         void removeReceiveHandler(const Socket::ClientOpCode opCode, receiveHandler_t receiveHandler);
@@ -85,8 +86,11 @@ class MANAGER_EXPORT CoreManager final
         CoreId finishConnectCore_(ProcessId pid, Socket::Socket listenSocket, const std::string& coreName);
 
         void endAllCoreConnections_();
+        static void removeSharedPageFiles_();
 
         static void logReceiveHandler_(CoreId coreId, const std::vector<uint8_t>& data);
+        static void resolutionReceiveHandler_(CoreId coreId, const std::vector<uint8_t>& data);
+        static void metricReceiveHandler_(CoreId coreId, const std::vector<uint8_t>& data);
 
         static void coreListener_(CoreManager* self);
 
@@ -94,6 +98,10 @@ class MANAGER_EXPORT CoreManager final
         std::map<CoreId, std::pair<ProcessId, Socket::Socket>> cores_;
         std::recursive_mutex receiveHandlersMutex_; // Should be just a normal mutex
         mutable std::recursive_mutex coresMutex_;
+        std::map<std::pair<std::string, uint64_t>, std::vector<size_t>> resolutions_; // RVAs by module fingerprint and search hash, as found by any core
+        std::mutex resolutionsMutex_;
+        std::map<CoreId, std::map<std::string, int64_t>> coreMetrics_;
+        mutable std::mutex coreMetricsMutex_;
 
     #if !defined(_GLIBCXX_HAS_GTHREADS) && defined(_WIN32)
         win32::HANDLE coreListenerThread_;
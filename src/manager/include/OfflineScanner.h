@@ -0,0 +1,56 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef OFFLINESCANNER_H
+#define OFFLINESCANNER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <utility>
+
+#include "Hook.h"
+#include "Patch.h"
+#include "Search.h"
+#include "Misc.h"
+
+// Runs the searches of hooks and patch packs against the modules' files on disk instead of inside the
+// target, and writes where they were found to a plan. The plan is a resolution cache file, so cores
+// given it with the "CoreManager.resolutionCacheFile" setting only have to check each result.
+class MANAGER_EXPORT OfflineScanner final
+{
+    public:
+        OfflineScanner() = default;
+        OfflineScanner(const OfflineScanner&) = delete;
+        OfflineScanner& operator=(const OfflineScanner&) = delete;
+        ~OfflineScanner() = default;
+
+        void addModule(const std::string& moduleName, const std::string& pathfile); // `moduleName' as searches name it: its file name or pathfile, even for the main executable
+        void addHook(const PatchData::Hook& hook);
+        void addPatchPack(const PatchData::PatchPack& patchPack);
+        void addFromPatchManager(); // Every registered hook and loaded patch pack
+
+        std::vector<std::string> writePlan(const std::string& planPathfile) const; // Returns why each search that wasn't written couldn't be
+
+    private:
+        std::map<std::string, std::string> modulePathfiles_;
+        std::vector<std::pair<std::string, std::shared_ptr<const PatchData::Search>>> searches_; // With a description of where each came from
+};
+
+#endif
@@ -0,0 +1,36 @@
+/*
+    This file is part of Memory Patcher.
+
+    Memory Patcher is free software: you can redistribute it and/or modify
+    it under the terms of the GNU Lesser General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    Memory Patcher is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+    GNU Lesser General Public License for more details.
+
+    You should have received a copy of the GNU Lesser General Public License
+    along with Memory Patcher. If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#pragma once
+#ifndef PATCHBAKER_H
+#define PATCHBAKER_H
+
+#include <string>
+
+#include "Patch.h"
+#include "Misc.h"
+
+namespace PatchBaker
+{
+    // Finds the replace patches of `patchPack' in `pathfile', the ELF file of `moduleName', and writes a copy with them
+    // already applied to `bakedPathfile'. What was changed is added to the manifests in `manifestPathfile', which cores
+    // given it with the "CoreManager.bakeManifestFile" setting check, leaving the patch pack alone if it's baked in.
+    MANAGER_EXPORT void bake(const PatchData::PatchPack& patchPack, const std::string& moduleName, const std::string& pathfile,
+        const std::string& bakedPathfile, const std::string& manifestPathfile);
+}
+
+#endif
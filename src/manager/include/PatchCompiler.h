@@ -20,6 +20,7 @@
 #define PATCHCOMPILER_H
 
 #include <string>
+#include <vector>
 
 #include "Hook.h"
 #include "Patch.h"
@@ -28,8 +29,12 @@
 namespace PatchCompiler
 {
     MANAGER_EXPORT std::string compileHook(const PatchData::Hook& hook, bool& isSkipped, bool force = false);
+    MANAGER_EXPORT std::string compileHook(const PatchData::Hook& hook, const std::vector<PatchData::PatchPack>& patchPacks, bool& isSkipped, bool force = false); // Specialised for the hook patches in `patchPacks'
     MANAGER_EXPORT std::string compilePatchPack(const PatchData::PatchPack& patchPack, bool& isSkipped, bool force = false);
+    MANAGER_EXPORT std::string compilePatchPack(const PatchData::PatchPack& patchPack, const std::vector<PatchData::Hook>& hooks, bool& isSkipped, bool force = false); // Needed for hook patches of function hooks
     MANAGER_EXPORT std::string linkObjects(bool force = false);
+    MANAGER_EXPORT std::string linkObjects(const std::vector<std::string>& hookNames, const std::vector<std::string>& patchPackNames, bool force = false);
+    MANAGER_EXPORT bool isLinkNeeded(const std::vector<std::string>& hookNames, const std::vector<std::string>& patchPackNames);
 }
 
 #endif
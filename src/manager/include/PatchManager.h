@@ -31,10 +31,24 @@
 class MANAGER_EXPORT PatchManager final
 {
     public:
+        // While at least one batch is alive, compiling and updating the cores is deferred.
+        // When the outermost batch is destroyed, everything changed within it is compiled
+        // and linked once and the cores are updated once.
+        class MANAGER_EXPORT Batch final
+        {
+            public:
+                Batch();
+                Batch(const Batch&) = delete;
+                Batch& operator=(const Batch&) = delete;
+                ~Batch() noexcept(false);
+        };
+
         void registerHook(const PatchData::Hook& hook);
         void unregisterHook(const std::string& name);
         void unregisterAllHooks();
         bool isHookRegistered(const std::string& name) const noexcept;
+        void setHookThreadFiltered(const std::string& name, bool isThreadFiltered); // Only call the hook in threads that enabled it in the core
+        void setHookSampleInterval(const std::string& name, uint32_t sampleInterval); // Only call the hook once every `sampleInterval' times
 
         void addPatchPack(const PatchData::PatchPack& patchPack);
         void removePatchPack(const std::string& name);
@@ -69,11 +83,20 @@ class MANAGER_EXPORT PatchManager final
         static PatchManager& getSingleton();
 
     private:
-        PatchManager() = default;
+        PatchManager();
         PatchManager(const PatchManager&) = delete;
         PatchManager& operator=(const PatchManager&) = delete;
         ~PatchManager() = default;
 
+        class PendingUpdate_ final
+        {
+            public:
+                enum class Type { HOOK, PATCH_PACK } type;
+                std::string name;
+                bool isAllCores;
+                CoreManager::CoreId coreId; // Ignored if `isAllCores' is set
+        };
+
         class Hook_ final
         {
             public:
@@ -98,6 +121,14 @@ class MANAGER_EXPORT PatchManager final
         void setPatchPackExtraSettingValue_(PatchData::PatchPack& patchPack, const std::string& extraSettingLabel, const std::string& value);
         void restorePatchPackExtraSettingDefaults_(PatchData::PatchPack& patchPack);
 
+        std::string compileHooksAndPatchPacks_(bool& isRelinked) const;
+        void getNeededHooksAndPatchPacks_(std::vector<std::string>& hookNames, std::vector<std::string>& patchPackNames) const;
+
+        void beginBatch_() const;
+        void endBatch_() const;
+        void queueUpdate_(PendingUpdate_::Type type, const std::string& name, bool isAllCores, CoreManager::CoreId coreId = 0) const;
+        void flushUpdates_() const;
+
         void updateCoreAboutHook_(const CoreManager::CoreId coreId, const Hook_& hook) const;
         void updateCoresAboutHook_(const Hook_& hook) const;
         void updateCoreAboutPatchPack_(const CoreManager::CoreId coreId, const PatchData::PatchPack& patchPack) const;
@@ -105,6 +136,9 @@ class MANAGER_EXPORT PatchManager final
 
         std::vector<Hook_> hooks_;
         std::vector<PatchData::PatchPack> patchPacks_;
+
+        mutable size_t batchDepth_;
+        mutable std::vector<PendingUpdate_> pendingUpdates_;
 };
 
 #endif